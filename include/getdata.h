@@ -75,6 +75,22 @@ struct FormatType *GetFormat(const char *filedir, const char *linterp_prefix, in
 /***************************************************************************/
 void GetDataClose(struct FormatType *F);
 
+/***************************************************************************/
+/*                                                                         */
+/*    Free decoded slim fields and kept slim handles, once nobody is       */
+/*    reading from F.  Reads after this just decode again if they need to. */
+/*                                                                         */
+/***************************************************************************/
+void GetDataDropDecoded(struct FormatType *F);
+
+/***************************************************************************/
+/*                                                                         */
+/*    Check the vectorised conversions against the scalar ones, and time   */
+/*    them on nbench samples if nbench>0.  Returns # of mismatches.        */
+/*                                                                         */
+/***************************************************************************/
+int GetDataCheckConversions(int nbench);
+
 
 #ifdef __cplusplus
 } // extern "C"
@@ -75,6 +75,36 @@ typedef struct {
 
 } TiledPointingFit;
 /*--------------------------------------------------------------------------------*/
+
+//saved pixelization for one detector, delta-coded in blocks of NK_PIX_BLOCK samples.  
+//Each block keeps its starting pixel so blocks can be decoded independently.
+typedef struct {
+  int nblock;
+  int *base;             //pixel of the first sample in each block
+  unsigned char *mode;   //how the deltas in each block are stored
+  int *offset;           //byte offset of each block in stream, nblock+1 long
+  unsigned char *stream;
+} PackedPixelizationDet;
+
+typedef struct {
+  int ndet;
+  int ndata;
+  int stride;            //pixel step between map rows, deltas are split into row/column steps
+  PackedPixelizationDet *dets;
+} PackedPixelization;
+/*--------------------------------------------------------------------------------*/
+
+//on-disk cache of pointing products for one TOD.  The key describes everything the pointing
+//depends on (TOD, boresight, offsets, cuts); files are only opened when a product is asked for.
+typedef struct {
+  char *dir;
+  char *key;
+  unsigned long hash;         //hash of key, goes into the file names
+  unsigned long radec_hash;   //source of ra_saved/dec_saved if they came from the cache machinery, 0 otherwise
+  void *pix_map;              //mapping that pixelization_saved points into, if it was loaded from the cache
+  size_t pix_map_len;
+} PointingCache;
+/*--------------------------------------------------------------------------------*/
 #ifdef ACTPOL
 typedef struct {
   int nhorn;
@@ -181,6 +211,8 @@ typedef struct {
                        //!< where det_number is the detector index into the rows, cols arrays.
   actData **calib_facs_saved;  //2D-array where calibration factors for the data are saved.
   int have_data;
+  void *data_map;      //!< if set, data rows point into this mapping of a TOD container.
+  size_t data_map_len;
   int decimate;        //!< decimate factor - for each value here, apply a factor of 2 decimation to the data.
   int n_to_window;     //!< how many samples at end to cut/window out.
 
@@ -249,6 +281,9 @@ typedef struct {
 
   PointingFit *pointing_fit;  //pointing fit, turn alt/az into ra/dec
   int **pixelization_saved;  //save a map pixelization in here.  Will break if there are multiple classes of maps with different pixelizations.
+  PackedPixelization *pixelization_packed;  //compressed version of the above, use one or the other.
+  struct map_tile_buckets_s *tile_buckets;  //samples bucketed by map tile, kept while the data is.
+  PointingCache *pointing_cache;  //where to find/keep pointing products between runs, NULL for none.
   actData **ra_saved;
   actData **dec_saved;
   actData **data_saved;
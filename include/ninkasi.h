@@ -136,6 +136,7 @@ act_fftw_plan act_fftw_plan_dft_c2r_1d(int n, act_fftw_complex *vec2,actData *ve
 
 
 void createFFTWplans1TOD(mbTOD *mytod);
+void filter_data(mbTOD *tod);
 void copy_mapset2mapset(MAPvec *map2, MAPvec *map);
 actData mapset_times_mapset(MAPvec *x, MAPvec *y);
 void remove_common_mode(mbTOD *tod);
@@ -153,6 +154,7 @@ void destroy_map(MAP *map);
 FILE *fopen_safe(char *filename, char *mode);
 void get_pointing_vec(const mbTOD *tod, const MAP *map, int det, int *ind);
 void get_pointing_vec_new(const mbTOD *tod, const MAP *map, int det, int *ind, PointingFitScratch *scratch);
+void get_all_pointing_vecs(const mbTOD *tod, const MAP *map, const PARAMS *params, int **inds);
 void write_tod_pointing_to_disk(const mbTOD *tod, char *fname);
 void mapset2det(const MAPvec *maps, mbTOD *tod, const PARAMS *params, actData *vec, int *ind, int det, PointingFitScratch *scratch);
 void map2tod(const MAP *map, mbTOD *tod,const PARAMS *params);
@@ -174,6 +176,15 @@ double *dvector(long n);
 actComplex *cvector(long n);
 int how_many_tods(char *froot, PARAMS *params);
 int find_my_tods(TODvec *tods, PARAMS *params);
+actData predict_tod_cost(int ndet, int ndata, const PARAMS *params);
+int *assign_tods_by_cost(const actData *cost, int ntod, int nproc, actData *load);
+void report_tod_balance(TODvec *tods);
+void write_tod_costs(TODvec *tods, PARAMS *params, char *fname);
+void free_tod_task_pool();
+void setup_tod_stream(TODvec *tods, PARAMS *params);
+void stream_tod_in(TODvec *tods, int i);
+void stream_tod_out(TODvec *tods, int i);
+void destroy_tod_stream(TODvec *tods);
 int read_all_tod_headers(TODvec *tods,PARAMS *params);
 void set_global_radec_lims(TODvec *tods);
 actData tocksilent(pca_time *tt);
@@ -194,6 +205,13 @@ int setup_maps(MAPvec *maps, PARAMS *params);
 void clear_mapset(MAPvec *maps);
 void createFFTWplans(TODvec *tod);
 void run_PCG(MAPvec *maps, TODvec *tods, PARAMS *params);
+PCGWork *allocate_pcg_work(MAPvec *r);
+void destroy_pcg_work(PCGWork *work);
+actData PCGstep_work(MAPvec *r, MAPvec *p, MAPvec *x, TODvec *tods, MAPvec *wts, PARAMS *params, PCGWork *work);
+actData PCGstep(MAPvec *r, MAPvec *p, MAPvec *x, TODvec *tods, MAPvec *wts, PARAMS *params);
+MAPvec *make_mapset_copy(MAPvec *maps);
+void destroy_mapset(MAPvec *maps);
+void mapset2mapset(MAPvec *maps, TODvec *tods, PARAMS *params);
 
 void allocate_tod_storage(mbTOD *tod);
 void tod2mapset(MAPvec *maps, mbTOD *tod, PARAMS *params);
@@ -211,6 +229,28 @@ void tod2map(MAP *map, mbTOD *tod, PARAMS *params);
 void tod2polmap(MAP *map,mbTOD *tod);
 void tod2polmap_copy(MAP *map,mbTOD *tod);
 int *tod2map_actpol(MAP *map, mbTOD *tod, int *ipiv_proc);
+void set_map_pivots_from_hit_map(MAP *map, const MAP *hitmap);
+void clear_map_pivots(MAP *map);
+MapTileBuckets *bucket_tod_by_map_tile(const MAP *map, const mbTOD *tod, const PARAMS *params, bool use_kept, int nthread);
+void destroy_map_tile_buckets(MapTileBuckets *buckets);
+MapTileBuckets *get_tod_map_tile_buckets(const MAP *map, mbTOD *tod, const PARAMS *params, bool use_kept, int nthread);
+void free_tod_map_tile_buckets(mbTOD *tod);
+void tod2map_tiled(MAP *map, mbTOD *tod, const PARAMS *params);
+void tod2map_sparse(MAP *map, mbTOD *tod, const PARAMS *params);
+actData *get_map_tile(MAP *map, long tile);
+long count_map_tiles(const MAP *map);
+void tile_map(MAP *map);
+void untile_map(MAP *map);
+#ifdef HAVE_MPI
+MapCommPattern *setup_map_comm(const MAP *map, TODvec *tods, PARAMS *params);
+void destroy_map_comm(MapCommPattern *comm);
+void setup_mapset_comm(MAPvec *maps, TODvec *tods, PARAMS *params);
+void free_mapset_comm(MAPvec *maps);
+int mpi_reduce_distributed_map(MAP *out, MAP *in);
+int mpi_fetch_map_ghosts(MAP *map);
+int mpi_fetch_mapset_ghosts(MAPvec *maps);
+#endif
+actData tod_times_map_tiled(const MAP *map, mbTOD *tod, const PARAMS *params);
 
 
 actData tod_times_map(const MAP *map, const mbTOD *tod, PARAMS *params);
@@ -222,6 +262,7 @@ MAP *upres_map(MAP *map);
 
 actData map_times_map(MAP *x, MAP *y);
 void map_axpy(MAP *y, MAP *x, actData a);
+void mapset_axpy(MAPvec *y, MAPvec *x, actData a);
 bool is_det_listed(const mbTOD *tod, const PARAMS *params, int det);
 void purge_cut_detectors(mbTOD *tod);
 mbUncut ***get_uncut_regions(mbTOD *tod);
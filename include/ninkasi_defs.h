@@ -26,6 +26,19 @@
 //#define MAX_DET_FFT 400  //Due to some odd seg faulting behavior with MKL/FFTW interactions.
 
 #define ACT_NO_VALUE -98747423
+#define NK_MAP_TILE_LEN 4096  //pixels per tile in the bucketed projection, ~L1/L2 sized.
+#define NK_PIX_BLOCK 128  //samples per independently decodable block of a packed pixelization.
+#define NK_MPI_REDUCE_CHUNK 1048576  //pixels per non-blocking allreduce when summing maps over processes.
+#define NK_TOD_COST_PROJ 4.0  //per-sample cost of projecting to and from the map, relative to...
+#define NK_TOD_COST_FFT 1.0   //...the per-sample, per-log2(n) cost of the noise filter FFTs.
+#define NK_TASK_DETS_PER_THREAD 16  //TODs with fewer detectors per thread than this run as concurrent tasks.
+#define NK_POINTING_BLOCK 16  //detectors per block when pixelizing a whole TOD, pivots are evaluated a block at a time.
+#define NK_FFT_SPLIT 0     //noise FFTs: one plan per detector, detectors spread over OpenMP threads
+#define NK_FFT_BATCHED 1   //one plan per block of NK_FFT_BATCH detectors, blocks spread over threads
+#define NK_FFT_THREADED 2  //one plan for all detectors, run on FFTW's own threads
+#define NK_FFT_BATCH 8     //default detectors per block for NK_FFT_BATCHED
+#define NK_NOISE_FFT 0     //noise filters in the periodic r2c/c2r basis
+#define NK_NOISE_DCT 1     //noise filters in the DCT-II/III basis, no windowing around them
 
 #ifndef INT_MAX
 #define INT_MAX 2147483647
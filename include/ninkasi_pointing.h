@@ -24,6 +24,11 @@ typedef struct {
   actData *dec_coarse;
   actData *time_coarse;
 
+  //boresight at the pivots, shared by every detector.  Filled once when the scratch is made.
+  actData *tod_alt_coarse;
+  actData *tod_az_coarse;
+  actData *tod_secalt_coarse;
+
 #ifdef ACTPOL
   actData *sin2gamma;
   actData *cos2gamma;
@@ -52,8 +57,11 @@ void get_radec_from_altaz_fit_tiled(const TiledPointingFit *tile, actData *alt,
 void get_radec_from_altaz_exact_1det(const mbTOD *tod,int det,    PointingFitScratch *scratch);
 void get_radec_from_altaz_fit_1det(const mbTOD *tod,int det, PointingFitScratch *scratch);
 void get_radec_from_altaz_fit_1det_coarse(const mbTOD *tod, int det, PointingFitScratch *scratch);
+void interp_coarse_pointing(const int *ind, int ncoarse, int ndata, const actData *ra_coarse, const actData *dec_coarse, actData ra_rate, actData dec_rate, actData ra_off, actData dec_off, actData *ra, actData *dec);
+void get_radec_coarse_ndet(const mbTOD *tod, const int *dets, int ndet, actData **ra_coarse, actData **dec_coarse, PointingFitScratch *scratch);
 void get_radec_from_altaz_fit_1det_coarse_exact(const mbTOD *tod, int det, PointingFitScratch *scratch);
 actData find_max_pointing_err(const mbTOD *tod);
+int check_pointing_pivots(int nscan, actData tol, unsigned seed);
 
 void destroy_pointing_fit_scratch(PointingFitScratch *scratch);
 PointingFitScratch *allocate_pointing_fit_scratch(const mbTOD *tod);
@@ -61,8 +69,19 @@ mbPointingOffset *nkPointingOffsetAlloc(int nrow,int ncol,int fitType);
 
 void destroy_pointing_offset(mbPointingOffset *pt);
 int *find_az_turnarounds(mbTOD *tod, int *nturn);
-void find_pointing_pivots(mbTOD *tod, actData tol);
+actData find_pointing_pivots(mbTOD *tod, actData tol);
 void shift_tod_pointing(mbTOD *tod, actData ra_shift, actData dec_shift);
+
+typedef struct pointing_cache_writer_s PointingCacheWriter;
+unsigned long pointing_cache_hash(const void *buf, long nbyte, unsigned long hash);
+PointingCache *setup_pointing_cache(const mbTOD *tod, const char *dir, const char *froot, const char *offset_file);
+void destroy_pointing_cache(PointingCache *cache);
+PointingCacheWriter *open_pointing_cache_writer(const PointingCache *cache, const char *kind, const char *subkey, int ndet, int ndata);
+void write_pointing_cache_chunk(PointingCacheWriter *w, const void *buf, long nbyte);
+int close_pointing_cache_writer(PointingCacheWriter *w);
+const void *map_pointing_cache_file(const PointingCache *cache, const char *kind, const char *subkey, int ndet, int ndata, long *nbyte, void **map, size_t *maplen);
+int load_pointing_fit_cache(mbTOD *tod);
+void save_pointing_fit_cache(const mbTOD *tod);
 int act_observed_altaz_to_mean_radec( const Site *site, double freq_GHz,
         int n, const double ctime[], const actData alt[], const actData az[],
 				      actData ra[], actData dec[] );
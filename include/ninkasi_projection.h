@@ -36,6 +36,7 @@ typedef struct {
 void radecvec2cea_pix(const actData *ra, const actData *dec, int *rapix, int *decpix, int *ind, int ndata, const MAP *map);
 void get_map_projection(const mbTOD *tod, const MAP *map, int det, int *ind, PointingFitScratch *scratch);
 void get_map_projection_wchecks(const mbTOD *tod, const MAP *map, int det, int *ind, PointingFitScratch *scratch, bool *inbounds);
+void get_map_projection_ndet(const mbTOD *tod, const MAP *map, const int *dets, int ndet, int **ind, PointingFitScratch *scratch);
 int set_map_projection_cea_simple( MAP *map);
 int set_map_projection_tan_simple( MAP *map);
 int set_map_projection_cea_simple_keeppix( MAP *map);
@@ -57,7 +58,23 @@ nkProjection *deres_projection(nkProjection *proj);
 nkProjection *upres_projection(nkProjection *proj);
 
 void convert_radec_to_map_pixel(const actData *ra, const actData *dec, int *ind, long ndata, const MAP *map);
+void convert_radec_to_map_pixel_exact(const actData *ra, const actData *dec, int *ind, long ndata, const MAP *map);
+void radecvec2rect_pix(const actData *ra, const actData *dec, int *ind, long ndata, const MAP *map);
+void radecvec2tan_pix(const actData *ra, const actData *dec, int *ind, long ndata, const MAP *map);
+long check_projection_kernels(const MAP *map, long npt, long seed);
 void convert_saved_pointing_to_pixellization(mbTOD *tod, MAP *map);
+int get_map_pixel_stride(const MAP *map);
+void pack_pixelization_det(const int *ind, int ndata, int stride, PackedPixelizationDet *pd);
+int unpack_pixelization_block(const PackedPixelization *pix, int det, int block, int *ind);
+void unpack_pixelization_det(const PackedPixelization *pix, int det, int *ind);
+const int *get_saved_pixelization(const mbTOD *tod, int det, int *buf);
+PackedPixelization *allocate_packed_pixelization(int ndet, int ndata, int stride);
+void destroy_packed_pixelization(PackedPixelization *pix);
+long get_packed_pixelization_nbyte(const PackedPixelization *pix);
+void pack_saved_pixelization(mbTOD *tod, const MAP *map);
+int load_pixelization_cache(mbTOD *tod, const MAP *map, const char *source);
+void save_pixelization_cache(const mbTOD *tod, const MAP *map, const char *source);
+void free_saved_pixelization(mbTOD *tod);
 
 
 #endif
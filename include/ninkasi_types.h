@@ -30,6 +30,24 @@ struct params_struct_s {
 
 
   bool write_pointing;
+  char pointing_cache[MAXLEN];  //directory for the on-disk pointing/pixelization cache, empty for none.
+  char fft_wisdom[MAXLEN];  //FFTW wisdom file, read at startup and written at the end.  Empty for none.
+  unsigned fft_plan_flags;  //planner rigor for the noise FFTs, FFTW_ESTIMATE by default.
+  int fft_mode;  //NK_FFT_SPLIT, NK_FFT_BATCHED or NK_FFT_THREADED.
+  int fft_threads;  //threads per TOD for the noise FFTs, 0 for all of them.
+  int fft_batch;  //detectors per plan with NK_FFT_BATCHED.
+  bool fft_benchmark;  //time the FFT strategies on my TOD shapes and quit.
+  bool noise_dct;  //filter noise in the DCT basis instead of the periodic FFT one.
+  bool reduce_bbox;  //only allreduce the part of the maps some process touched.
+  long mpi_chunk;  //pixels per non-blocking allreduce when reducing maps.
+  bool tiled_maps;  //store maps as sparse tiles allocated on first hit.
+  bool distributed_maps;  //each process only keeps the tiles it owns or its TODs hit.
+  bool balance_tods;  //hand out TODs by predicted cost instead of round robin.
+  bool tod_tasks;  //run narrow TODs several at a time in mapset2mapset.
+  char stream_dir[MAXLEN];  //scratch directory for out-of-core TOD pointing, empty to keep everything in memory.
+  actData stream_mem;  //MB of TOD pointing to keep in memory when streaming.
+  char tod_cost_file[MAXLEN];  //measured per-TOD costs, read to balance and written at the end.
+  char nktod_dir[MAXLEN];  //convert my TODs to containers in this directory and quit, empty for none.
 
   
   int n_use_rows;
@@ -41,6 +59,8 @@ struct params_struct_s {
 typedef struct params_struct_s PARAMS;
 /*--------------------------------------------------------------------------------*/
 
+typedef struct tod_stream_s TodStream;
+
 struct todvec_struct_s {
   int ntod; //# of privately owned tod's
   int total_tod;  //total number of tod's
@@ -48,6 +68,10 @@ struct todvec_struct_s {
   char **my_fnames;
   //char *froot;
   char froot[MAXLEN];
+  int *my_index;     //position of each of my TODs in the global list
+  actData *tod_cost; //predicted (or previously measured) cost of each of my TODs
+  actData *tod_time; //seconds each of my TODs took in the last mapset2mapset
+  struct tod_stream_s *stream;  //set if some TODs keep their pointing on disk
   
   actData ramin,ramax,decmin,decmax;  //global ra/dec limits
 
@@ -66,6 +90,25 @@ typedef struct todvec_struct_s TODvec;
 
 
 
+//communication pattern of a distributed map: every observed tile has one owning process,
+//and each process keeps ghost copies of the tiles its own TODs hit.  Built once per run.
+struct map_comm_s {
+  int nproc;
+  int myid;
+  long ntile;
+  int *owner;         //owning process of each tile, -1 if nobody observes it
+  long nowned;
+  long nsend;         //ghost tiles I hit, grouped by owner
+  long *send_tiles;
+  int *send_count;    //per process, in pixels
+  int *send_displ;
+  long nrecv;         //my tiles hit by other processes, grouped by process
+  long *recv_tiles;
+  int *recv_count;
+  int *recv_displ;
+};
+typedef struct map_comm_s MapCommPattern;
+
 struct map_struct_s {
   actData pixsize;
   actData ramin,ramax,decmin,decmax;
@@ -84,6 +127,17 @@ struct map_struct_s {
   int lock_len;
   int nlock;
 
+  //per-thread pixel ranges for the pivoted projections (tod2map, tod2polmap, tod2map_actpol),
+  //set by run_PCG and cached across iterations.
+  int *ipiv_proc;
+  int npiv_proc;
+
+  //sparse storage.  If tiles is set, map is NULL and pixels live in NK_MAP_TILE_LEN
+  //long tiles that are only allocated once something lands in them.
+  actData **tiles;
+  long ntile;
+  MapCommPattern *comm;  //set if the map is distributed over processes, shared by copies.
+
   nkProjection *projection;
 } map_struct;
 typedef struct map_struct_s MAP;
@@ -95,6 +149,40 @@ struct mapvec_struct_s {
   MAP **maps;
 } mapvec_struct;
 typedef struct mapvec_struct_s MAPvec;
+/*--------------------------------------------------------------------------------*/
+
+//samples of a TOD bucketed by the map tile they land in, so that threads can
+//own disjoint tile ranges and accumulate into the map without locks or copies.
+struct map_tile_buckets_s {
+  int tile_len;     //pixels per tile
+  long ntile;
+  long nsamp;
+  long *tile_start; //ntile+1 offsets into pix/det/samp
+  int *pix;         //map pixel of each bucketed sample
+  int *det;         //detector of each bucketed sample
+  int *samp;        //sample index within the detector
+  int nthread;
+  long *thread_tile;  //nthread+1 tile boundaries, balanced by sample count
+
+  //what the buckets were made for, so they can be kept on the TOD and reused.
+  const nkProjection *projection;
+  long npix;
+  const PARAMS *params;
+  bool kept;        //samples came from kept_data rather than the uncuts
+};
+typedef struct map_tile_buckets_s MapTileBuckets;
+/*--------------------------------------------------------------------------------*/
+
+//work vectors kept alive across PCG iterations.  mr holds the preconditioned
+//residual M^-1 r from the end of the previous step, so it (and r.mr) never
+//have to be recomputed at the start of the next one.
+struct pcg_work_s {
+  MAPvec *ap;      //A p
+  MAPvec *mr;      //M^-1 r
+  actData rmr;     //r.mr, valid if have_mr
+  bool have_mr;
+};
+typedef struct pcg_work_s PCGWork;
 
 
 #endif
@@ -46,6 +46,17 @@ actComplex **fft_all_data(mbTOD *tod);
 void ifft_all_data(mbTOD *tod,actComplex **data_fft) ;
 void ifft_all_data_flag(mbTOD *tod,actComplex **data_fft,unsigned flag);
 actComplex **fft_all_data_flag(mbTOD *tod, unsigned flags);
+void set_fft_plan_flags(unsigned flags);
+void set_fft_threading(int mode, int nthread, int batch);
+void set_noise_basis(int basis);
+int get_noise_basis(void);
+void benchmark_noise_ffts(int ndet, int ndata, int nrep);
+actData check_noise_dct_white(int ndet, int ndata, long seed);
+void destroy_fft_plan_cache(void);
+void free_noise_workspace(void);
+void free_all_noise_workspaces(void);
+int import_fft_wisdom(const char *fname);
+int export_fft_wisdom(const char *fname);
 actData **get_banded_correlation_matrix_from_fft(mbTOD *tod, actComplex **data_fft, actData nu_min, actData nu_max);
 void act_syrk(char uplo, char trans, int n, int m, actData alpha, actData *a, int lda, actData beta, actData *b, int ldb);
 void get_eigenvectors(actData **mat, int n);
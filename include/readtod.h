@@ -3,16 +3,31 @@
 
 #include "mbTOD.h"
 
+struct FormatType;
+
 
 void *dirfile_read_channel_direct(char typechar, const char *filename, const char *channelname, int *nsamples_out);
 
 
 void read_dirfile_tod_data (mbTOD *tod);
+void prefetch_dirfile_tod_data(mbTOD *tod);
+const struct FormatType *get_dirfile_format(const char *filename);
+void release_dirfile_format(const struct FormatType *format);
+void free_dirfile_format_cache();
+int is_nktod_file(const char *filename);
+mbTOD *read_nktod_header(const char *filename);
+int read_nktod_size(const char *filename, int *ndet, int *ndata);
+void read_nktod_data(mbTOD *tod);
+int write_nktod(const mbTOD *tod, const char *filename, int compress);
+int convert_dirfile_to_nktod(const char *dirfile, const char *filename, int compress);
 actData **read_dirfile_tod_data_from_rowcol_list (mbTOD *tod, int *row, int *col, int ndet, actData **data);
 
 mbTOD *
 read_dirfile_tod_header( const char *filename );
 
+int
+read_dirfile_tod_size( const char *filename, int *ndet, int *ndata );
+
 
 mbTOD *
 read_dirfile_tod( const char *filename );
@@ -14,7 +14,10 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <libgen.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <string.h>
@@ -50,6 +53,31 @@ struct FileHandle {
   SLIMFILE *slim;
 };
 
+/* Plain (uncompressed, unzipped) raw files get mmapped the first time they */
+/* are read and stay mapped until the format is closed.  Slimmed fields     */
+/* keep their open handle after a read, so a read starting where the last   */
+/* one stopped (streaming in chunks) just carries on decompressing.  Only a */
+/* read that would have to seek decodes the whole field, while it fits in   */
+/* GD_SLIM_CACHE_BYTES; GetDataDropDecoded hands that memory back.  One     */
+/* entry per raw field, in the same order as F->rawEntries.                 */
+#define GD_SLIM_CACHE_BYTES (64L*1024*1024)
+
+struct RawMapEntry {
+  int state;  /* 0: not tried, 1: mapped, 2: decoded, 3: being decoded, -1: use zzip/slim */
+  const unsigned char *addr;
+  size_t len;
+  SLIMFILE *cursor;  /* slim handle left by the last read, positioned at cursor_at */
+  long cursor_at;
+};
+
+struct RawMapCache {
+  pthread_mutex_t lock;
+  pthread_cond_t decoded;
+  long slim_bytes;
+  int n;
+  struct RawMapEntry *entries;
+};
+
 struct LincomEntryType {
   char field[FIELD_LENGTH+1];
   int n_infields;
@@ -103,6 +131,7 @@ struct FormatType {
   int n_mplex;
   struct BitEntryType *bitEntries;
   int n_bit;
+  struct RawMapCache *raw_maps;
 };
 
 const int  MAX_GETDATA_FILES_OPEN=128;
@@ -297,6 +326,18 @@ static int GetLine(FILE *fp, char *line) {
 /*                                                                         */
 /***************************************************************************/
 static void FreeF(struct FormatType *F) {
+  if (F->raw_maps) {
+    GetDataDropDecoded(F);
+    for (int i=0; i<F->raw_maps->n; i++) {
+      if (F->raw_maps->entries[i].state == 1)
+        munmap((void *)F->raw_maps->entries[i].addr, F->raw_maps->entries[i].len);
+    }
+    pthread_mutex_destroy(&F->raw_maps->lock);
+    pthread_cond_destroy(&F->raw_maps->decoded);
+    free(F->raw_maps->entries);
+    free(F->raw_maps);
+    F->raw_maps = NULL;
+  }
   if (F->n_raw > 0) free(F->rawEntries);
   if (F->n_lincom > 0) free(F->lincomEntries);
   if (F->n_multiply > 0) free(F->multiplyEntries);
@@ -663,6 +704,34 @@ void GetDataClose(struct FormatType *F) {
   FreeF(F);
 }
 
+/***************************************************************************/
+/*                                                                         */
+/*  GetDataDropDecoded: free decoded slim fields and close the slim        */
+/*      handles kept between reads.  Mapped plain files stay mapped.       */
+/*      Nobody may be reading from F at the time.                          */
+/*                                                                         */
+/***************************************************************************/
+void GetDataDropDecoded(struct FormatType *F) {
+  struct RawMapCache *C = F->raw_maps;
+  if (C == NULL) return;
+  pthread_mutex_lock(&C->lock);
+  for (int i=0; i<C->n; i++) {
+    struct RawMapEntry *E = C->entries + i;
+    if (E->state == 2) {
+      free((void *)E->addr);
+      E->addr = NULL;
+      E->len = 0;
+      E->state = 0;
+    }
+    if (E->cursor != NULL) {
+      slimclose(E->cursor);
+      E->cursor = NULL;
+    }
+  }
+  C->slim_bytes = 0;
+  pthread_mutex_unlock(&C->lock);
+}
+
 /***************************************************************************/
 /*                                                                         */
 /*   GetFormat: Read format file and fill structure.  The format           */
@@ -700,6 +769,7 @@ struct FormatType *GetFormat(const char *filedir, const char *linterp_prefix, in
   F->linterpEntries = NULL;
   F->mplexEntries = NULL;
   F->bitEntries = NULL;
+  F->raw_maps = NULL;
 
   /* Parse the file.  This will take care of any necessary inclusions */
   i_include = 1;
@@ -761,6 +831,15 @@ struct FormatType *GetFormat(const char *filedir, const char *linterp_prefix, in
     qsort(F->bitEntries, F->n_bit, sizeof(struct BitEntryType),
         BitCmp);
   }
+
+  /* raw entries are sorted now, so the map cache can be indexed like them */
+  F->raw_maps = (struct RawMapCache *) malloc(sizeof(struct RawMapCache));
+  pthread_mutex_init(&F->raw_maps->lock, NULL);
+  pthread_cond_init(&F->raw_maps->decoded, NULL);
+  F->raw_maps->slim_bytes = 0;
+  F->raw_maps->n = F->n_raw;
+  F->raw_maps->entries = (struct RawMapEntry *)
+    calloc(F->n_raw > 0 ? F->n_raw : 1, sizeof(struct RawMapEntry));
   return(F);
 }
 
@@ -813,11 +892,11 @@ static void FillFileFrame(void *dataout, char rtype, int s0, int n) {
 }
 /***************************************************************************/
 /*                                                                         */
-/*    ConvertType: copy data to output buffer while converting type        */
-/*           Returns error code                                            */
+/*    ConvertTypeScalar: the original type-by-type conversion.  Only used  */
+/*           as the reference the conversion table is checked against.    */
 /*                                                                         */
 /***************************************************************************/
-static int ConvertType(unsigned char *data_in, char in_type,
+static int ConvertTypeScalar(unsigned char *data_in, char in_type,
                        void *data_out, char out_type, int n) {
   int i;
 
@@ -1039,6 +1118,125 @@ static int ConvertType(unsigned char *data_in, char in_type,
   return(GD_E_OK);
 }
 
+/***************************************************************************/
+/*                                                                         */
+/*    Conversion table: one kernel per (in_type, out_type) pair, with      */
+/*      restrict pointers and a plain loop so the compiler vectorises      */
+/*      them.  The casts are the same as in ConvertTypeScalar.             */
+/*      'i' and 'S' share a slot.                                          */
+/*                                                                         */
+/***************************************************************************/
+#define GD_NTYPES 7
+
+static int TypeIndex(char type) {
+  switch (type) {
+    case 'c': return(0);
+    case 's': return(1);
+    case 'u': return(2);
+    case 'i': case 'S': return(3);
+    case 'U': return(4);
+    case 'f': return(5);
+    case 'd': return(6);
+  }
+  return(-1);
+}
+
+typedef void (*ConvertKernel)(const void *restrict, void *restrict, int);
+
+#define CONVERT_KERNEL(NAME, TIN, TOUT) \
+static void NAME(const void *restrict in_, void *restrict out_, int n) { \
+  const TIN *restrict in = (const TIN *)in_; \
+  TOUT *restrict out = (TOUT *)out_; \
+  for (int i=0;i<n;i++) out[i]=in[i]; \
+}
+
+#define CONVERT_ROW(IN, TIN) \
+  CONVERT_KERNEL(Convert_##IN##_c, TIN, unsigned char) \
+  CONVERT_KERNEL(Convert_##IN##_s, TIN, short) \
+  CONVERT_KERNEL(Convert_##IN##_u, TIN, unsigned short) \
+  CONVERT_KERNEL(Convert_##IN##_i, TIN, int) \
+  CONVERT_KERNEL(Convert_##IN##_U, TIN, unsigned) \
+  CONVERT_KERNEL(Convert_##IN##_f, TIN, float) \
+  CONVERT_KERNEL(Convert_##IN##_d, TIN, double)
+
+CONVERT_ROW(c, unsigned char)
+CONVERT_ROW(s, short)
+CONVERT_ROW(u, unsigned short)
+CONVERT_ROW(i, int)
+CONVERT_ROW(U, unsigned)
+CONVERT_ROW(f, float)
+CONVERT_ROW(d, double)
+
+#define CONVERT_TABLE_ROW(IN) \
+  {Convert_##IN##_c, Convert_##IN##_s, Convert_##IN##_u, Convert_##IN##_i, \
+   Convert_##IN##_U, Convert_##IN##_f, Convert_##IN##_d}
+
+static const ConvertKernel ConvertTable[GD_NTYPES][GD_NTYPES] = {
+  CONVERT_TABLE_ROW(c), CONVERT_TABLE_ROW(s), CONVERT_TABLE_ROW(u),
+  CONVERT_TABLE_ROW(i), CONVERT_TABLE_ROW(U), CONVERT_TABLE_ROW(f),
+  CONVERT_TABLE_ROW(d)
+};
+
+/* Fused LINCOM term: out = (T)((double)(T)in*m + b), or out += that.     */
+/* Only float and double returns, which is what calibrated fields use.    */
+/* Rounding is the same as converting, then ScaleData, then AddData.      */
+typedef void (*ScaleKernel)(const void *restrict, void *restrict, int,
+                            double, double, int);
+
+#define SCALE_KERNEL(NAME, TIN, TOUT) \
+static void NAME(const void *restrict in_, void *restrict out_, int n, \
+                 double m, double b, int add) { \
+  const TIN *restrict in = (const TIN *)in_; \
+  TOUT *restrict out = (TOUT *)out_; \
+  if (add) \
+    for (int i=0;i<n;i++) out[i] += (TOUT)((double)(TOUT)in[i]*m + b); \
+  else \
+    for (int i=0;i<n;i++) out[i] = (TOUT)((double)(TOUT)in[i]*m + b); \
+}
+
+#define SCALE_ROW(IN, TIN) \
+  SCALE_KERNEL(Scale_##IN##_f, TIN, float) \
+  SCALE_KERNEL(Scale_##IN##_d, TIN, double)
+
+SCALE_ROW(c, unsigned char)
+SCALE_ROW(s, short)
+SCALE_ROW(u, unsigned short)
+SCALE_ROW(i, int)
+SCALE_ROW(U, unsigned)
+SCALE_ROW(f, float)
+SCALE_ROW(d, double)
+
+static const ScaleKernel ScaleTable[GD_NTYPES][2] = {
+  {Scale_c_f, Scale_c_d}, {Scale_s_f, Scale_s_d}, {Scale_u_f, Scale_u_d},
+  {Scale_i_f, Scale_i_d}, {Scale_U_f, Scale_U_d}, {Scale_f_f, Scale_f_d},
+  {Scale_d_f, Scale_d_d}
+};
+
+/***************************************************************************/
+/*                                                                         */
+/*    ConvertType: copy data to output buffer while converting type        */
+/*           Returns error code                                            */
+/*                                                                         */
+/***************************************************************************/
+static int ConvertType(unsigned char *data_in, char in_type,
+                       void *data_out, char out_type, int n) {
+  if (out_type=='n') { /* null return type: don't return data */
+    return(0);
+  }
+
+  int ii = TypeIndex(in_type);
+  int io = TypeIndex(out_type);
+  if (ii < 0) {
+    printf("internal getdata bug: unknown type shouldn't make it here!\n");
+    return (GD_E_BAD_RETURN_TYPE);
+  }
+  if (io < 0)
+    return (GD_E_BAD_RETURN_TYPE);
+
+  ConvertTable[ii][io](data_in, data_out, n);
+  return(GD_E_OK);
+}
+
 
 /***************************************************************************/
 /*                                                                         */
@@ -1220,6 +1418,147 @@ static inline ssize_t read_wrap(struct FileHandle *R, void *buf, size_t count) {
   return (ssize_t)-1;
 }
 
+/***************************************************************************/
+/*                                                                         */
+/*   DecodeSlim: expand a whole slimmed field into a new buffer.           */
+/*                                                                         */
+/***************************************************************************/
+static unsigned char *DecodeSlim(const char *datafilename, long len) {
+  SLIMFILE *slim = slimopen(datafilename, "r");
+  if (slim == NULL) return(NULL);
+  unsigned char *buf = (unsigned char *)malloc(len);
+  if (buf != NULL && slimread(buf, 1, len, slim) != (size_t)len) {
+    free(buf);
+    buf = NULL;
+  }
+  slimclose(slim);
+  return(buf);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/*   TakeSlimCursor/PutSlimCursor: borrow the slim handle left by the last */
+/*      read of a field if it sits at byte pos, and hand one back after.   */
+/*                                                                         */
+/***************************************************************************/
+static SLIMFILE *TakeSlimCursor(const struct FormatType *F,
+    const struct RawEntryType *R, long pos) {
+  struct RawMapCache *C = F->raw_maps;
+  SLIMFILE *slim = NULL;
+  if (C == NULL) return(NULL);
+  struct RawMapEntry *E = C->entries + (R - F->rawEntries);
+  pthread_mutex_lock(&C->lock);
+  if (E->cursor != NULL && E->cursor_at == pos) {
+    slim = E->cursor;
+    E->cursor = NULL;
+  }
+  pthread_mutex_unlock(&C->lock);
+  return(slim);
+}
+
+static void PutSlimCursor(const struct FormatType *F,
+    const struct RawEntryType *R, SLIMFILE *slim, long pos) {
+  struct RawMapCache *C = F->raw_maps;
+  if (C == NULL) {
+    slimclose(slim);
+    return;
+  }
+  struct RawMapEntry *E = C->entries + (R - F->rawEntries);
+  pthread_mutex_lock(&C->lock);
+  SLIMFILE *old = E->cursor;
+  E->cursor = slim;
+  E->cursor_at = pos;
+  pthread_mutex_unlock(&C->lock);
+  if (old != NULL)
+    slimclose(old);
+}
+
+static int SlimCursorAt(const struct FormatType *F,
+    const struct RawEntryType *R, long pos) {
+  struct RawMapCache *C = F->raw_maps;
+  if (C == NULL) return(0);
+  struct RawMapEntry *E = C->entries + (R - F->rawEntries);
+  pthread_mutex_lock(&C->lock);
+  int at = (E->cursor != NULL && E->cursor_at == pos);
+  pthread_mutex_unlock(&C->lock);
+  return(at);
+}
+
+/***************************************************************************/
+/*                                                                         */
+/*   GetRawMap: the whole of a raw field in memory, mapped for plain       */
+/*      files and decoded for slimmed ones, made on first use.  Slim       */
+/*      fields are only decoded for a read starting at s0>0 that no kept   */
+/*      handle can carry on from.  Returns NULL if the field is zipped,    */
+/*      too big to cache, or not worth decoding for this read, in which   */
+/*      case the zzip/slim path reads it.  Different fields decode in      */
+/*      parallel.                                                          */
+/*                                                                         */
+/***************************************************************************/
+static const struct RawMapEntry *GetRawMap(const struct FormatType *F,
+    const struct RawEntryType *R, int s0) {
+  struct RawMapCache *C = F->raw_maps;
+  if (C == NULL) return(NULL);
+  struct RawMapEntry *E = C->entries + (R - F->rawEntries);
+  char datafilename[2 * MAX_FILENAME_LENGTH + FIELD_LENGTH + 2];
+  long slim_len = -1;
+  int decode = (s0 > 0) && !SlimCursorAt(F, R, (long)s0*R->size);
+
+  pthread_mutex_lock(&C->lock);
+  if (E->state == 0) {
+    snprintf(datafilename, 2 * MAX_FILENAME_LENGTH + FIELD_LENGTH + 2,
+             "%s/%s", F->FileDirName, R->file);
+    E->state = -1;
+    int fd = open(datafilename, O_RDONLY);
+    if (fd >= 0) {
+      struct stat statbuf;
+      if ((fstat(fd, &statbuf) == 0) && (statbuf.st_size > 0)) {
+        void *addr = mmap(NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr != MAP_FAILED) {
+          madvise(addr, statbuf.st_size, MADV_SEQUENTIAL);
+          E->addr = (const unsigned char *)addr;
+          E->len = statbuf.st_size;
+          E->state = 1;
+        }
+      }
+      close(fd);
+    } else {
+      snprintf(datafilename, 2 * MAX_FILENAME_LENGTH + FIELD_LENGTH + 2,
+               "%s/%s.slm", F->FileDirName, R->file);
+      slim_len = decode ? slimrawsize(datafilename) : -1;
+      if (slim_len > 0 && C->slim_bytes + slim_len <= GD_SLIM_CACHE_BYTES) {
+        C->slim_bytes += slim_len;  /* reserve it, decode outside the lock */
+        E->state = 3;
+      } else {
+        if (!decode)
+          E->state = 0;  /* a later seek may still want it decoded */
+        slim_len = -1;
+      }
+    }
+  }
+  else
+    while (E->state == 3)
+      pthread_cond_wait(&C->decoded, &C->lock);
+  pthread_mutex_unlock(&C->lock);
+
+  if (slim_len > 0) {
+    unsigned char *buf = DecodeSlim(datafilename, slim_len);
+    pthread_mutex_lock(&C->lock);
+    if (buf != NULL) {
+      E->addr = buf;
+      E->len = slim_len;
+      E->state = 2;
+    } else {
+      C->slim_bytes -= slim_len;
+      E->state = -1;
+    }
+    pthread_cond_broadcast(&C->decoded);
+    pthread_mutex_unlock(&C->lock);
+  }
+
+  return((E->state == 1 || E->state == 2) ? E : NULL);
+}
+
 /***************************************************************************/
 /*                                                                         */
 /*   Look to see if the field code belongs to a raw.  If so, parse it.     */
@@ -1249,15 +1588,33 @@ static int DoIfRaw(const struct FormatType *F, const char *field_code,
   s0 = first_samp + first_frame*R->samples_per_frame;
   ns = num_samp + num_frames*R->samples_per_frame;
 
-  /** open the file */
-  open_raw(&FH, F->FileDirName, R->file);
+  /** plain files (and cached slim ones) convert straight out of memory into data_out */
+  const struct RawMapEntry *M = (s0 >= 0) ? GetRawMap(F, R, s0) : NULL;
+  if (M != NULL) {
+    long avail = (long)(M->len/R->size) - s0;
+    *n_read = (avail < 0) ? 0 : (avail < ns ? (int)avail : ns);
+    *error_code = ConvertType((unsigned char *)M->addr + (size_t)s0*R->size,
+                              R->type, data_out, return_type, *n_read);
+    return(1);
+  }
+
+  /** open the file, or carry on from where the last slim read stopped */
+  FH.fp = NULL;
+  FH.slim = (s0 > 0) ? TakeSlimCursor(F, R, (long)s0*R->size) : NULL;
+  int resumed = (FH.slim != NULL);
+  if (!resumed)
+    open_raw(&FH, F->FileDirName, R->file);
   if (FH.fp<0 && FH.slim == NULL) {
     *n_read = 0;
     *error_code = GD_E_OPEN_RAWFIELD;
     return(1);
   }
 
-  databuffer = (unsigned char *)malloc(ns*R->size);
+  /* if no conversion is needed, read straight into data_out */
+  bool direct = (TypeIndex(R->type) >= 0 &&
+                 TypeIndex(R->type) == TypeIndex(return_type));
+  databuffer = direct ? (unsigned char *)data_out :
+                        (unsigned char *)malloc(ns*R->size);
 
   *n_read = 0;
   if (s0 < 0) {
@@ -1266,26 +1623,66 @@ static int DoIfRaw(const struct FormatType *F, const char *field_code,
     s0 = 0;
   }
 
+  bytes_read = 0;
   if (ns>0) {
-    seek_wrap(&FH, s0*R->size, SEEK_SET);
+    if (!resumed)
+      seek_wrap(&FH, s0*R->size, SEEK_SET);
     bytes_read = read_wrap(&FH, databuffer + *n_read*R->size, ns*R->size);
     *n_read += bytes_read/R->size;
   }
 
-  *error_code =
-    ConvertType(databuffer, R->type, data_out, return_type, *n_read);
-
-  free(databuffer);
+  if (direct)
+    *error_code = GD_E_OK;
+  else {
+    *error_code =
+      ConvertType(databuffer, R->type, data_out, return_type, *n_read);
+    free(databuffer);
+  }
 
   if (FH.fp >= 0)
     zzip_close(FH.fp);
-  if (FH.slim != NULL)
-    slimclose(FH.slim);
+  if (FH.slim != NULL) {
+    if (bytes_read == ns*R->size)
+      PutSlimCursor(F, R, FH.slim, (long)(s0 + ns)*R->size);
+    else
+      slimclose(FH.slim);
+  }
 
   return(1);
 }
 
 
+/***************************************************************************/
+/*                                                                         */
+/*   DoRawScaled: read a plain raw field as m*x+b straight out of its      */
+/*      mapping, adding into data_out if add is set.  Returns 0 if the     */
+/*      field isn't a mapped raw or the return type isn't f/d, and the     */
+/*      caller has to go the long way round.                               */
+/*                                                                         */
+/***************************************************************************/
+static int DoRawScaled(const struct FormatType *F, const char *field_code,
+    int s0, int ns, char return_type, void *data_out,
+    double m, double b, int add, int *n_read) {
+  struct RawEntryType tR;
+  const struct RawEntryType *R;
+
+  if ((return_type != 'f' && return_type != 'd') || s0 < 0) return(0);
+
+  strncpy(tR.field, field_code, FIELD_LENGTH);
+  R = bsearch(&tR, F->rawEntries, F->n_raw,
+      sizeof(struct RawEntryType), RawCmp);
+  if (R==NULL || TypeIndex(R->type) < 0) return(0);
+
+  const struct RawMapEntry *M = GetRawMap(F, R, s0);
+  if (M==NULL) return(0);
+
+  long avail = (long)(M->len/R->size) - s0;
+  *n_read = (avail < 0) ? 0 : (avail < ns ? (int)avail : ns);
+  ScaleTable[TypeIndex(R->type)][return_type=='d'](M->addr + (size_t)s0*R->size,
+      data_out, *n_read, m, b, add);
+  return(1);
+}
+
 /***************************************************************************/
 /*                                                                         */
 /*            AllocTmpbuff: allocate a buffer of the right type and size   */
@@ -1536,21 +1933,28 @@ static int DoIfLincom(int recurse_level,
   if (*error_code != GD_E_OK) return(1);
 
   /* read and scale the first field and record the number of samples
-   * returned */
-  *n_read = DoField(recurse_level+1, F, L->in_fields[0],
-      first_frame, first_samp,
-      num_frames, num_samp,
-      return_type, data_out,
-      error_code);
+   * returned.  Plain raw fields do both in one pass. */
+  if (DoRawScaled(F, L->in_fields[0],
+        first_samp + first_frame*spf1, num_samp + num_frames*spf1,
+        return_type, data_out, L->m[0], L->b[0], 0, n_read)) {
+    if (*n_read == 0)
+      return 1;
+  } else {
+    *n_read = DoField(recurse_level+1, F, L->in_fields[0],
+        first_frame, first_samp,
+        num_frames, num_samp,
+        return_type, data_out,
+        error_code);
 
-  if (*error_code != GD_E_OK)
-    return(1);
+    if (*error_code != GD_E_OK)
+      return(1);
 
-  /* Nothing to lincomise */
-  if (*n_read == 0)
-    return 1;
+    /* Nothing to lincomise */
+    if (*n_read == 0)
+      return 1;
   
-  ScaleData(data_out, return_type, *n_read, L->m[0], L->b[0]);
+    ScaleData(data_out, return_type, *n_read, L->m[0], L->b[0]);
+  }
 
   if (L->n_infields > 1) {
     for (i=1; i<L->n_infields; i++) {
@@ -1564,6 +1968,15 @@ static int DoIfLincom(int recurse_level,
       num_samp2 = (int)ceil((double)*n_read * spf2 / spf1);
       first_samp2 = (first_frame * spf2 + first_samp * spf2 / spf1);
 
+      /* same rate plain raw: scale and add in one pass, no temporary */
+      if (spf2 == spf1 &&
+          DoRawScaled(F, L->in_fields[i], first_samp2, num_samp2,
+            return_type, data_out, L->m[i], L->b[i], 1, &n_read2)) {
+        if (n_read2 > 0 && n_read2 != *n_read)
+          *n_read = n_read2;
+        continue;
+      }
+
       /* Allocate a temporary buffer for the next field */
       tmpbuf = AllocTmpbuff(return_type, num_samp2);
       if (!tmpbuf && return_type != 'n') {
@@ -2095,6 +2508,93 @@ int GetSamplesPerFrame(const struct FormatType *F, const char *field_name, int *
   return GetSPF(0, field_name, F, error_code);
 }
 
+/***************************************************************************/
+/*                                                                         */
+/*    GetDataCheckConversions: check the conversion table and the fused    */
+/*      LINCOM kernels against the scalar code, for every pair of types.   */
+/*      If nbench>0, also time the two on nbench samples of the pairs TES  */
+/*      channels go through.  Returns the number of mismatches.            */
+/*                                                                         */
+/***************************************************************************/
+static double GetDataSeconds(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return(tv.tv_sec + 1e-6*tv.tv_usec);
+}
+
+int GetDataCheckConversions(int nbench) {
+  const char types[GD_NTYPES] = {'c', 's', 'u', 'S', 'U', 'f', 'd'};
+  const int nsamp = 256;
+  double in[256], ref[256], out[256], acc_ref[256], acc[256];
+  unsigned char raw[256*sizeof(double)];
+  int nbad = 0;
+
+  for (int ti=0; ti<GD_NTYPES; ti++) {
+    /* values every type can hold, so no conversion is out of range */
+    for (int k=0; k<nsamp; k++)
+      in[k] = (types[ti]=='f' || types[ti]=='d') ? 0.25*(k%255) : (k%255);
+    ConvertTypeScalar((unsigned char *)in, 'd', raw, types[ti], nsamp);
+
+    for (int to=0; to<GD_NTYPES; to++) {
+      memset(ref, 0, sizeof(ref));
+      memset(out, 0, sizeof(out));
+      ConvertTypeScalar(raw, types[ti], ref, types[to], nsamp);
+      ConvertType(raw, types[ti], out, types[to], nsamp);
+      if (memcmp(ref, out, sizeof(ref))) {
+        printf("conversion %c -> %c doesn't match the scalar code.\n",
+            types[ti], types[to]);
+        nbad++;
+      }
+    }
+
+    for (int to=0; to<2; to++) {
+      char ot = to ? 'd' : 'f';
+      double m = 1.0/3.0, b = -0.7;
+      ConvertTypeScalar(raw, types[ti], ref, ot, nsamp);
+      ScaleData(ref, ot, nsamp, m, b);
+      ConvertTypeScalar(raw, types[ti], acc_ref, ot, nsamp);
+      ScaleData(acc_ref, ot, nsamp, 2*m, b);
+      AddData(acc_ref, 1, ref, 1, ot, nsamp);
+
+      ScaleTable[ti][to](raw, out, nsamp, m, b, 0);
+      ScaleTable[ti][to](raw, acc, nsamp, 2*m, b, 0);
+      ScaleTable[ti][to](raw, acc, nsamp, m, b, 1);
+      if (memcmp(ref, out, nsamp*(to ? sizeof(double) : sizeof(float))) ||
+          memcmp(acc_ref, acc, nsamp*(to ? sizeof(double) : sizeof(float)))) {
+        printf("fused lincom %c -> %c doesn't match the scalar code.\n",
+            types[ti], ot);
+        nbad++;
+      }
+    }
+  }
+
+  if (nbench > 0) {
+    const char bench_in[3] = {'S', 'U', 'f'};
+    unsigned char *src = (unsigned char *)calloc(nbench, sizeof(double));
+    double *dst = (double *)malloc(nbench*sizeof(double));
+    assert(src && dst);
+    for (int k=0; k<3; k++) {
+      double t0 = GetDataSeconds();
+      ConvertTypeScalar(src, bench_in[k], dst, 'd', nbench);
+      double t1 = GetDataSeconds();
+      ConvertType(src, bench_in[k], dst, 'd', nbench);
+      double t2 = GetDataSeconds();
+      ConvertTypeScalar(src, bench_in[k], dst, 'd', nbench);
+      ScaleData(dst, 'd', nbench, 1.5, 0.5);
+      double t3 = GetDataSeconds();
+      ScaleTable[TypeIndex(bench_in[k])][1](src, dst, nbench, 1.5, 0.5, 0);
+      double t4 = GetDataSeconds();
+      printf("%c -> d: scalar %.3f ns, table %.3f ns; lincom scalar %.3f ns, fused %.3f ns per sample.\n",
+          bench_in[k], 1e9*(t1-t0)/nbench, 1e9*(t2-t1)/nbench,
+          1e9*(t3-t2)/nbench, 1e9*(t4-t3)/nbench);
+    }
+    free(src);
+    free(dst);
+  }
+
+  return(nbad);
+}
+
 
 /* vim: ts=2 sw=2 et
 */
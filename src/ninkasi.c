@@ -8,7 +8,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/time.h>
+#include <pthread.h>
 #ifndef NO_FFTW
 #include <fftw3.h>
 #endif
@@ -398,8 +400,129 @@ int how_many_tods(char *froot, PARAMS *params)
   return params->ntod;
 }
 
+/*--------------------------------------------------------------------------------*/
+actData predict_tod_cost(int ndet, int ndata, const PARAMS *params)
+//relative per-iteration cost of a TOD: projecting to and from the map plus, if we're filtering,
+//a forward and backward FFT of every detector.  Only the ratios between TODs matter.
+{
+  if ((ndet<=0)||(ndata<=1))
+    return 0;
+  actData per_samp=NK_TOD_COST_PROJ;
+  if (!params->no_noise)
+    per_samp+=NK_TOD_COST_FFT*log2((actData)ndata);
+  return (actData)ndet*(actData)ndata*per_samp;
+}
+/*--------------------------------------------------------------------------------*/
+typedef struct {
+  actData cost;
+  int ind;
+} tod_cost_ind;
+
+static int compare_tod_costs(const void *a, const void *b)
+//most expensive first, ties broken by position so every process sorts the same way.
+{
+  const tod_cost_ind *aa=(const tod_cost_ind *)a;
+  const tod_cost_ind *bb=(const tod_cost_ind *)b;
+  if (aa->cost>bb->cost)
+    return -1;
+  if (aa->cost<bb->cost)
+    return 1;
+  return aa->ind-bb->ind;
+}
+/*--------------------------------------------------------------------------------*/
+int *assign_tods_by_cost(const actData *cost, int ntod, int nproc, actData *load)
+//greedy largest-first partition: hand the most expensive TOD left to the least loaded process.
+//Deterministic, so every process gets the same answer on its own.  load (nproc long) comes
+//back with the total cost given to each process.
+{
+  tod_cost_ind *order=(tod_cost_ind *)malloc_retry(sizeof(tod_cost_ind)*ntod);
+  for (int i=0;i<ntod;i++) {
+    order[i].cost=cost[i];
+    order[i].ind=i;
+  }
+  qsort(order,ntod,sizeof(tod_cost_ind),compare_tod_costs);
+  int *owner=(int *)malloc_retry(sizeof(int)*ntod);
+  memset(load,0,sizeof(actData)*nproc);
+  for (int i=0;i<ntod;i++) {
+    int best=0;
+    for (int j=1;j<nproc;j++)
+      if (load[j]<load[best])
+	best=j;
+    owner[order[i].ind]=best;
+    load[best]+=order[i].cost;
+  }
+  free(order);
+  return owner;
+}
+/*--------------------------------------------------------------------------------*/
+static actData get_load_imbalance(const actData *load, int nproc)
+//max/mean
+{
+  actData tot=0,mymax=0;
+  for (int i=0;i<nproc;i++) {
+    tot+=load[i];
+    if (load[i]>mymax)
+      mymax=load[i];
+  }
+  if (tot<=0)
+    return 1.0;
+  return mymax*nproc/tot;
+}
+/*--------------------------------------------------------------------------------*/
+typedef struct {
+  char *name;
+  actData cost;
+} tod_cost_entry;
+
+static int compare_tod_cost_names(const void *a, const void *b)
+{
+  return strcmp(((const tod_cost_entry *)a)->name,((const tod_cost_entry *)b)->name);
+}
+/*--------------------------------------------------------------------------------*/
+static int read_tod_cost_file(const char *fname, char datanames[][MAXLEN], int ntod, actData *cost)
+//fill in the measured costs of TODs listed in fname, one "name seconds" pair per line.
+//Returns how many of the TODs were found.
+{
+  FILE *infile=fopen(fname,"r");
+  if (!infile)
+    return 0;
+  int nalloc=1024,n=0;
+  tod_cost_entry *entries=(tod_cost_entry *)malloc_retry(sizeof(tod_cost_entry)*nalloc);
+  char name[MAXLEN];
+  double val;
+  while (fscanf(infile,"%255s %lf",name,&val)==2) {
+    if (n==nalloc) {
+      nalloc*=2;
+      entries=(tod_cost_entry *)realloc(entries,sizeof(tod_cost_entry)*nalloc);
+      assert(entries);
+    }
+    entries[n].name=strdup(name);
+    entries[n].cost=val;
+    n++;
+  }
+  fclose(infile);
+  qsort(entries,n,sizeof(tod_cost_entry),compare_tod_cost_names);
+  int nfound=0;
+  for (int i=0;i<ntod;i++) {
+    tod_cost_entry key;
+    key.name=datanames[i];
+    tod_cost_entry *hit=(tod_cost_entry *)bsearch(&key,entries,n,sizeof(tod_cost_entry),compare_tod_cost_names);
+    if ((hit)&&(hit->cost>0)) {
+      cost[i]=hit->cost;
+      nfound++;
+    }
+  }
+  for (int i=0;i<n;i++)
+    free(entries[i].name);
+  free(entries);
+  return nfound;
+}
 /*--------------------------------------------------------------------------------*/
 int find_my_tods(TODvec *tods, PARAMS *params)
+//decide which TODs are mine.  Round robin by default.  With params->balance_tods, every TOD
+//gets a cost - measured in a previous run if tod_cost_file has it, otherwise predicted from
+//its shape (scaled to seconds by the TODs that were measured) - and they're split largest
+//first over the processes.
 {
 #ifdef HAVE_MPI
   int ierr,myid,nproc;
@@ -412,25 +535,415 @@ int find_my_tods(TODvec *tods, PARAMS *params)
   int nproc=1;
 #endif
 
-  tods->ntod=0;
-
+  int ntot=tods->total_tod;
+  actData *cost=(actData *)calloc(ntot>0 ? ntot : 1,sizeof(actData));
+  int *owner=NULL;
+  if (params->balance_tods) {
+    //only the format files get read here, and even those are split over processes.
+    actData *predicted=(actData *)calloc(ntot>0 ? ntot : 1,sizeof(actData));
+    for (int i=myid;i<ntot;i+=nproc) {
+      int ndet,ndata;
+      if (read_dirfile_tod_size(params->datanames[i],&ndet,&ndata)==0)
+	predicted[i]=predict_tod_cost(ndet,ndata,params);
+    }
+#ifdef HAVE_MPI
+    MPI_Allreduce(MPI_IN_PLACE,predicted,ntot,MPI_NType,MPI_SUM,MPI_COMM_WORLD);
+#endif
+    int nmeasured=0;
+    if (strlen(params->tod_cost_file))
+      nmeasured=read_tod_cost_file(params->tod_cost_file,params->datanames,ntot,cost);
+    actData scale=1.0;
+    if (nmeasured>0) {
+      actData tot_meas=0,tot_pred=0;
+      for (int i=0;i<ntot;i++)
+	if (cost[i]>0) {
+	  tot_meas+=cost[i];
+	  tot_pred+=predicted[i];
+	}
+      if (tot_pred>0)
+	scale=tot_meas/tot_pred;
+    }
+    for (int i=0;i<ntot;i++)
+      if (cost[i]<=0)
+	cost[i]=predicted[i]*scale;
+    free(predicted);
 
-  //first, do a simple loop to figure out how many I own
-  for (int i=myid;i<tods->total_tod;i+=nproc) {
-    tods->ntod++;
+    actData *load=(actData *)calloc(nproc,sizeof(actData));
+    for (int i=0;i<ntot;i++)
+      load[i%nproc]+=cost[i];
+    actData rr_imbalance=get_load_imbalance(load,nproc);
+    owner=assign_tods_by_cost(cost,ntot,nproc,load);
+    mprintf(stdout,"%d of %d TOD costs measured.  Predicted load imbalance (max/mean) is %.3f, round robin would be %.3f.\n",nmeasured,ntot,get_load_imbalance(load,nproc),rr_imbalance);
+    free(load);
   }
+
+  tods->ntod=0;
+  for (int i=0;i<ntot;i++)
+    if ((owner ? owner[i] : i%nproc)==myid)
+      tods->ntod++;
   tods->my_fnames=(char **)malloc_retry(sizeof(char *)*tods->ntod);
   tods->tods=(mbTOD *)calloc(sizeof(mbTOD),tods->ntod);
+  tods->my_index=(int *)malloc_retry(sizeof(int)*(tods->ntod>0 ? tods->ntod : 1));
+  tods->tod_cost=(actData *)calloc(tods->ntod>0 ? tods->ntod : 1,sizeof(actData));
+  tods->tod_time=(actData *)calloc(tods->ntod>0 ? tods->ntod : 1,sizeof(actData));
+  tods->stream=NULL;
   int ii=0;
-  for (int i=myid;i<tods->total_tod;i+=nproc) {
-    tods->tods[ii].seed=((1+fabs(params->seed))*MAXTOD+i)*MAXDET;
-    tods->my_fnames[ii]=strdup(params->datanames[i]);
-    
-    ii++;
+  for (int i=0;i<ntot;i++) 
+    if ((owner ? owner[i] : i%nproc)==myid) {
+      tods->tods[ii].seed=((1+fabs(params->seed))*MAXTOD+i)*MAXDET;
+      tods->my_fnames[ii]=strdup(params->datanames[i]);
+      tods->my_index[ii]=i;
+      tods->tod_cost[ii]=cost[i];
+      ii++;
+    }
+  if (owner)
+    free(owner);
+  free(cost);
+  return 0;
+  
+}
+/*--------------------------------------------------------------------------------*/
+void report_tod_balance(TODvec *tods)
+//print the measured load imbalance of the last pass through mapset2mapset.
+{
+  actData mytot=0;
+  for (int i=0;i<tods->ntod;i++)
+    mytot+=tods->tod_time[i];
+  actData mymax=mytot,tot=mytot;
+  int nproc=1;
+#ifdef HAVE_MPI
+  MPI_Comm_size(MPI_COMM_WORLD,&nproc);
+  MPI_Allreduce(&mytot,&mymax,1,MPI_NType,MPI_MAX,MPI_COMM_WORLD);
+  MPI_Allreduce(&mytot,&tot,1,MPI_NType,MPI_SUM,MPI_COMM_WORLD);
+#endif
+  if (tot>0)
+    mprintf(stdout,"TOD time per process: max %8.3f mean %8.3f seconds, imbalance %.3f\n",mymax,tot/nproc,mymax*nproc/tot);
+}
+/*--------------------------------------------------------------------------------*/
+void write_tod_costs(TODvec *tods, PARAMS *params, char *fname)
+//write the measured time of every TOD from the last pass, so the next run can balance on it.
+{
+  int ntot=tods->total_tod;
+  actData *cost=(actData *)calloc(ntot>0 ? ntot : 1,sizeof(actData));
+  for (int i=0;i<tods->ntod;i++)
+    cost[tods->my_index[i]]=tods->tod_time[i];
+  int myid=0;
+#ifdef HAVE_MPI
+  MPI_Comm_rank(MPI_COMM_WORLD,&myid);
+  MPI_Allreduce(MPI_IN_PLACE,cost,ntot,MPI_NType,MPI_SUM,MPI_COMM_WORLD);
+#endif
+  if (myid==0) {
+    char tmpname[MAXLEN+16];
+    snprintf(tmpname,sizeof(tmpname),"%s.tmp",fname);
+    FILE *outfile=fopen(tmpname,"w");
+    if (outfile) {
+      for (int i=0;i<ntot;i++)
+	if (cost[i]>0)
+	  fprintf(outfile,"%s %14.6e\n",params->datanames[i],cost[i]);
+      fclose(outfile);
+      if (rename(tmpname,fname))
+	fprintf(stderr,"Warning - unable to write TOD costs to %s\n",fname);
+    }
+    else
+      fprintf(stderr,"Warning - unable to open %s for TOD costs.\n",tmpname);
+  }
+  free(cost);
+}
+/*--------------------------------------------------------------------------------*/
+//Out-of-core TODs.  The pointing products of a spilled TOD (its pixelization and, for
+//polarization, its angles) live in a scratch file and are only in memory while the TOD is being
+//used.  A helper thread reads the next spilled TOD while the current one is projected.
+struct tod_stream_s {
+  char dir[MAXLEN];
+  int ntod;
+  bool *spilled;
+  bool *resident;
+  long *nbyte;
+  pthread_t thread;
+  bool prefetching;
+  int prefetch_tod;
+  bool prefetch_failed;  //set by the prefetch thread, checked once it's joined.
+  char prefetch_fname[MAXLEN+64];
+  mbTOD *tods;
+};
+
+#define NK_STREAM_MAGIC 0x6e6b7331
 
+/*--------------------------------------------------------------------------------*/
+static void get_stream_fname(const TodStream *stream, int i, char *fname, int len)
+{
+  int myid=0;
+#ifdef HAVE_MPI
+  MPI_Comm_rank(MPI_COMM_WORLD,&myid);
+#endif
+  snprintf(fname,len,"%s/nk_stream_%d_%d.dat",stream->dir,myid,i);
+}
+/*--------------------------------------------------------------------------------*/
+static long get_tod_stream_nbyte(const mbTOD *tod)
+//memory held by the products that get spilled.
+{
+  long nbyte=0;
+  if (tod->pixelization_saved)
+    nbyte+=sizeof(int)*(long)tod->ndet*tod->ndata;
+  else if (tod->pixelization_packed)
+    nbyte+=get_packed_pixelization_nbyte(tod->pixelization_packed);
+#ifdef ACTPOL
+  if (tod->twogamma_saved)
+    nbyte+=sizeof(actData)*(long)tod->ndet*tod->ndata;
+#endif
+  return nbyte;
+}
+/*--------------------------------------------------------------------------------*/
+static void free_tod_stream_products(mbTOD *tod)
+{
+  free_saved_pixelization(tod);
+  if (tod->pixelization_packed)
+    destroy_packed_pixelization(tod->pixelization_packed);
+  tod->pixelization_packed=NULL;
+#ifdef ACTPOL
+  if (tod->twogamma_saved) {
+    free(tod->twogamma_saved[0]);
+    free(tod->twogamma_saved);
+    tod->twogamma_saved=NULL;
+  }
+#endif
+}
+/*--------------------------------------------------------------------------------*/
+static int write_tod_stream_products(const mbTOD *tod, const char *fname)
+{
+  FILE *outfile=fopen(fname,"w");
+  if (!outfile) {
+    fprintf(stderr,"Unable to open %s for TOD streaming.\n",fname);
+    return 1;
+  }
+  int head[5]={NK_STREAM_MAGIC,tod->ndet,tod->ndata,0,0};
+  if (tod->pixelization_saved)
+    head[3]=1;
+  else if (tod->pixelization_packed) {
+    head[3]=2;
+    head[4]=tod->pixelization_packed->stride;
+  }
+  int have_gamma=0;
+#ifdef ACTPOL
+  if (tod->twogamma_saved)
+    have_gamma=1;
+#endif
+  fwrite(head,sizeof(int),5,outfile);
+  fwrite(&have_gamma,sizeof(int),1,outfile);
+  if (head[3]==1)
+    for (int i=0;i<tod->ndet;i++)
+      fwrite(tod->pixelization_saved[i],sizeof(int),tod->ndata,outfile);
+  if (head[3]==2)
+    for (int i=0;i<tod->ndet;i++) {
+      const PackedPixelizationDet *pd=tod->pixelization_packed->dets+i;
+      fwrite(&pd->nblock,sizeof(int),1,outfile);
+      fwrite(pd->base,sizeof(int),pd->nblock+1,outfile);
+      fwrite(pd->mode,sizeof(unsigned char),pd->nblock+1,outfile);
+      fwrite(pd->offset,sizeof(int),pd->nblock+1,outfile);
+      fwrite(pd->stream,sizeof(unsigned char),pd->offset[pd->nblock]+1,outfile);
+    }
+#ifdef ACTPOL
+  if (have_gamma)
+    fwrite(tod->twogamma_saved[0],sizeof(actData),(long)tod->ndet*tod->ndata,outfile);
+#endif
+  if (fclose(outfile)) {
+    fprintf(stderr,"Error writing %s for TOD streaming.\n",fname);
+    return 1;
   }
   return 0;
-  
+}
+/*--------------------------------------------------------------------------------*/
+static int read_tod_stream_products(mbTOD *tod, const char *fname)
+{
+  FILE *infile=fopen(fname,"r");
+  if (!infile) {
+    fprintf(stderr,"Unable to open %s for TOD streaming.\n",fname);
+    return 1;
+  }
+  int head[5],have_gamma;
+  long nread=fread(head,sizeof(int),5,infile);
+  nread+=fread(&have_gamma,sizeof(int),1,infile);
+  if ((nread!=6)||(head[0]!=NK_STREAM_MAGIC)||(head[1]!=tod->ndet)||(head[2]!=tod->ndata)) {
+    fprintf(stderr,"Bad header in TOD stream file %s\n",fname);
+    fclose(infile);
+    return 1;
+  }
+  bool ok=true;
+  if (head[3]==1) {
+    int **pix=imatrix(tod->ndet,tod->ndata);
+    ok=(fread(pix[0],sizeof(int),(long)tod->ndet*tod->ndata,infile)==(size_t)tod->ndet*tod->ndata);
+    tod->pixelization_saved=pix;
+  }
+  if (head[3]==2) {
+    PackedPixelization *pix=allocate_packed_pixelization(tod->ndet,tod->ndata,head[4]);
+    for (int i=0;(i<tod->ndet)&&(ok);i++) {
+      PackedPixelizationDet *pd=pix->dets+i;
+      ok=(fread(&pd->nblock,sizeof(int),1,infile)==1);
+      if (!ok)
+	break;
+      pd->base=(int *)malloc_retry(sizeof(int)*(pd->nblock+1));
+      pd->mode=(unsigned char *)malloc_retry(sizeof(unsigned char)*(pd->nblock+1));
+      pd->offset=(int *)malloc_retry(sizeof(int)*(pd->nblock+1));
+      ok=(fread(pd->base,sizeof(int),pd->nblock+1,infile)==(size_t)pd->nblock+1);
+      ok=ok&&(fread(pd->mode,sizeof(unsigned char),pd->nblock+1,infile)==(size_t)pd->nblock+1);
+      ok=ok&&(fread(pd->offset,sizeof(int),pd->nblock+1,infile)==(size_t)pd->nblock+1);
+      if (!ok)
+	break;
+      pd->stream=(unsigned char *)malloc_retry(pd->offset[pd->nblock]+1);
+      ok=(fread(pd->stream,sizeof(unsigned char),pd->offset[pd->nblock]+1,infile)==(size_t)pd->offset[pd->nblock]+1);
+    }
+    tod->pixelization_packed=pix;
+  }
+#ifdef ACTPOL
+  if ((have_gamma)&&(ok)) {
+    tod->twogamma_saved=matrix(tod->ndet,tod->ndata);
+    ok=(fread(tod->twogamma_saved[0],sizeof(actData),(long)tod->ndet*tod->ndata,infile)==(size_t)tod->ndet*tod->ndata);
+  }
+#endif
+  fclose(infile);
+  if (!ok) {
+    fprintf(stderr,"Short read on TOD stream file %s\n",fname);
+    return 1;
+  }
+  return 0;
+}
+/*--------------------------------------------------------------------------------*/
+static void abort_tod_stream(int i, const char *fname)
+//the pointing products of a spilled TOD are gone, so there's no carrying on without them.
+{
+  fprintf(stderr,"Unable to read pointing for TOD %d back from stream file %s, aborting.\n",i,fname);
+#ifdef HAVE_MPI
+  MPI_Abort(MPI_COMM_WORLD,EXIT_FAILURE);
+#endif
+  exit(EXIT_FAILURE);
+}
+/*--------------------------------------------------------------------------------*/
+static void *prefetch_tod_stream(void *arg)
+//runs on its own thread, so failures are only recorded here and reported by finish_tod_prefetch.
+{
+  TodStream *stream=(TodStream *)arg;
+  get_stream_fname(stream,stream->prefetch_tod,stream->prefetch_fname,sizeof(stream->prefetch_fname));
+  stream->prefetch_failed=(read_tod_stream_products(&(stream->tods[stream->prefetch_tod]),stream->prefetch_fname)!=0);
+  return NULL;
+}
+/*--------------------------------------------------------------------------------*/
+static void finish_tod_prefetch(TodStream *stream)
+{
+  if (!stream->prefetching)
+    return;
+  pthread_join(stream->thread,NULL);
+  stream->prefetching=false;
+  if (stream->prefetch_failed)
+    abort_tod_stream(stream->prefetch_tod,stream->prefetch_fname);
+  stream->resident[stream->prefetch_tod]=true;
+}
+/*--------------------------------------------------------------------------------*/
+void setup_tod_stream(TODvec *tods, PARAMS *params)
+//spill the pointing products of TODs to params->stream_dir.  TODs are kept in memory, in order,
+//while they fit in params->stream_mem MB, leaving room for the two that are streamed at a time.
+{
+  if ((!strlen(params->stream_dir))||(tods->stream))
+    return;
+  TodStream *stream=(TodStream *)malloc_retry(sizeof(TodStream));
+  strncpy(stream->dir,params->stream_dir,MAXLEN-1);
+  stream->dir[MAXLEN-1]='\0';
+  stream->ntod=tods->ntod;
+  stream->tods=tods->tods;
+  stream->prefetching=false;
+  stream->prefetch_tod=-1;
+  stream->prefetch_failed=false;
+  stream->prefetch_fname[0]='\0';
+  int n=(tods->ntod>0 ? tods->ntod : 1);
+  stream->spilled=(bool *)calloc(n,sizeof(bool));
+  stream->resident=(bool *)calloc(n,sizeof(bool));
+  stream->nbyte=(long *)calloc(n,sizeof(long));
+
+  long maxbyte=0;
+  for (int i=0;i<tods->ntod;i++) {
+    stream->nbyte[i]=get_tod_stream_nbyte(&(tods->tods[i]));
+    if (stream->nbyte[i]>maxbyte)
+      maxbyte=stream->nbyte[i];
+  }
+  long budget=params->stream_mem*1024.0*1024.0-2*maxbyte;
+  long used=0,spilled=0;
+  int nspill=0;
+  for (int i=0;i<tods->ntod;i++) {
+    stream->resident[i]=true;
+    if (stream->nbyte[i]==0)
+      continue;
+    if (used+stream->nbyte[i]<=budget) {
+      used+=stream->nbyte[i];
+      continue;
+    }
+    char fname[MAXLEN+64];
+    get_stream_fname(stream,i,fname,sizeof(fname));
+    if (write_tod_stream_products(&(tods->tods[i]),fname))
+      continue;
+    free_tod_stream_products(&(tods->tods[i]));
+    stream->spilled[i]=true;
+    stream->resident[i]=false;
+    spilled+=stream->nbyte[i];
+    nspill++;
+  }
+  tods->stream=stream;
+  printf("streaming %d of %d TODs from %s, %.1f MB on disk, %.1f MB kept in memory.\n",nspill,tods->ntod,stream->dir,spilled/1048576.0,used/1048576.0);
+}
+/*--------------------------------------------------------------------------------*/
+void stream_tod_in(TODvec *tods, int i)
+//make sure TOD i has its pointing products, and start reading the next spilled TOD.
+{
+  TodStream *stream=tods->stream;
+  if (!stream)
+    return;
+  finish_tod_prefetch(stream);
+  if (!stream->resident[i]) {
+    char fname[MAXLEN+64];
+    get_stream_fname(stream,i,fname,sizeof(fname));
+    if (read_tod_stream_products(&(tods->tods[i]),fname))
+      abort_tod_stream(i,fname);
+    stream->resident[i]=true;
+  }
+  for (int k=1;k<stream->ntod;k++) {
+    int j=(i+k)%stream->ntod;
+    if ((stream->spilled[j])&&(!stream->resident[j])) {
+      stream->prefetch_tod=j;
+      stream->prefetch_failed=false;
+      if (pthread_create(&stream->thread,NULL,prefetch_tod_stream,stream)==0)
+	stream->prefetching=true;
+      break;
+    }
+  }
+}
+/*--------------------------------------------------------------------------------*/
+void stream_tod_out(TODvec *tods, int i)
+//drop TOD i's pointing products again if it lives on disk.  They never change, so the file stays valid.
+{
+  TodStream *stream=tods->stream;
+  if ((!stream)||(!stream->spilled[i])||(!stream->resident[i]))
+    return;
+  free_tod_stream_products(&(tods->tods[i]));
+  stream->resident[i]=false;
+}
+/*--------------------------------------------------------------------------------*/
+void destroy_tod_stream(TODvec *tods)
+//remove the scratch files.  TODs that were on disk are left without their pointing products.
+{
+  TodStream *stream=tods->stream;
+  if (!stream)
+    return;
+  finish_tod_prefetch(stream);
+  for (int i=0;i<stream->ntod;i++)
+    if (stream->spilled[i]) {
+      char fname[MAXLEN+64];
+      get_stream_fname(stream,i,fname,sizeof(fname));
+      stream_tod_out(tods,i);
+      remove(fname);
+    }
+  free(stream->spilled);
+  free(stream->resident);
+  free(stream->nbyte);
+  free(stream);
+  tods->stream=NULL;
 }
 /*--------------------------------------------------------------------------------*/
 actData *read_1d_datafile(char *fname, int *n)
@@ -1170,10 +1683,12 @@ int read_all_tod_headers(TODvec *tods,PARAMS *params)
 
     memcpy(mytod,tmp,sizeof(mbTOD));
     mytod->seed=seed;
-    mytod->cuts=mbCutsAlloc(mytod->nrow,mytod->ncol);
+    if (!mytod->cuts)  //TOD containers carry their own cuts and pointing offsets.
+      mytod->cuts=mbCutsAlloc(mytod->nrow,mytod->ncol);
     
     mprintf(stdout,"file %s had %d detectors and %d data elements, rows and cols are %d %d.  dt=%12.4e\n",myfroot,mytod->ndet,mytod->ndata,mytod->nrow, mytod->ncol,mytod->deltat);
-    mytod->pointingOffset=nkReadPointingOffset(params->pointing_file);  
+    if (!mytod->pointingOffset)
+      mytod->pointingOffset=nkReadPointingOffset(params->pointing_file);  
     //printf("read pointing offsets.\n");
     cut_mispointed_detectors(mytod);
     //printf("cut mispointed detectors.\n");
@@ -1182,12 +1697,19 @@ int read_all_tod_headers(TODvec *tods,PARAMS *params)
       mprintf(stdout,"starting altaz/ctime are %10.5f %10.5f %12.2f on file %d\n",mytod->alt[0],mytod->az[0],mytod->ctime,i);
     }
     
-    assign_tod_ra_dec(mytod);
-    //currently not used - lives inside of read_tod_header_c.cpp
-    find_pointing_pivots(mytod,0.5);
-    printf("got pivots inside ninkasi .\n");
-    //printf("ra/dec are assigned.\n");
-    find_tod_radec_lims(mytod);    
+    //only the key is worked out here, the bulky products are read when they're used.
+    mytod->pointing_cache=setup_pointing_cache(mytod,params->pointing_cache,myfroot,params->pointing_file);
+    if (load_pointing_fit_cache(mytod)) 
+      printf("pointing fit for %s read from cache.\n",myfroot);
+    else {
+      assign_tod_ra_dec(mytod);
+      //currently not used - lives inside of read_tod_header_c.cpp
+      find_pointing_pivots(mytod,0.5);
+      printf("got pivots inside ninkasi .\n");
+      //printf("ra/dec are assigned.\n");
+      find_tod_radec_lims(mytod);    
+      save_pointing_fit_cache(mytod);
+    }
     int myid=0;
 #ifdef HAVE_MPI 
     MPI_Comm_rank(MPI_COMM_WORLD,&myid);
@@ -1269,12 +1791,126 @@ int setup_maps(MAPvec *maps, PARAMS *params)
     mymap->nx=(mymap->ramax-mymap->ramin)/mymap->pixsize+1;
     mymap->ny=(mymap->decmax-mymap->decmin)/mymap->pixsize+1;
     mymap->npix=mymap->nx*mymap->ny;
-    mymap->map=vector(mymap->npix);
+    mymap->tiles=NULL;
+    mymap->comm=NULL;
+    mymap->ntile=0;
+    if ((params)&&((params->tiled_maps)||(params->distributed_maps))) {
+      mymap->map=NULL;
+      mymap->ntile=(mymap->npix+NK_MAP_TILE_LEN-1)/NK_MAP_TILE_LEN;
+      mymap->tiles=(actData **)calloc(mymap->ntile,sizeof(actData *));
+      assert(mymap->tiles);
+    }
+    else
+      mymap->map=vector(mymap->npix);
   }
     
   return 0;
 }
 
+/*--------------------------------------------------------------------------------*/
+static void copy_map_pivots(MAP *map_copy, const MAP *map)
+//copies share geometry with the parent, so the cached projection pivots carry over.
+{
+  map_copy->ipiv_proc=NULL;
+  map_copy->npiv_proc=0;
+  if (map->ipiv_proc) {
+    map_copy->ipiv_proc=(int *)malloc_retry(sizeof(int)*(map->npiv_proc+1));
+    memcpy(map_copy->ipiv_proc,map->ipiv_proc,sizeof(int)*(map->npiv_proc+1));
+    map_copy->npiv_proc=map->npiv_proc;
+  }
+}
+/*--------------------------------------------------------------------------------*/
+static inline long map_tile_len(const MAP *map, long tile)
+//number of real pixels in a tile.  The last one is padded out to NK_MAP_TILE_LEN with zeros.
+{
+  long n=map->npix-tile*NK_MAP_TILE_LEN;
+  return (n<NK_MAP_TILE_LEN ? n : NK_MAP_TILE_LEN);
+}
+/*--------------------------------------------------------------------------------*/
+actData *get_map_tile(MAP *map, long tile)
+//return a tile of a sparse map, allocating (and zeroing) it on first use.  Not thread safe -
+//allocate the tiles you need before going parallel.
+{
+  assert(map->tiles);
+  assert((tile>=0)&&(tile<map->ntile));
+  if (map->tiles[tile]==NULL) {
+    map->tiles[tile]=(actData *)calloc(NK_MAP_TILE_LEN,sizeof(actData));
+    assert(map->tiles[tile]);
+  }
+  return map->tiles[tile];
+}
+/*--------------------------------------------------------------------------------*/
+long count_map_tiles(const MAP *map)
+//number of allocated tiles in a sparse map, or -1 if the map is dense.
+{
+  if (!map->tiles)
+    return -1;
+  long n=0;
+  for (long i=0;i<map->ntile;i++)
+    if (map->tiles[i])
+      n++;
+  return n;
+}
+/*--------------------------------------------------------------------------------*/
+static void copy_map_tiles(MAP *map_copy, const MAP *map, bool copy_data)
+//give map_copy the same storage layout as map, with the same tiles allocated if sparse.
+{
+  map_copy->tiles=NULL;
+  map_copy->comm=map->comm;
+  map_copy->ntile=0;
+  if (!map->tiles)
+    return;
+  map_copy->map=NULL;
+  map_copy->ntile=map->ntile;
+  map_copy->tiles=(actData **)calloc(map->ntile,sizeof(actData *));
+  assert(map_copy->tiles);
+  for (long i=0;i<map->ntile;i++)
+    if (map->tiles[i]) {
+      get_map_tile(map_copy,i);
+      if (copy_data)
+	memcpy(map_copy->tiles[i],map->tiles[i],sizeof(actData)*NK_MAP_TILE_LEN);
+    }
+}
+/*--------------------------------------------------------------------------------*/
+void tile_map(MAP *map)
+//convert a dense map into a sparse one in place, keeping only tiles with something in them.
+{
+  if (map->tiles)
+    return;
+  assert(get_npol_in_map(map)==1);
+  map->ntile=(map->npix+NK_MAP_TILE_LEN-1)/NK_MAP_TILE_LEN;
+  map->tiles=(actData **)calloc(map->ntile,sizeof(actData *));
+  assert(map->tiles);
+  for (long i=0;i<map->ntile;i++) {
+    const actData *src=map->map+i*NK_MAP_TILE_LEN;
+    long n=map_tile_len(map,i);
+    for (long j=0;j<n;j++)
+      if (src[j]) {
+	memcpy(get_map_tile(map,i),src,sizeof(actData)*n);
+	break;
+      }
+  }
+  free(map->map);
+  map->map=NULL;
+}
+/*--------------------------------------------------------------------------------*/
+void untile_map(MAP *map)
+//convert a sparse map back to dense storage in place.
+{
+  if (!map->tiles)
+    return;
+  assert(map->comm==NULL);  //a distributed map only holds part of the sky.
+  map->map=vector(map->npix);
+  memset(map->map,0,sizeof(actData)*map->npix);
+  for (long i=0;i<map->ntile;i++)
+    if (map->tiles[i]) {
+      memcpy(map->map+i*NK_MAP_TILE_LEN,map->tiles[i],sizeof(actData)*map_tile_len(map,i));
+      free(map->tiles[i]);
+    }
+  free(map->tiles);
+  map->tiles=NULL;
+  map->ntile=0;
+}
 /*--------------------------------------------------------------------------------*/
 MAP *make_blank_map_copy(const MAP *map)
 {
@@ -1290,10 +1926,13 @@ MAP *make_blank_map_copy(const MAP *map)
   map_copy->ny=map->ny;
   map_copy->npix=map->npix;
   map_copy->have_locks=0;  //don't recycle locks.  will create them as needed, if needed.
+  copy_map_pivots(map_copy,map);
 #ifdef ACTPOL
   memcpy(map_copy->pol_state,map->pol_state,MAX_NPOL*sizeof(map->pol_state[0]));
 #endif
-  map_copy->map=(actData *)malloc_retry(sizeof(actData)*map_copy->npix*get_npol_in_map(map));
+  copy_map_tiles(map_copy,map,false);
+  if (!map_copy->tiles)
+    map_copy->map=(actData *)malloc_retry(sizeof(actData)*map_copy->npix*get_npol_in_map(map));
   //memcpy(map_copy->map,map->map,sizeof(actData)*map_copy->npix);
   clear_map(map_copy);
   return map_copy;
@@ -1319,6 +1958,12 @@ MAP *deres_map(MAP *map)
   //memcpy(map_copy->projection,map->projection,sizeof(nkProjection));
   map_copy->projection=deres_projection(map->projection);
   map_copy->have_locks=0;  //don't recycle locks.  will create them as needed, if needed.
+  map_copy->ipiv_proc=NULL;  //pixel pivots don't survive a change in resolution.
+  map_copy->npiv_proc=0;
+  assert(map->tiles==NULL);
+  map_copy->tiles=NULL;
+  map_copy->comm=NULL;
+  map_copy->ntile=0;
   map_copy->map=(actData *)malloc_retry(sizeof(actData)*map_copy->npix);
   //memcpy(map_copy->map,map->map,sizeof(actData)*map_copy->npix);
   
@@ -1350,6 +1995,12 @@ MAP *upres_map(MAP *map)
   //memcpy(map_copy->projection,map->projection,sizeof(nkProjection));
   map_copy->projection=upres_projection(map->projection);
   map_copy->have_locks=0;  //don't recycle locks.  will create them as needed, if needed.
+  map_copy->ipiv_proc=NULL;
+  map_copy->npiv_proc=0;
+  assert(map->tiles==NULL);
+  map_copy->tiles=NULL;
+  map_copy->comm=NULL;
+  map_copy->ntile=0;
   map_copy->map=(actData *)malloc_retry(sizeof(actData)*map_copy->npix);
   //memcpy(map_copy->map,map->map,sizeof(actData)*map_copy->npix);
   for (int i=0;i<map_copy->ny;i++) 
@@ -1378,19 +2029,30 @@ MAP *make_map_copy(MAP *map)
   map_copy->projection=(nkProjection *)malloc_retry(sizeof(nkProjection));
   memcpy(map_copy->projection,map->projection,sizeof(nkProjection));
   map_copy->have_locks=0;  //don't recycle locks.  will create them as needed, if needed.
-  map_copy->map=(actData *)malloc_retry(sizeof(actData)*map_copy->npix*get_npol_in_map(map));
+  copy_map_pivots(map_copy,map);
 #ifdef ACTPOL
   memcpy(map_copy->pol_state,map->pol_state,MAX_NPOL*sizeof(map->pol_state[0]));
 #endif
-  memcpy(map_copy->map,map->map,sizeof(actData)*map_copy->npix*get_npol_in_map(map));
+  copy_map_tiles(map_copy,map,true);
+  if (!map_copy->tiles) {
+    map_copy->map=(actData *)malloc_retry(sizeof(actData)*map_copy->npix*get_npol_in_map(map));
+    memcpy(map_copy->map,map->map,sizeof(actData)*map_copy->npix*get_npol_in_map(map));
+  }
   return map_copy;
 }
 /*--------------------------------------------------------------------------------*/
 void destroy_map(MAP *map)
 {
   free(map->map);
+  if (map->tiles) {
+    for (long i=0;i<map->ntile;i++)
+      free(map->tiles[i]);
+    free(map->tiles);
+  }
   if (map->have_locks)
     free(map->locks);
+  if (map->ipiv_proc)
+    free(map->ipiv_proc);
   //free(map->projection);
   free(map);
 }
@@ -1418,6 +2080,13 @@ MAPvec *make_mapset_copy(MAPvec *maps)
 /*--------------------------------------------------------------------------------*/
 void clear_map(MAP *map)
 {
+  if (map->tiles) {
+    //keep the tiles around, the next pass will most likely hit the same ones.
+    for (long i=0;i<map->ntile;i++)
+      if (map->tiles[i])
+	memset(map->tiles[i],0,sizeof(actData)*NK_MAP_TILE_LEN);
+    return;
+  }
   memset(map->map,0,sizeof(actData)*map->npix*get_npol_in_map(map));
 }
 /*--------------------------------------------------------------------------------*/
@@ -1430,6 +2099,14 @@ void clear_mapset(MAPvec *maps)
 bool is_map_blank(MAP *map)
 //return true if all elements of a map are 0.
 {
+  if (map->tiles) {
+    for (long i=0;i<map->ntile;i++)
+      if (map->tiles[i])
+	for (int j=0;j<NK_MAP_TILE_LEN;j++)
+	  if (map->tiles[i][j])
+	    return false;
+    return true;
+  }
   for (int i=0;i<map->npix;i++)
     if (map->map[i])
       return false;
@@ -1437,39 +2114,480 @@ bool is_map_blank(MAP *map)
 }
 /*--------------------------------------------------------------------------------*/
 bool is_mapset_blank(MAPvec *maps)
-//return true if all maps in a mapset are blank (0).
+//return true if all maps in a mapset are blank (0).  For distributed maps, that has to be
+//true on every process.
 {
   assert(maps);  
+  int blank=1;
   for (int i=0;i<maps->nmap;i++)
-    if (!is_map_blank(maps->maps[i]))
-      return false;
-  return true;
+    if (!is_map_blank(maps->maps[i])) {
+      blank=0;
+      break;
+    }
+#ifdef HAVE_MPI
+  if (maps->maps[0]->comm)
+    MPI_Allreduce(MPI_IN_PLACE,&blank,1,MPI_INT,MPI_MIN,MPI_COMM_WORLD);
+#endif
+  return blank;
 }
 /*--------------------------------------------------------------------------------*/
 
 
 #ifdef HAVE_MPI
-int mpi_reduce_map(MAP *map)
+static void get_touched_range(const actData *vec, long n, long *lo, long *hi)
+//[lo,hi) spans every nonzero element of vec.  lo=n, hi=0 if vec is all zero.
 {
+  long i=0;
+  while ((i<n)&&(vec[i]==0))
+    i++;
+  *lo=i;
+  long j=n;
+  while ((j>i)&&(vec[j-1]==0))
+    j--;
+  *hi=(j>i ? j : 0);
+}
+/*--------------------------------------------------------------------------------*/
+static void accumulate_tile_hits(const MAP *map, TODvec *tods, PARAMS *params, long *hits, int tile_len);
+/*--------------------------------------------------------------------------------*/
+static void set_comm_displs(const int *count, int *displ, int nproc)
+{
+  displ[0]=0;
+  for (int i=1;i<nproc;i++)
+    displ[i]=displ[i-1]+count[i-1];
+}
+/*--------------------------------------------------------------------------------*/
+MapCommPattern *setup_map_comm(const MAP *map, TODvec *tods, PARAMS *params)
+//work out which process owns which tiles of a distributed map, and which tiles each process
+//needs for its own TODs, from the (saved) pixelization of the TODs.  The observed tiles are
+//split into contiguous ranges with the same number of tiles per owner.  Everything the
+//iterations exchange is fixed here, once.
+{
+  int nproc,myid;
+  MPI_Comm_size(MPI_COMM_WORLD,&nproc);
+  MPI_Comm_rank(MPI_COMM_WORLD,&myid);
 
-  int ierr;
-  actData *vec=vector(map->npix);
-  memset(vec,0,sizeof(actData)*map->npix);
-  ierr=MPI_Allreduce(map->map,vec,map->npix,MPI_NType,MPI_SUM,MPI_COMM_WORLD);
-  memcpy(map->map,vec,sizeof(actData)*map->npix);
-  free(vec);
+  MapCommPattern *comm=(MapCommPattern *)calloc(1,sizeof(MapCommPattern));
+  assert(comm);
+  comm->nproc=nproc;
+  comm->myid=myid;
+  comm->ntile=(map->npix+NK_MAP_TILE_LEN-1)/NK_MAP_TILE_LEN;
+  long ntile=comm->ntile;
+
+  long *hits=(long *)calloc(ntile,sizeof(long));
+  long *observed=(long *)malloc_retry(sizeof(long)*ntile);
+  assert(hits);
+  accumulate_tile_hits(map,tods,params,hits,NK_MAP_TILE_LEN);
+  for (long t=0;t<ntile;t++)
+    observed[t]=(hits[t]>0);
+  MPI_Allreduce(MPI_IN_PLACE,observed,ntile,MPI_LONG,MPI_MAX,MPI_COMM_WORLD);
+  long nobs=0;
+  for (long t=0;t<ntile;t++)
+    nobs+=observed[t];
+
+  comm->owner=(int *)malloc_retry(sizeof(int)*ntile);
+  long k=0;
+  for (long t=0;t<ntile;t++)
+    if (observed[t]) {
+      comm->owner[t]=(k*nproc)/nobs;
+      if (comm->owner[t]==myid)
+	comm->nowned++;
+      k++;
+    }
+    else
+      comm->owner[t]=-1;
+
+  //owners go up with the tile index, so walking the tiles in order groups the ghosts by owner.
+  comm->send_count=(int *)calloc(nproc,sizeof(int));
+  comm->send_displ=(int *)calloc(nproc,sizeof(int));
+  comm->recv_count=(int *)calloc(nproc,sizeof(int));
+  comm->recv_displ=(int *)calloc(nproc,sizeof(int));
+  for (long t=0;t<ntile;t++)
+    if ((hits[t]>0)&&(comm->owner[t]!=myid)) {
+      comm->send_count[comm->owner[t]]++;
+      comm->nsend++;
+    }
+  comm->send_tiles=(long *)malloc_retry(sizeof(long)*(comm->nsend>0 ? comm->nsend : 1));
+  k=0;
+  for (long t=0;t<ntile;t++)
+    if ((hits[t]>0)&&(comm->owner[t]!=myid))
+      comm->send_tiles[k++]=t;
+
+  //swap tile lists so every owner knows who wants what.
+  MPI_Alltoall(comm->send_count,1,MPI_INT,comm->recv_count,1,MPI_INT,MPI_COMM_WORLD);
+  set_comm_displs(comm->send_count,comm->send_displ,nproc);
+  set_comm_displs(comm->recv_count,comm->recv_displ,nproc);
+  for (int i=0;i<nproc;i++)
+    comm->nrecv+=comm->recv_count[i];
+  comm->recv_tiles=(long *)malloc_retry(sizeof(long)*(comm->nrecv>0 ? comm->nrecv : 1));
+  MPI_Alltoallv(comm->send_tiles,comm->send_count,comm->send_displ,MPI_LONG,comm->recv_tiles,comm->recv_count,comm->recv_displ,MPI_LONG,MPI_COMM_WORLD);
+
+  //from here on counts are in pixels, which is what the exchanges use.
+  assert((comm->nsend+comm->nrecv)*(long)NK_MAP_TILE_LEN<INT_MAX);
+  for (int i=0;i<nproc;i++) {
+    comm->send_count[i]*=NK_MAP_TILE_LEN;
+    comm->send_displ[i]*=NK_MAP_TILE_LEN;
+    comm->recv_count[i]*=NK_MAP_TILE_LEN;
+    comm->recv_displ[i]*=NK_MAP_TILE_LEN;
+  }
+  
+  mprintf(stdout,"distributed map has %ld observed tiles, %ld owned, %ld ghosts here.\n",nobs,comm->nowned,comm->nsend);
+  free(hits);
+  free(observed);
+  return comm;
+}
+/*--------------------------------------------------------------------------------*/
+void destroy_map_comm(MapCommPattern *comm)
+{
+  if (!comm)
+    return;
+  free(comm->owner);
+  free(comm->send_tiles);
+  free(comm->send_count);
+  free(comm->send_displ);
+  free(comm->recv_tiles);
+  free(comm->recv_count);
+  free(comm->recv_displ);
+  free(comm);
+}
+/*--------------------------------------------------------------------------------*/
+void setup_mapset_comm(MAPvec *maps, TODvec *tods, PARAMS *params)
+//turn a mapset into distributed maps.  Anything already in the maps is dropped from the
+//tiles a process doesn't own.
+{
+  for (int i=0;i<maps->nmap;i++) {
+    MAP *map=maps->maps[i];
+    if (!map->tiles)
+      tile_map(map);
+    map->comm=setup_map_comm(map,tods,params);
+    for (long t=0;t<map->ntile;t++)
+      if ((map->tiles[t])&&(map->comm->owner[t]!=map->comm->myid))
+	memset(map->tiles[t],0,sizeof(actData)*NK_MAP_TILE_LEN);
+  }
+}
+/*--------------------------------------------------------------------------------*/
+void free_mapset_comm(MAPvec *maps)
+//release the communication pattern shared by all copies of a distributed mapset.
+{
+  for (int i=0;i<maps->nmap;i++) {
+    destroy_map_comm(maps->maps[i]->comm);
+    maps->maps[i]->comm=NULL;
+  }
+}
+/*--------------------------------------------------------------------------------*/
+static void pack_map_tiles(const MAP *map, const long *tiles, long ntile, actData *buf)
+{
+  for (long k=0;k<ntile;k++)
+    if (map->tiles[tiles[k]])
+      memcpy(buf+k*NK_MAP_TILE_LEN,map->tiles[tiles[k]],sizeof(actData)*NK_MAP_TILE_LEN);
+    else
+      memset(buf+k*NK_MAP_TILE_LEN,0,sizeof(actData)*NK_MAP_TILE_LEN);
+}
+/*--------------------------------------------------------------------------------*/
+int mpi_reduce_distributed_map(MAP *out, MAP *in)
+//sum the contributions of every process into the owners' tiles of a distributed map.
+//Ghost tiles come out zero, so vector operations on the result only ever see owned pixels.
+{
+  MapCommPattern *comm=in->comm;
+  assert(comm);
+  assert(out->comm==comm);
+  actData *sendbuf=(actData *)malloc_retry(sizeof(actData)*(comm->nsend>0 ? comm->nsend : 1)*NK_MAP_TILE_LEN);
+  actData *recvbuf=(actData *)malloc_retry(sizeof(actData)*(comm->nrecv>0 ? comm->nrecv : 1)*NK_MAP_TILE_LEN);
+  pack_map_tiles(in,comm->send_tiles,comm->nsend,sendbuf);
+  int ierr=MPI_Alltoallv(sendbuf,comm->send_count,comm->send_displ,MPI_NType,recvbuf,comm->recv_count,comm->recv_displ,MPI_NType,MPI_COMM_WORLD);
+  
+  for (long t=0;t<comm->ntile;t++)
+    if (comm->owner[t]==comm->myid) {
+      if (out!=in) {
+	if (in->tiles[t])
+	  memcpy(get_map_tile(out,t),in->tiles[t],sizeof(actData)*NK_MAP_TILE_LEN);
+	else
+	  if (out->tiles[t])
+	    memset(out->tiles[t],0,sizeof(actData)*NK_MAP_TILE_LEN);
+      }
+    }
+    else
+      if (out->tiles[t])
+	memset(out->tiles[t],0,sizeof(actData)*NK_MAP_TILE_LEN);
+  for (long k=0;k<comm->nrecv;k++)
+    get_map_tile(out,comm->recv_tiles[k]);
+  
+  //threads split each tile, so contributions land in process order without collisions.
+#pragma omp parallel for shared(out,comm,recvbuf) default(none)
+  for (int i=0;i<NK_MAP_TILE_LEN;i++)
+    for (long k=0;k<comm->nrecv;k++)
+      out->tiles[comm->recv_tiles[k]][i]+=recvbuf[k*NK_MAP_TILE_LEN+i];
+  
+  free(sendbuf);
+  free(recvbuf);
   return ierr;
+}
+/*--------------------------------------------------------------------------------*/
+int mpi_fetch_map_ghosts(MAP *map)
+//copy the owners' values into the ghost tiles of a distributed map, so my TODs can read
+//every pixel they hit.  The reduction's exchange run backwards.
+{
+  MapCommPattern *comm=map->comm;
+  assert(comm);
+  actData *sendbuf=(actData *)malloc_retry(sizeof(actData)*(comm->nrecv>0 ? comm->nrecv : 1)*NK_MAP_TILE_LEN);
+  actData *recvbuf=(actData *)malloc_retry(sizeof(actData)*(comm->nsend>0 ? comm->nsend : 1)*NK_MAP_TILE_LEN);
+  pack_map_tiles(map,comm->recv_tiles,comm->nrecv,sendbuf);
+  int ierr=MPI_Alltoallv(sendbuf,comm->recv_count,comm->recv_displ,MPI_NType,recvbuf,comm->send_count,comm->send_displ,MPI_NType,MPI_COMM_WORLD);
+  for (long k=0;k<comm->nsend;k++)
+    memcpy(get_map_tile(map,comm->send_tiles[k]),recvbuf+k*NK_MAP_TILE_LEN,sizeof(actData)*NK_MAP_TILE_LEN);
+  free(sendbuf);
+  free(recvbuf);
+  return ierr;
+}
+/*--------------------------------------------------------------------------------*/
+int mpi_fetch_mapset_ghosts(MAPvec *maps)
+{
+  int ierr=0;
+  for (int i=0;i<maps->nmap;i++)
+    if (maps->maps[i]->comm)
+      ierr|=mpi_fetch_map_ghosts(maps->maps[i]);
+  return ierr;
+}
+/*--------------------------------------------------------------------------------*/
+static void write_distributed_map(MAP *map, char *filename)
+//gather the owned tiles of a distributed map onto the master and write it there.  Collective.
+{
+  MapCommPattern *comm=map->comm;
+  long nmine=0;
+  for (long t=0;t<comm->ntile;t++)
+    if ((comm->owner[t]==comm->myid)&&(map->tiles[t]))
+      nmine++;
+  long *mytiles=(long *)malloc_retry(sizeof(long)*(nmine>0 ? nmine : 1));
+  nmine=0;
+  for (long t=0;t<comm->ntile;t++)
+    if ((comm->owner[t]==comm->myid)&&(map->tiles[t]))
+      mytiles[nmine++]=t;
+  actData *mydata=(actData *)malloc_retry(sizeof(actData)*(nmine>0 ? nmine : 1)*NK_MAP_TILE_LEN);
+  pack_map_tiles(map,mytiles,nmine,mydata);
+
+  int nn=nmine;
+  int *counts=(int *)calloc(comm->nproc,sizeof(int));
+  int *displs=(int *)calloc(comm->nproc,sizeof(int));
+  MPI_Gather(&nn,1,MPI_INT,counts,1,MPI_INT,0,MPI_COMM_WORLD);
+  set_comm_displs(counts,displs,comm->nproc);
+  long ntot=0;
+  for (int i=0;i<comm->nproc;i++)
+    ntot+=counts[i];
+  long *alltiles=NULL;
+  actData *alldata=NULL;
+  if (comm->myid==0) {
+    alltiles=(long *)malloc_retry(sizeof(long)*(ntot>0 ? ntot : 1));
+    alldata=(actData *)malloc_retry(sizeof(actData)*(ntot>0 ? ntot : 1)*NK_MAP_TILE_LEN);
+  }
+  MPI_Gatherv(mytiles,nn,MPI_LONG,alltiles,counts,displs,MPI_LONG,0,MPI_COMM_WORLD);
+  assert(ntot*(long)NK_MAP_TILE_LEN<INT_MAX);
+  for (int i=0;i<comm->nproc;i++) {
+    counts[i]*=NK_MAP_TILE_LEN;
+    displs[i]*=NK_MAP_TILE_LEN;
+  }
+  MPI_Gatherv(mydata,nn*NK_MAP_TILE_LEN,MPI_NType,alldata,counts,displs,MPI_NType,0,MPI_COMM_WORLD);
+
+  if (comm->myid==0) {
+    //a sparse view of the whole map pointing into the gathered tiles.
+    MAP whole=*map;
+    whole.comm=NULL;
+    whole.tiles=(actData **)calloc(map->ntile,sizeof(actData *));
+    for (long k=0;k<ntot;k++)
+      whole.tiles[alltiles[k]]=alldata+k*NK_MAP_TILE_LEN;
+    readwrite_simple_map(&whole,filename,DOWRITE);
+    free(whole.tiles);
+    free(alltiles);
+    free(alldata);
+  }
+  free(counts);
+  free(displs);
+  free(mytiles);
+  free(mydata);
+}
+/*--------------------------------------------------------------------------------*/
+int mpi_reduce_mapset_into(MAPvec *out, MAPvec *in, bool use_bbox, long chunk, MAPvec *dotwith, actData *dot)
+//sum the maps in in over all processes into out, which may be the same mapset.
+//The maps go out as chunk-sized non-blocking allreduces that are all in flight
+//at once.  If dotwith is set (and the same on every process), *dot gets dotwith.out:
+//this process's share, dotwith.in, is worked out while the maps are in flight and
+//summed along with them, so the PCG's p.Ap costs no extra pass or reduction.
+//With use_bbox, only the union over processes of the range of pixels each
+//one actually touched is communicated - everything outside it is zero everywhere.
+//Sparse maps only send the union of the tiles allocated anywhere, packed together, and
+//distributed maps send their contributions to the owners of each tile.
+{
+  assert(out->nmap==in->nmap);
+  int nmap=in->nmap;
+  if (chunk<=0)
+    chunk=NK_MPI_REDUCE_CHUNK;
+  bool inplace=(out==in);
+
+  //stored as (-lo,hi) so a single MAX reduction gets the union of the ranges.  Tile
+  //occupancy flags of sparse maps go on the end so they're agreed on in the same call.
+  long nlim=2*nmap;
+  bool any_tiled=false;
+  for (int i=0;i<nmap;i++) {
+    assert(out->maps[i]->npix==in->maps[i]->npix);
+    assert((out->maps[i]->tiles==NULL)==(in->maps[i]->tiles==NULL));
+    if ((in->maps[i]->tiles)&&(!in->maps[i]->comm)) {
+      nlim+=in->maps[i]->ntile;
+      any_tiled=true;
+    }
+  }
+  long *lims=(long *)malloc_retry(nlim*sizeof(long));
+  long **occ=(long **)calloc(nmap,sizeof(long *));
+  long icur=2*nmap;
+  for (int i=0;i<nmap;i++) {
+    MAP *map=in->maps[i];
+    long lo=0,hi=map->npix*get_npol_in_map(map);
+    if (map->comm)
+      lo=hi=0;  //handled by the owner exchange below.
+    else if (map->tiles) {
+      occ[i]=lims+icur;
+      for (long t=0;t<map->ntile;t++)
+	occ[i][t]=(map->tiles[t]!=NULL);
+      icur+=map->ntile;
+    }
+    else
+      if (use_bbox)
+	get_touched_range(map->map,hi,&lo,&hi);
+    lims[2*i]=-lo;
+    lims[2*i+1]=hi;
+  }
+  if ((use_bbox)||(any_tiled))
+    MPI_Allreduce(MPI_IN_PLACE,lims,nlim,MPI_LONG,MPI_MAX,MPI_COMM_WORLD);
+
+  //pack the union of the tiles of each sparse map into one contiguous buffer.
+  actData **packed=(actData **)calloc(nmap,sizeof(actData *));
+  for (int i=0;i<nmap;i++)
+    if (occ[i]) {
+      MAP *map=in->maps[i];
+      long nocc=0;
+      for (long t=0;t<map->ntile;t++)
+	if (occ[i][t])
+	  nocc++;
+      packed[i]=(actData *)malloc_retry(sizeof(actData)*(nocc>0 ? nocc : 1)*NK_MAP_TILE_LEN);
+      long k=0;
+      for (long t=0;t<map->ntile;t++)
+	if (occ[i][t]) {
+	  if (map->tiles[t])
+	    memcpy(packed[i]+k*NK_MAP_TILE_LEN,map->tiles[t],sizeof(actData)*NK_MAP_TILE_LEN);
+	  else
+	    memset(packed[i]+k*NK_MAP_TILE_LEN,0,sizeof(actData)*NK_MAP_TILE_LEN);
+	  k++;
+	}
+      lims[2*i]=0;
+      lims[2*i+1]=nocc*NK_MAP_TILE_LEN;
+    }
+
+  int nreq=(dotwith ? 1 : 0);
+  for (int i=0;i<nmap;i++) {
+    long lo=-lims[2*i],hi=lims[2*i+1];
+    if (hi>lo)
+      nreq+=(hi-lo+chunk-1)/chunk;
+  }
+  MPI_Request *reqs=(MPI_Request *)malloc_retry((nreq+1)*sizeof(MPI_Request));
+
+  int ierr=0;
+#if MPI_VERSION>=3
+  int ireq=0;
+#endif
+  for (int i=0;i<nmap;i++) {
+    long lo=-lims[2*i],hi=lims[2*i+1];
+    if (hi<lo)
+      hi=lo;
+    bool myinplace=inplace;
+    actData *src,*dest;
+    if (packed[i]) {
+      src=dest=packed[i];
+      myinplace=true;
+    }
+    else if (in->maps[i]->comm)
+      continue;
+    else {
+      long n=in->maps[i]->npix*get_npol_in_map(in->maps[i]);
+      src=in->maps[i]->map;
+      dest=out->maps[i]->map;
+      if (!inplace) {
+	memset(dest,0,sizeof(actData)*lo);
+	memset(dest+hi,0,sizeof(actData)*(n-hi));
+      }
+    }
+    for (long j=lo;j<hi;j+=chunk) {
+      int nn=(hi-j<chunk ? hi-j : chunk);
+#if MPI_VERSION>=3
+      ierr|=MPI_Iallreduce(myinplace ? MPI_IN_PLACE : src+j,dest+j,nn,MPI_NType,MPI_SUM,MPI_COMM_WORLD,&reqs[ireq++]);
+#else
+      ierr|=MPI_Allreduce(myinplace ? MPI_IN_PLACE : src+j,dest+j,nn,MPI_NType,MPI_SUM,MPI_COMM_WORLD);
+#endif
+    }
+  }
+  actData mydot=0;
+  if (dotwith) {
+    //in is only read by the reductions above (and not at all for distributed maps yet).
+    for (int i=0;i<nmap;i++)
+      if (!in->maps[i]->comm)
+	mydot+=map_times_map(dotwith->maps[i],in->maps[i]);
+#if MPI_VERSION>=3
+    ierr|=MPI_Iallreduce(MPI_IN_PLACE,&mydot,1,MPI_NType,MPI_SUM,MPI_COMM_WORLD,&reqs[ireq++]);
+#else
+    ierr|=MPI_Allreduce(MPI_IN_PLACE,&mydot,1,MPI_NType,MPI_SUM,MPI_COMM_WORLD);
+#endif
+  }
+#if MPI_VERSION>=3
+  assert(ireq==nreq);
+  ierr|=MPI_Waitall(ireq,reqs,MPI_STATUSES_IGNORE);
+#endif
+
+  actData owned_dot=0;
+  bool any_comm=false;
+  for (int i=0;i<nmap;i++)
+    if (in->maps[i]->comm) {
+      ierr|=mpi_reduce_distributed_map(out->maps[i],in->maps[i]);
+      if (dotwith)
+	owned_dot+=map_times_map(dotwith->maps[i],out->maps[i]);
+      any_comm=true;
+    }
+  if (dotwith) {
+    //distributed maps are only whole on their owners, same as mapset_times_mapset.
+    if (any_comm)
+      ierr|=MPI_Allreduce(MPI_IN_PLACE,&owned_dot,1,MPI_NType,MPI_SUM,MPI_COMM_WORLD);
+    *dot=mydot+owned_dot;
+  }
   
+  for (int i=0;i<nmap;i++)
+    if (packed[i]) {
+      MAP *map=out->maps[i];
+      long k=0;
+      for (long t=0;t<map->ntile;t++)
+	if (occ[i][t]) {
+	  memcpy(get_map_tile(map,t),packed[i]+k*NK_MAP_TILE_LEN,sizeof(actData)*NK_MAP_TILE_LEN);
+	  k++;
+	}
+	else
+	  if (map->tiles[t])
+	    memset(map->tiles[t],0,sizeof(actData)*NK_MAP_TILE_LEN);
+      free(packed[i]);
+    }
+  free(packed);
+  free(occ);
+  free(reqs);
+  free(lims);
+  return ierr;
+}
+/*--------------------------------------------------------------------------------*/
+int mpi_reduce_map(MAP *map)
+{
+  MAPvec maps;
+  maps.nmap=1;
+  maps.maps=&map;
+  return mpi_reduce_mapset_into(&maps,&maps,false,0,NULL,NULL);
 }
 
 /*--------------------------------------------------------------------------------*/
 int  mpi_reduce_mapset(MAPvec *maps)
 {
-  int ierr;
-  for (int i=0;i<maps->nmap;i++) {
-    ierr=mpi_reduce_map(maps->maps[i]);
-    assert(ierr==0);
-  }
+  int ierr=mpi_reduce_mapset_into(maps,maps,false,0,NULL,NULL);
+  assert(ierr==0);
   return ierr;
 }
 #endif
@@ -1498,11 +2616,9 @@ int mpi_broadcast_mapset(MAPvec *maps,int master)
 int read_tod_data(mbTOD *tod)
 {
 
-  if (tod->have_data==0)
-    tod->data=matrix(tod->ndet,tod->ndata);
-  tod->have_data=1;  
-  //printf("clearing tod.\n");
-  clear_tod(tod);
+  //with no data yet, the reader allocates it (or hands over a prefetched copy).
+  if (tod->have_data)
+    clear_tod(tod);
   //printf("reading tod.\n");
   read_dirfile_tod_data (tod);
   return 0;
@@ -1636,7 +2752,32 @@ void get_pointing_vec_new(const mbTOD *tod, const MAP *map, int det, int *ind, P
 #endif 
   
 }
-
+/*--------------------------------------------------------------------------------*/
+void get_all_pointing_vecs(const mbTOD *tod, const MAP *map, const PARAMS *params, int **inds)
+//pixelization of every kept, listed detector into inds[det].  Detectors go in blocks of
+//NK_POINTING_BLOCK so the pointing-fit pivots get evaluated a block at a time.
+{
+  int nblock=(tod->ndet+NK_POINTING_BLOCK-1)/NK_POINTING_BLOCK;
+#pragma omp parallel shared(tod,map,params,inds,nblock) default(none)
+  {
+    PointingFitScratch *scratch=allocate_pointing_fit_scratch(tod);
+    int dets[NK_POINTING_BLOCK];
+    int *rows[NK_POINTING_BLOCK];
+#pragma omp for schedule(dynamic,1)
+    for (int block=0;block<nblock;block++) {
+      int ndet=0;
+      for (int i=block*NK_POINTING_BLOCK;(i<(block+1)*NK_POINTING_BLOCK)&&(i<tod->ndet);i++)
+	if ((!mbCutsIsAlwaysCut(tod->cuts,tod->rows[i],tod->cols[i]))&&(is_det_listed(tod,params,i))) {
+	  dets[ndet]=i;
+	  rows[ndet]=inds[i];
+	  ndet++;
+	}
+      if (ndet>0)
+	get_map_projection_ndet(tod,map,dets,ndet,rows,scratch);
+    }
+    destroy_pointing_fit_scratch(scratch);
+  }
+}
 /*--------------------------------------------------------------------------------*/
 
 void write_tod_pointing_to_disk(const mbTOD *tod, char *fname)
@@ -1829,15 +2970,7 @@ void generate_index_mapping(MAP *map, mbTOD *tod, int **inds)
 {
   assert(map);
   assert(map->projection);
-#pragma omp parallel shared(map,tod,inds)
-  {
-    PointingFitScratch *scratch=allocate_pointing_fit_scratch(tod);
-#pragma omp for schedule(dynamic,4)
-    for (int i=0;i<tod->ndet;i++) 
-      if ((!mbCutsIsAlwaysCut(tod->cuts,tod->rows[i],tod->cols[i]))&&(is_det_listed(tod,NULL,i)))
-	get_pointing_vec_new(tod,map,i,inds[i],scratch);  
-    destroy_pointing_fit_scratch(scratch);   
-   }
+  get_all_pointing_vecs(tod,map,NULL,inds);
 }
 /*--------------------------------------------------------------------------------*/
 void find_map_index_limits(MAP *map, mbTOD *tod, int *imin_out, int *imax_out)
@@ -1898,70 +3031,6 @@ void find_map_index_limits(MAP *map, mbTOD *tod, int *imin_out, int *imax_out)
   *imax_out=imax;
   
 }
-/*--------------------------------------------------------------------------------*/
-int *tod2map_actpol(MAP *map, mbTOD *tod, int *ipiv_proc)
-//project a tod into a map, hopefully with better ompness.  It wants to know the
-//index limits for processes when mapping TODs into a map.  If ipiv_proc comes in as null,
-//it will calculate some for you.
-{
-
-  //float **sin2gamma=fmatrix(tod->ndet,tod->ndata);  //eventually polarization goes in.
-  assert(map);
-  assert(map->projection);
-  if (ipiv_proc==NULL) {
-    printf("Nope, pivot finding not yet implemented.\n");
-    return NULL;    
-  }
-    
-  int **inds=imatrix(tod->ndet,tod->ndata);
-  generate_index_mapping(map,tod, inds);
-  
-
-  
-#pragma omp parallel shared(map,tod,inds,ipiv_proc) default(none)
-  {
-    int myid=omp_get_thread_num();
-    
-#pragma omp for
-    for (int i=0;i<tod->ndet;i++) {
-      if ((!mbCutsIsAlwaysCut(tod->cuts,tod->rows[i],tod->cols[i]))&&(is_det_listed(tod,NULL,i))) {      
-	if (tod->kept_data) {
-	  int row=tod->rows[i];
-	  int col=tod->cols[i];
-	  mbUncut *uncut=tod->kept_data[row][col];
-	  for (int region=0;region<uncut->nregions;region++)
-	    for (int j=uncut->indexFirst[region];j<uncut->indexLast[region];j++) {
-	      int itmp=inds[i][j];
-	      if ((itmp>=ipiv_proc[myid])&&(itmp<ipiv_proc[myid+1]))
-		map->map[itmp]+=tod->data[i][j];
-	    }
-	}
-	else {
-	  if (tod->uncuts) {
-	    int row=tod->rows[i];
-	    int col=tod->cols[i];
-	    mbUncut *uncut=tod->uncuts[row][col];
-	    for (int region=0;region<uncut->nregions;region++)
-	      for (int j=uncut->indexFirst[region];j<uncut->indexLast[region];j++) {
-		int itmp=inds[i][j];
-		if ((itmp>=ipiv_proc[myid])&&(itmp<ipiv_proc[myid+1]))
-		  map->map[itmp]+=tod->data[i][j];
-	      }
-	  }
-	  else
-	    for (int j=0;j<tod->ndata;j++)
-	      map->map[inds[i][j]]+=tod->data[i][j];
-	}
-      }
-    }
-  }
-  free(inds[0]);
-  free(inds);
-
-  return NULL;
-
-}
-
 /*--------------------------------------------------------------------------------*/
 void tod2map_nocopy(MAP *map, mbTOD *tod,PARAMS *params)
 {
@@ -1969,17 +3038,7 @@ void tod2map_nocopy(MAP *map, mbTOD *tod,PARAMS *params)
 
   assert(map);
   assert(map->projection);
-#pragma omp parallel shared(map,tod,inds)
-  {
-    PointingFitScratch *scratch=allocate_pointing_fit_scratch(tod);
-#pragma omp for schedule(dynamic,4)
-    for (int i=0;i<tod->ndet;i++) { 
-      if ((!mbCutsIsAlwaysCut(tod->cuts,tod->rows[i],tod->cols[i]))&&(is_det_listed(tod,params,i)))
-	get_pointing_vec_new(tod,map,i,inds[i],scratch);  
-    }
-    destroy_pointing_fit_scratch(scratch);
-    
-   }
+  get_all_pointing_vecs(tod,map,params,inds);
 
   for (int i=0;i<tod->ndet;i++) {
     if ((!mbCutsIsAlwaysCut(tod->cuts,tod->rows[i],tod->cols[i]))&&(is_det_listed(tod,params,i))) {
@@ -2007,11 +3066,427 @@ void tod2map_nocopy(MAP *map, mbTOD *tod,PARAMS *params)
       }
     }
   }
-  free(inds[0]);
-  free(inds);
+  free(inds[0]);
+  free(inds);
+
+
+      
+}
+/*--------------------------------------------------------------------------------*/
+static void get_det_kept_regions(const mbTOD *tod, int det, bool use_kept, int *nregions, int **first, int **last)
+//point first/last at the kept regions of a detector, from kept_data if use_kept and the TOD has
+//it, otherwise from the uncuts.  If there are no cuts, first/last are left alone, so callers
+//should preload them with the full range.
+{
+  mbUncut *uncut=NULL;
+  if ((use_kept)&&(tod->kept_data))
+    uncut=tod->kept_data[tod->rows[det]][tod->cols[det]];
+  else
+    if (tod->uncuts)
+      uncut=tod->uncuts[tod->rows[det]][tod->cols[det]];
+  if (uncut) {
+    *nregions=uncut->nregions;
+    *first=uncut->indexFirst;
+    *last=uncut->indexLast;
+  }
+}
+/*--------------------------------------------------------------------------------*/
+MapTileBuckets *bucket_tod_by_map_tile(const MAP *map, const mbTOD *tod, const PARAMS *params, bool use_kept, int nthread)
+//counting-sort the kept samples of a TOD by map tile.  use_kept picks kept_data over the uncuts,
+//as in tod2map; tod2polmap only ever projects the uncuts.  Thread t fills its own slots inside 
+//every tile, so the ordering is deterministic.  Tiles are then split into nthread contiguous
+//ranges holding roughly equal numbers of samples.
+{
+  assert(map);
+  assert(map->projection);
+  assert(nthread>0);
+
+  MapTileBuckets *buckets=(MapTileBuckets *)calloc(1,sizeof(MapTileBuckets));
+  assert(buckets);
+  buckets->tile_len=NK_MAP_TILE_LEN;
+  buckets->ntile=(map->npix+buckets->tile_len-1)/buckets->tile_len;
+  buckets->nthread=nthread;
+  buckets->kept=((use_kept)&&(tod->kept_data));
+  buckets->tile_start=(long *)malloc_retry(sizeof(long)*(buckets->ntile+1));
+  buckets->thread_tile=(long *)malloc_retry(sizeof(long)*(nthread+1));
+
+  long ntile=buckets->ntile;
+  int tile_len=buckets->tile_len;
+  int **inds=imatrix(tod->ndet,tod->ndata);
+  long *counts=(long *)calloc(nthread*ntile,sizeof(long));
+  assert(counts);
+  get_all_pointing_vecs(tod,map,params,inds);
+  
+#pragma omp parallel num_threads(nthread) shared(map,tod,params,use_kept,inds,counts,buckets,ntile,tile_len,nthread) default(none)
+  {
+    int myid=omp_get_thread_num();
+    long *mycounts=counts+myid*ntile;
+
+    //the counting and filling loops must see the same detectors on the same threads, so keep them static.
+#pragma omp for schedule(static)
+    for (int i=0;i<tod->ndet;i++)
+      if ((!mbCutsIsAlwaysCut(tod->cuts,tod->rows[i],tod->cols[i]))&&(is_det_listed(tod,params,i))) {
+	int whole[2]={0,tod->ndata};
+	int nregions=1,*first=whole,*last=whole+1;
+	get_det_kept_regions(tod,i,use_kept,&nregions,&first,&last);
+	for (int region=0;region<nregions;region++)
+	  for (int j=first[region];j<last[region];j++)
+	    mycounts[inds[i][j]/tile_len]++;
+      }
+    
+#pragma omp single
+    {
+      //turn the counts into per-thread write cursors, tile-major.
+      long tot=0;
+      for (long tile=0;tile<ntile;tile++) {
+	buckets->tile_start[tile]=tot;
+	for (int t=0;t<nthread;t++) {
+	  long nn=counts[t*ntile+tile];
+	  counts[t*ntile+tile]=tot;
+	  tot+=nn;
+	}
+      }
+      buckets->tile_start[ntile]=tot;
+      buckets->nsamp=tot;
+      buckets->pix=(int *)malloc_retry(sizeof(int)*(tot>0 ? tot : 1));
+      buckets->det=(int *)malloc_retry(sizeof(int)*(tot>0 ? tot : 1));
+      buckets->samp=(int *)malloc_retry(sizeof(int)*(tot>0 ? tot : 1));
+
+      long tile=0;
+      buckets->thread_tile[0]=0;
+      for (int t=1;t<nthread;t++) {
+	long target=(tot*t)/nthread;
+	while ((tile<ntile)&&(buckets->tile_start[tile]<target))
+	  tile++;
+	buckets->thread_tile[t]=tile;
+      }
+      buckets->thread_tile[nthread]=ntile;
+    }
+
+#pragma omp for schedule(static)
+    for (int i=0;i<tod->ndet;i++)
+      if ((!mbCutsIsAlwaysCut(tod->cuts,tod->rows[i],tod->cols[i]))&&(is_det_listed(tod,params,i))) {
+	int whole[2]={0,tod->ndata};
+	int nregions=1,*first=whole,*last=whole+1;
+	get_det_kept_regions(tod,i,use_kept,&nregions,&first,&last);
+	for (int region=0;region<nregions;region++)
+	  for (int j=first[region];j<last[region];j++) {
+	    long ii=mycounts[inds[i][j]/tile_len]++;
+	    buckets->pix[ii]=inds[i][j];
+	    buckets->det[ii]=i;
+	    buckets->samp[ii]=j;
+	  }
+      }
+  }
+  
+  free(counts);
+  free(inds[0]);
+  free(inds);
+  return buckets;
+}
+/*--------------------------------------------------------------------------------*/
+void destroy_map_tile_buckets(MapTileBuckets *buckets)
+{
+  if (buckets==NULL)
+    return;
+  free(buckets->tile_start);
+  free(buckets->thread_tile);
+  free(buckets->pix);
+  free(buckets->det);
+  free(buckets->samp);
+  free(buckets);
+}
+/*--------------------------------------------------------------------------------*/
+static bool lists_all_dets(const PARAMS *params)
+{
+  return (params==NULL)||((params->n_use_rows==0)&&(params->n_use_cols==0));
+}
+/*--------------------------------------------------------------------------------*/
+static bool tod_has_map_tile_buckets(const MAP *map, const mbTOD *tod, const PARAMS *params, bool use_kept, int nthread)
+//params only matter through is_det_listed, so any two that list every detector match.  That
+//lets tod2polmap (no params) share the buckets tod2map made when the TOD has no kept_data.
+{
+  MapTileBuckets *buckets=tod->tile_buckets;
+  if ((buckets==NULL)||(buckets->projection!=map->projection)||(buckets->npix!=map->npix)||(buckets->nthread!=nthread))
+    return false;
+  if (buckets->kept!=((use_kept)&&(tod->kept_data)))
+    return false;
+  return (buckets->params==params)||((lists_all_dets(buckets->params))&&(lists_all_dets(params)));
+}
+/*--------------------------------------------------------------------------------*/
+static bool map_tile_buckets_fit(const MAP *map, const mbTOD *tod, const PARAMS *params, bool use_kept, int nthread)
+//buckets cost three ints a sample for as long as the TOD has data, so only make them if
+//that's no more than the per-thread map copies they save.
+{
+  if (tod_has_map_tile_buckets(map,tod,params,use_kept,nthread))
+    return true;
+  return 3*sizeof(int)*(long)tod->ndet*tod->ndata<=nthread*map->npix*sizeof(actData);
+}
+/*--------------------------------------------------------------------------------*/
+MapTileBuckets *get_tod_map_tile_buckets(const MAP *map, mbTOD *tod, const PARAMS *params, bool use_kept, int nthread)
+//tile buckets of a TOD for this map, made the first time they're asked for and then kept
+//on the TOD until its data is freed, so PCG iterations don't redo the pointing and sort.
+{
+  if (tod_has_map_tile_buckets(map,tod,params,use_kept,nthread))
+    return tod->tile_buckets;
+  free_tod_map_tile_buckets(tod);
+  MapTileBuckets *buckets=bucket_tod_by_map_tile(map,tod,params,use_kept,nthread);
+  buckets->projection=map->projection;
+  buckets->npix=map->npix;
+  buckets->params=params;
+  tod->tile_buckets=buckets;
+  return buckets;
+}
+/*--------------------------------------------------------------------------------*/
+void free_tod_map_tile_buckets(mbTOD *tod)
+{
+  destroy_map_tile_buckets(tod->tile_buckets);
+  tod->tile_buckets=NULL;
+}
+/*--------------------------------------------------------------------------------*/
+void tod2map_tiled(MAP *map, mbTOD *tod, const PARAMS *params)
+//project a tod into a map by tile buckets.  Every thread owns a disjoint range of tiles,
+//so there are no locks, no atomics, and no private map copies.
+{
+  assert(map);
+  assert(map->projection);
+
+  int nthread;
+#pragma omp parallel shared(nthread) default(none)
+#pragma omp single
+  nthread=omp_get_num_threads();
+
+  MapTileBuckets *buckets=get_tod_map_tile_buckets(map,tod,params,true,nthread);
+
+#pragma omp parallel num_threads(nthread) shared(map,tod,buckets) default(none)
+  {
+    int myid=omp_get_thread_num();
+    long imin=buckets->tile_start[buckets->thread_tile[myid]];
+    long imax=buckets->tile_start[buckets->thread_tile[myid+1]];
+    for (long ii=imin;ii<imax;ii++)
+      map->map[buckets->pix[ii]]+=tod->data[buckets->det[ii]][buckets->samp[ii]];
+  }
+}
+/*--------------------------------------------------------------------------------*/
+void tod2map_sparse(MAP *map, mbTOD *tod, const PARAMS *params)
+//project a tod into a sparse map.  Same tile buckets as tod2map_tiled, and the tiles
+//this TOD hits get allocated up front so the threads never have to.
+{
+  assert(map);
+  assert(map->projection);
+  assert(map->tiles);
+
+  int nthread;
+#pragma omp parallel shared(nthread) default(none)
+#pragma omp single
+  nthread=omp_get_num_threads();
+
+  MapTileBuckets *buckets=get_tod_map_tile_buckets(map,tod,params,true,nthread);
+  assert(buckets->ntile==map->ntile);
+  for (long tile=0;tile<buckets->ntile;tile++)
+    if (buckets->tile_start[tile+1]>buckets->tile_start[tile])
+      get_map_tile(map,tile);
+
+#pragma omp parallel num_threads(nthread) shared(map,tod,buckets) default(none)
+  {
+    int myid=omp_get_thread_num();
+    for (long tile=buckets->thread_tile[myid];tile<buckets->thread_tile[myid+1];tile++) {
+      actData *mytile=map->tiles[tile];
+      long off=tile*NK_MAP_TILE_LEN;
+      for (long ii=buckets->tile_start[tile];ii<buckets->tile_start[tile+1];ii++)
+	mytile[buckets->pix[ii]-off]+=tod->data[buckets->det[ii]][buckets->samp[ii]];
+    }
+  }
+}
+/*--------------------------------------------------------------------------------*/
+actData tod_times_map_tiled(const MAP *map, mbTOD *tod, const PARAMS *params)
+//same as tod_times_map, but walks the map a tile at a time so the map reads stay in cache.
+{
+  assert(map);
+  assert(map->projection);
+
+  int nthread;
+#pragma omp parallel shared(nthread) default(none)
+#pragma omp single
+  nthread=omp_get_num_threads();
+
+  MapTileBuckets *buckets=get_tod_map_tile_buckets(map,tod,params,true,nthread);
+
+  actData tot=0;
+#pragma omp parallel num_threads(nthread) shared(map,tod,buckets) reduction(+:tot) default(none)
+  {
+    int myid=omp_get_thread_num();
+    long imin=buckets->tile_start[buckets->thread_tile[myid]];
+    long imax=buckets->tile_start[buckets->thread_tile[myid+1]];
+    for (long ii=imin;ii<imax;ii++)
+      tot+=map->map[buckets->pix[ii]]*tod->data[buckets->det[ii]][buckets->samp[ii]];
+  }
+
+  return tot;
+}
+/*--------------------------------------------------------------------------------*/
+static void set_map_pivots_from_tile_hits(MAP *map, const long *hits, long ntile, int tile_len, int nthread)
+//split the map into nthread pixel ranges, on tile boundaries, holding roughly equal hit counts.
+//Pivots are cached on the map so they can be reused across PCG iterations.
+{
+  if (map->ipiv_proc)
+    free(map->ipiv_proc);
+  map->ipiv_proc=(int *)malloc_retry(sizeof(int)*(nthread+1));
+  map->npiv_proc=nthread;
+
+  long tot=0;
+  for (long tile=0;tile<ntile;tile++)
+    tot+=hits[tile];
+
+  long cum=0;
+  long tile=0;
+  map->ipiv_proc[0]=0;
+  for (int t=1;t<nthread;t++) {
+    long target=(tot*t)/nthread;
+    while ((tile<ntile)&&(cum<target)) {
+      cum+=hits[tile];
+      tile++;
+    }
+    long pix=tile*tile_len;
+    map->ipiv_proc[t]=(pix<map->npix ? pix : map->npix);
+  }
+  map->ipiv_proc[nthread]=map->npix;
+}
+/*--------------------------------------------------------------------------------*/
+static void accumulate_tile_hits(const MAP *map, TODvec *tods, PARAMS *params, long *hits, int tile_len)
+//add the number of kept samples of all my TODs landing in each map tile into hits.
+{
+  long ntile=(map->npix+tile_len-1)/tile_len;
+  for (int tt=0;tt<tods->ntod;tt++) {
+    mbTOD *tod=&(tods->tods[tt]);
+#pragma omp parallel shared(map,tod,params,hits,ntile,tile_len) default(none)
+    {
+      long *myhits=(long *)calloc(ntile,sizeof(long));
+      int *ind=(int *)malloc_retry(sizeof(int)*tod->ndata);
+      PointingFitScratch *scratch=allocate_pointing_fit_scratch(tod);
+#pragma omp for schedule(dynamic,4)
+      for (int i=0;i<tod->ndet;i++)
+	if ((!mbCutsIsAlwaysCut(tod->cuts,tod->rows[i],tod->cols[i]))&&(is_det_listed(tod,params,i))) {
+	  get_pointing_vec_new(tod,map,i,ind,scratch);
+	  int whole[2]={0,tod->ndata};
+	  int nregions=1,*first=whole,*last=whole+1;
+	  get_det_kept_regions(tod,i,true,&nregions,&first,&last);
+	  for (int region=0;region<nregions;region++)
+	    for (int j=first[region];j<last[region];j++)
+	      myhits[ind[j]/tile_len]++;
+	}
+#pragma omp critical
+      for (long tile=0;tile<ntile;tile++)
+	hits[tile]+=myhits[tile];
+      destroy_pointing_fit_scratch(scratch);
+      free(ind);
+      free(myhits);
+    }
+  }
+}
+/*--------------------------------------------------------------------------------*/
+void set_map_pivots_from_hit_map(MAP *map, const MAP *hitmap)
+//set the cached projection pivots of a map from a hit map on the same pixels, e.g. the weights
+//from get_weights, so there's no extra pass through the TODs.  Call once before iterating if
+//the first TOD seen by tod2map_actpol is not representative.
+{
+  assert(map);
+  assert(map->projection);
+  assert(hitmap->map);
+  assert(hitmap->npix==map->npix);
+  int nthread;
+#pragma omp parallel shared(nthread) default(none)
+#pragma omp single
+  nthread=omp_get_num_threads();
+
+  int tile_len=NK_MAP_TILE_LEN;
+  long ntile=(map->npix+tile_len-1)/tile_len;
+  long *hits=(long *)calloc(ntile,sizeof(long));
+  assert(hits);
+  for (long i=0;i<map->npix;i++)
+    hits[i/tile_len]+=(long)hitmap->map[i];
+  set_map_pivots_from_tile_hits(map,hits,ntile,tile_len,nthread);
+  free(hits);
+}
+/*--------------------------------------------------------------------------------*/
+static int *get_map_pivots(MAP *map, const MapTileBuckets *buckets, int nthread)
+//the pivots cached on the map, found from this TOD's tile hits if there are none for nthread threads.
+{
+  if ((map->ipiv_proc==NULL)||(map->npiv_proc!=nthread)) {
+    long *hits=(long *)malloc_retry(sizeof(long)*buckets->ntile);
+    for (long tile=0;tile<buckets->ntile;tile++)
+      hits[tile]=buckets->tile_start[tile+1]-buckets->tile_start[tile];
+    set_map_pivots_from_tile_hits(map,hits,buckets->ntile,buckets->tile_len,nthread);
+    free(hits);
+  }
+  return map->ipiv_proc;
+}
+/*--------------------------------------------------------------------------------*/
+static void get_pivot_sample_range(const MapTileBuckets *buckets, const int *ipiv_proc, int myid, long *imin, long *imax)
+//bucketed samples that can belong to thread myid.  Only the tiles straddling a pivot hold
+//samples belonging to other threads, so the pixel still has to be checked.
+{
+  int pmin=ipiv_proc[myid];
+  int pmax=ipiv_proc[myid+1];
+  *imin=*imax=0;
+  if (pmax<=pmin)
+    return;
+  long tmin=pmin/buckets->tile_len;
+  long tmax=(pmax-1)/buckets->tile_len+1;
+  if (tmax>buckets->ntile)
+    tmax=buckets->ntile;
+  *imin=buckets->tile_start[tmin];
+  *imax=buckets->tile_start[tmax];
+}
+/*--------------------------------------------------------------------------------*/
+static void tod2map_pivoted(MAP *map, mbTOD *tod, const PARAMS *params, const int *ipiv_proc, int nthread)
+{
+  MapTileBuckets *buckets=get_tod_map_tile_buckets(map,tod,params,true,nthread);
+  if (ipiv_proc==NULL)
+    ipiv_proc=get_map_pivots(map,buckets,nthread);
+
+#pragma omp parallel num_threads(nthread) shared(map,tod,buckets,ipiv_proc) default(none)
+  {
+    int myid=omp_get_thread_num();
+    int pmin=ipiv_proc[myid];
+    int pmax=ipiv_proc[myid+1];
+    long imin,imax;
+    get_pivot_sample_range(buckets,ipiv_proc,myid,&imin,&imax);
+    for (long ii=imin;ii<imax;ii++) {
+      int pix=buckets->pix[ii];
+      if ((pix>=pmin)&&(pix<pmax))
+	map->map[pix]+=tod->data[buckets->det[ii]][buckets->samp[ii]];
+    }
+  }
+}
+/*--------------------------------------------------------------------------------*/
+int *tod2map_actpol(MAP *map, mbTOD *tod, int *ipiv_proc)
+//project a tod into a map, with each thread owning the pixel range [ipiv_proc[i],ipiv_proc[i+1]).
+//If ipiv_proc comes in as null, the pivots cached on the map are used, and if there are none
+//(or they were made for a different thread count) they are found from this TOD's hit histogram
+//and cached.  Samples are bucketed by map tile first, so each thread only ever touches its own
+//samples.  Returns the pivots used.
+{
+  assert(map);
+  assert(map->projection);
 
+  int nthread;
+#pragma omp parallel shared(nthread) default(none)
+#pragma omp single
+  nthread=omp_get_num_threads();
 
-      
+  if (ipiv_proc==NULL)
+    ipiv_proc=get_map_pivots(map,get_tod_map_tile_buckets(map,tod,NULL,true,nthread),nthread);
+  tod2map_pivoted(map,tod,NULL,ipiv_proc,nthread);
+  return ipiv_proc;
+}
+/*--------------------------------------------------------------------------------*/
+void clear_map_pivots(MAP *map)
+{
+  if (map->ipiv_proc)
+    free(map->ipiv_proc);
+  map->ipiv_proc=NULL;
+  map->npiv_proc=0;
 }
 /*--------------------------------------------------------------------------------*/
 int is_map_polarized(MAP *map) 
@@ -2035,6 +3510,11 @@ void tod2map(MAP *map, mbTOD *tod, PARAMS *params)
   assert(map);
   assert(map->projection);
 
+  if (map->tiles) {
+    tod2map_sparse(map,tod,params);
+    return;
+  }
+
 #ifdef ACTPOLFWEEE
   if (is_map_polarized(map)) {       
     return;
@@ -2047,6 +3527,16 @@ void tod2map(MAP *map, mbTOD *tod, PARAMS *params)
 #pragma omp parallel shared(nproc) default(none)
 #pragma omp single
   nproc=omp_get_num_threads();
+
+  if ((nproc>1)&&(map_tile_buckets_fit(map,tod,params,true,nproc))) {
+    //bucket by map tile, threads own disjoint tiles.  No map copies or locked reductions.  If
+    //run_PCG set pivots up front, every thread keeps the same slice of the map for every TOD.
+    if (map->npiv_proc==nproc)
+      tod2map_pivoted(map,tod,params,map->ipiv_proc,nproc);
+    else
+      tod2map_tiled(map,tod,params);
+    return;
+  }
   
   if (nproc*map->npix*sizeof(actData)>tod->ndata*tod->ndet*sizeof(int)) {
     //printf("doing index-saving projection.\n");
@@ -2164,10 +3654,11 @@ void polmap2tod(MAP *map, mbTOD *tod)
 {
   assert(tod);
   assert(tod->data);
-  assert(tod->pixelization_saved);
+  assert((tod->pixelization_saved)||(tod->pixelization_packed));
   assert(tod->uncuts);
 
 
+  assert(map->tiles==NULL);  //polarized maps are dense only.
   const int npol=get_npol_in_map(map);
   const int poltag=get_map_poltag(map);
   const int npix=map->npix;
@@ -2184,22 +3675,25 @@ void polmap2tod(MAP *map, mbTOD *tod)
 
 
     const actData *mymap=map->map;
+    int *pixbuf=(int *)malloc_retry(sizeof(int)*tod->ndata);
     switch(poltag){
     case POL_I:
 #pragma omp for
       for (int det=0;det<tod->ndet;det++) {
+	const int *pix=get_saved_pixelization(tod,det,pixbuf);
 	int row=tod->rows[det];
 	int col=tod->cols[det];
 	mbUncut *uncut=tod->uncuts[row][col];
 	for (int region=0;region<uncut->nregions;region++) {
 	  for (int j=uncut->indexFirst[region];j<uncut->indexLast[region];j++)
-	    tod->data[det][j]+=mymap[tod->pixelization_saved[det][j]];
+	    tod->data[det][j]+=mymap[pix[j]];
 	}
       }
       break;
     case POL_IQU:
 #pragma omp for
       for (int det=0;det<tod->ndet;det++) {
+	const int *pix=get_saved_pixelization(tod,det,pixbuf);
 	actData ctime_sin=pfit->gamma_ctime_sin_coeffs[det]*ninv;
 	actData ctime_cos=pfit->gamma_ctime_cos_coeffs[det]*ninv;
 	const actData *az_sin=pfit->gamma_az_sin_coeffs[det];
@@ -2216,7 +3710,7 @@ void polmap2tod(MAP *map, mbTOD *tod)
 	    mysin=az_sin[3]+aa*(az_sin[2]+aa*(az_sin[1]+aa*(az_sin[0])))+ctime_sin*j;
 	    mycos=az_cos[3]+aa*(az_cos[2]+aa*(az_cos[1]+aa*(az_cos[0])))+ctime_cos*j;
 
-	    int jj=tod->pixelization_saved[det][j]*npol;
+	    int jj=pix[j]*npol;
 	    tod->data[det][j]+=mymap[jj];
 	    tod->data[det][j]+=mymap[jj+1]*mycos;
 	    tod->data[det][j]+=mymap[jj+2]*mysin;
@@ -2227,6 +3721,7 @@ void polmap2tod(MAP *map, mbTOD *tod)
     case POL_QU:
 #pragma omp for
       for (int det=0;det<tod->ndet;det++) {
+	const int *pix=get_saved_pixelization(tod,det,pixbuf);
 	int row=tod->rows[det];
 	int col=tod->cols[det];
 	mbUncut *uncut=tod->uncuts[row][col];
@@ -2234,7 +3729,7 @@ void polmap2tod(MAP *map, mbTOD *tod)
 	  for (int j=uncut->indexFirst[region];j<uncut->indexLast[region];j++){
 	    actData mycos=cos7_pi(tod->twogamma_saved[det][j]);
 	    actData mysin=sin7_pi(tod->twogamma_saved[det][j]);
-	    int jj=tod->pixelization_saved[det][j]*npol;
+	    int jj=pix[j]*npol;
 	    tod->data[det][j]+=mymap[jj]*mycos;
 	    tod->data[det][j]+=mymap[jj+1]*mysin;
 	  }
@@ -2245,63 +3740,149 @@ void polmap2tod(MAP *map, mbTOD *tod)
       printf("Error - unsupported poltag in polmap2tod.\n");
       break;
     }
+    free(pixbuf);
   }
 }
 
+/*--------------------------------------------------------------------------------*/
+static void tod2polmap_pivoted(MAP *map, mbTOD *tod, int nthread)
+//tod2polmap with each thread owning the same pixel range, between the map's cached pivots, in
+//every polarization plane.  Samples come from the TOD's tile buckets, so there are no atomics.
+//Like the locked path, this projects the uncuts and ignores kept_data.
+{
+  int pols[MAX_NPOL];
+  int npol=0;
+  bool need_gamma=false;
+  for (int pol_ind=0;pol_ind<MAX_NPOL;pol_ind++)
+    if (map->pol_state[pol_ind]) {
+      pols[npol++]=pol_ind;
+      if (pol_ind>0)
+	need_gamma=true;
+    }
+  MapTileBuckets *buckets=get_tod_map_tile_buckets(map,tod,NULL,false,nthread);
+  const int *ipiv_proc=get_map_pivots(map,buckets,nthread);
+  long npix=map->npix;
+
+#pragma omp parallel num_threads(nthread) shared(map,tod,buckets,ipiv_proc,pols,npol,need_gamma,npix) default(none)
+  {
+    int myid=omp_get_thread_num();
+    int pmin=ipiv_proc[myid];
+    int pmax=ipiv_proc[myid+1];
+    long imin,imax;
+    get_pivot_sample_range(buckets,ipiv_proc,myid,&imin,&imax);
+    for (long ii=imin;ii<imax;ii++) {
+      int pix=buckets->pix[ii];
+      if ((pix<pmin)||(pix>=pmax))
+	continue;
+      int det=buckets->det[ii];
+      int j=buckets->samp[ii];
+      actData dat=tod->data[det][j];
+      actData mysin=0,mycos=0;
+      if (need_gamma) {
+	mysin=sin(tod->twogamma_saved[det][j]);
+	mycos=cos(tod->twogamma_saved[det][j]);
+      }
+      for (int k=0;k<npol;k++) {
+	actData fac=1;
+	switch(pols[k]) {
+	case 1: fac=mysin; break;         //Q
+	case 2: fac=mycos; break;         //U
+	case 3: fac=mycos*mycos; break;   //Q^2
+	case 4: fac=mycos*mysin; break;   //Q*U
+	case 5: fac=mysin*mysin; break;   //U^2
+	}
+	map->map[pix+k*npix]+=dat*fac;
+      }
+    }
+  }
+}
 /*--------------------------------------------------------------------------------*/
 void tod2polmap(MAP *map,mbTOD *tod)
 {
   assert(tod);
   assert(tod->data);
-  assert(tod->pixelization_saved);
+  assert((tod->pixelization_saved)||(tod->pixelization_packed));
   assert(tod->uncuts);
+  assert(map->tiles==NULL);  //polarized maps are dense only.
+
+  int nthread;
+#pragma omp parallel shared(nthread) default(none)
+#pragma omp single
+  nthread=omp_get_num_threads();
+  if ((nthread>1)&&(map_tile_buckets_fit(map,tod,NULL,false,nthread))) {
+    tod2polmap_pivoted(map,tod,nthread);
+    return;
+  }
+
   int cur_pol=0;
   //loop through possible polarization states and project the ones we find.
   for (int pol_ind=0;pol_ind<MAX_NPOL;pol_ind++)
     if (map->pol_state[pol_ind]) {
       if (pol_ind==0) {  //I 
-#pragma omp parallel for shared(pol_ind,map,tod,cur_pol)
+#pragma omp parallel shared(pol_ind,map,tod,cur_pol)
+	{
+	  int *pixbuf=(int *)malloc_retry(sizeof(int)*tod->ndata);
+#pragma omp for
 	for (int det=0;det<tod->ndet;det++) {
+	  const int *pix=get_saved_pixelization(tod,det,pixbuf);
 	  int row=tod->rows[det];
 	  int col=tod->cols[det];
 	  mbUncut *uncut=tod->uncuts[row][col];
 	  for (int region=0;region<uncut->nregions;region++) {
 	    for (int j=uncut->indexFirst[region];j<uncut->indexLast[region];j++)
 #pragma omp atomic
-	      map->map[tod->pixelization_saved[det][j]]+=tod->data[det][j];
+	      map->map[pix[j]]+=tod->data[det][j];
 	  }
+	}
+	  free(pixbuf);
 	}
 	cur_pol++;
       }
       if (pol_ind==1) {  //Q
 #pragma omp parallel shared(pol_ind,map,tod,cur_pol)
+	{
+	  int *pixbuf=(int *)malloc_retry(sizeof(int)*tod->ndata);
+#pragma omp for
         for (int det=0;det<tod->ndet;det++) {
+	  const int *pix=get_saved_pixelization(tod,det,pixbuf);
           int row=tod->rows[det];
           int col=tod->cols[det];
           mbUncut *uncut=tod->uncuts[row][col];
           for (int region=0;region<uncut->nregions;region++)
             for (int j=uncut->indexFirst[region];j<uncut->indexLast[region];j++)
 #pragma omp atomic
-	      map->map[tod->pixelization_saved[det][j]+cur_pol*map->npix]+=tod->data[det][j]*sin(tod->twogamma_saved[det][j]);
+	      map->map[pix[j]+cur_pol*map->npix]+=tod->data[det][j]*sin(tod->twogamma_saved[det][j]);
+	}
+	  free(pixbuf);
 	}
 	cur_pol++;
       }
       if (pol_ind==2) {  //U
 #pragma omp parallel shared(pol_ind,map,tod,cur_pol)
+	{
+	  int *pixbuf=(int *)malloc_retry(sizeof(int)*tod->ndata);
+#pragma omp for
         for (int det=0;det<tod->ndet;det++) {
+	  const int *pix=get_saved_pixelization(tod,det,pixbuf);
           int row=tod->rows[det];
           int col=tod->cols[det];
           mbUncut *uncut=tod->uncuts[row][col];
           for (int region=0;region<uncut->nregions;region++)
             for (int j=uncut->indexFirst[region];j<uncut->indexLast[region];j++)
 #pragma omp atomic
-	      map->map[tod->pixelization_saved[det][j]+cur_pol*map->npix]+=tod->data[det][j]*cos(tod->twogamma_saved[det][j]);
+	      map->map[pix[j]+cur_pol*map->npix]+=tod->data[det][j]*cos(tod->twogamma_saved[det][j]);
+	}
+	  free(pixbuf);
 	}
 	cur_pol++;
       }
       if (pol_ind==3) {  //Q^2
 #pragma omp parallel shared(pol_ind,map,tod,cur_pol)
+	{
+	  int *pixbuf=(int *)malloc_retry(sizeof(int)*tod->ndata);
+#pragma omp for
         for (int det=0;det<tod->ndet;det++) {
+	  const int *pix=get_saved_pixelization(tod,det,pixbuf);
           int row=tod->rows[det];
           int col=tod->cols[det];
           mbUncut *uncut=tod->uncuts[row][col];
@@ -2309,15 +3890,21 @@ void tod2polmap(MAP *map,mbTOD *tod)
             for (int j=uncut->indexFirst[region];j<uncut->indexLast[region];j++) {
 	      actData mycos=cos(tod->twogamma_saved[det][j]);
 #pragma omp atomic
-	      map->map[tod->pixelization_saved[det][j]+cur_pol*map->npix]+=tod->data[det][j]*mycos*mycos;
+	      map->map[pix[j]+cur_pol*map->npix]+=tod->data[det][j]*mycos*mycos;
 	    }
+	}
+	  free(pixbuf);
 	}
 	cur_pol++;
       }
 
       if (pol_ind==4) {  //Q*U
 #pragma omp parallel shared(pol_ind,map,tod,cur_pol)
+	{
+	  int *pixbuf=(int *)malloc_retry(sizeof(int)*tod->ndata);
+#pragma omp for
         for (int det=0;det<tod->ndet;det++) {
+	  const int *pix=get_saved_pixelization(tod,det,pixbuf);
           int row=tod->rows[det];
           int col=tod->cols[det];
           mbUncut *uncut=tod->uncuts[row][col];
@@ -2326,15 +3913,21 @@ void tod2polmap(MAP *map,mbTOD *tod)
 	      actData mycos=cos(tod->twogamma_saved[det][j]);
 	      actData mysin=sin(tod->twogamma_saved[det][j]);
 #pragma omp atomic
-	      map->map[tod->pixelization_saved[det][j]+cur_pol*map->npix]+=tod->data[det][j]*mycos*mysin;
+	      map->map[pix[j]+cur_pol*map->npix]+=tod->data[det][j]*mycos*mysin;
 	    }
+	}
+	  free(pixbuf);
 	}
 	cur_pol++;
       }
       
       if (pol_ind==5) {  //U^2
 #pragma omp parallel shared(pol_ind,map,tod,cur_pol)
+	{
+	  int *pixbuf=(int *)malloc_retry(sizeof(int)*tod->ndata);
+#pragma omp for
         for (int det=0;det<tod->ndet;det++) {
+	  const int *pix=get_saved_pixelization(tod,det,pixbuf);
           int row=tod->rows[det];
           int col=tod->cols[det];
           mbUncut *uncut=tod->uncuts[row][col];
@@ -2342,8 +3935,10 @@ void tod2polmap(MAP *map,mbTOD *tod)
             for (int j=uncut->indexFirst[region];j<uncut->indexLast[region];j++) {
 	      actData mysin=sin(tod->twogamma_saved[det][j]);
 #pragma omp atomic
-	      map->map[tod->pixelization_saved[det][j]+cur_pol*map->npix]+=tod->data[det][j]*mysin*mysin;
+	      map->map[pix[j]+cur_pol*map->npix]+=tod->data[det][j]*mysin*mysin;
 	    }
+	}
+	  free(pixbuf);
 	}
 	cur_pol++;
       }
@@ -2369,8 +3964,9 @@ void tod2polmap_copy(MAP *map,mbTOD *tod)
 {
   assert(tod);
   assert(tod->data);
-  assert(tod->pixelization_saved);
+  assert((tod->pixelization_saved)||(tod->pixelization_packed));
   assert(tod->uncuts);
+  assert(map->tiles==NULL);
 
   const int npol=get_npol_in_map(map);
   const int poltag=get_map_poltag(map);
@@ -2388,22 +3984,25 @@ void tod2polmap_copy(MAP *map,mbTOD *tod)
     actData *mymap=vector(npol*map->npix);
     actData ninv=1.0/tod->ndata;
     memset(mymap,0,npol*map->npix*sizeof(actData));
+    int *pixbuf=(int *)malloc_retry(sizeof(int)*tod->ndata);
     switch(poltag){
     case POL_I: 
 #pragma omp for
       for (int det=0;det<tod->ndet;det++) {
+	const int *pix=get_saved_pixelization(tod,det,pixbuf);
 	int row=tod->rows[det];
 	int col=tod->cols[det];
 	mbUncut *uncut=tod->uncuts[row][col];
 	for (int region=0;region<uncut->nregions;region++) {
 	  for (int j=uncut->indexFirst[region];j<uncut->indexLast[region];j++)
-	    mymap[tod->pixelization_saved[det][j]]+=tod->data[det][j];	  
+	    mymap[pix[j]]+=tod->data[det][j];	  
 	}
       }
       break;
     case POL_IQU:
 #pragma omp for
       for (int det=0;det<tod->ndet;det++) {
+	const int *pix=get_saved_pixelization(tod,det,pixbuf);
 
 	actData ctime_sin=pfit->gamma_ctime_sin_coeffs[det]*ninv;
 	actData ctime_cos=pfit->gamma_ctime_cos_coeffs[det]*ninv;
@@ -2421,7 +4020,7 @@ void tod2polmap_copy(MAP *map,mbTOD *tod)
 	    mysin=az_sin[3]+aa*(az_sin[2]+aa*(az_sin[1]+aa*(az_sin[0])))+ctime_sin*j;
 	    mycos=az_cos[3]+aa*(az_cos[2]+aa*(az_cos[1]+aa*(az_cos[0])))+ctime_cos*j;
 
-	    int jj=tod->pixelization_saved[det][j]*npol;
+	    int jj=pix[j]*npol;
 	    mymap[jj]+=tod->data[det][j];
 	    mymap[jj+1]+=tod->data[det][j]*mycos;
 	    mymap[jj+2]+=tod->data[det][j]*mysin;
@@ -2434,6 +4033,7 @@ void tod2polmap_copy(MAP *map,mbTOD *tod)
     case POL_QU:
 #pragma omp for
       for (int det=0;det<tod->ndet;det++) {
+	const int *pix=get_saved_pixelization(tod,det,pixbuf);
 	int row=tod->rows[det];
 	int col=tod->cols[det];
 	mbUncut *uncut=tod->uncuts[row][col];
@@ -2442,13 +4042,13 @@ void tod2polmap_copy(MAP *map,mbTOD *tod)
 #if 1
 	    actData mycos=cos7_pi(tod->twogamma_saved[det][j]);
 	    actData mysin=sin7_pi(tod->twogamma_saved[det][j]);
-	    int jj=tod->pixelization_saved[det][j]*npol;
+	    int jj=pix[j]*npol;
 	    mymap[jj]+=tod->data[det][j]*mycos;
 	    mymap[jj+1]+=tod->data[det][j]*mysin;
 	    
 #else
-	    mymap[tod->pixelization_saved[det][j]]+=tod->data[det][j]*cos(tod->twogamma_saved[det][j]);
-	    mymap[tod->pixelization_saved[det][j]+npix]+=tod->data[det][j]*sin(tod->twogamma_saved[det][j]);
+	    mymap[pix[j]]+=tod->data[det][j]*cos(tod->twogamma_saved[det][j]);
+	    mymap[pix[j]+npix]+=tod->data[det][j]*sin(tod->twogamma_saved[det][j]);
 #endif
 	  }
 	}
@@ -2458,6 +4058,7 @@ void tod2polmap_copy(MAP *map,mbTOD *tod)
     case POL_IQU_PRECON:
 #pragma omp for
       for (int det=0;det<tod->ndet;det++) {
+	const int *pix=get_saved_pixelization(tod,det,pixbuf);
 	actData ctime_sin=pfit->gamma_ctime_sin_coeffs[det]*ninv;
 	actData ctime_cos=pfit->gamma_ctime_cos_coeffs[det]*ninv;
 	const actData *az_sin=pfit->gamma_az_sin_coeffs[det];
@@ -2477,7 +4078,7 @@ void tod2polmap_copy(MAP *map,mbTOD *tod)
 	    actData mycos=cos7_pi(tod->twogamma_saved[det][j]);
 	    actData mysin=sin7_pi(tod->twogamma_saved[det][j]);
 
-	    int jj=tod->pixelization_saved[det][j]*npol;
+	    int jj=pix[j]*npol;
 	    
 	    mymap[jj]+=tod->data[det][j];
 	    mymap[jj+1]+=tod->data[det][j]*mycos;
@@ -2525,6 +4126,7 @@ void tod2polmap_copy(MAP *map,mbTOD *tod)
     }    
     
     free(mymap);
+    free(pixbuf);
   }
 }
 /*--------------------------------------------------------------------------------*/
@@ -2559,6 +4161,15 @@ actData tod_times_map(const MAP *map, const mbTOD *tod, PARAMS *params)
     
   }
 #endif
+
+  int nproc;
+#pragma omp parallel shared(nproc) default(none)
+#pragma omp single
+  nproc=omp_get_num_threads();
+  //the plain loop has no write conflicts, so only go by tiles if tod2map already made the buckets.
+  if ((nproc>1)&&(tod_has_map_tile_buckets(map,tod,params,true,nproc)))
+    return tod_times_map_tiled(map,(mbTOD *)tod,params);  //only reads the cached buckets
+
   actData tot=0;
 #pragma omp parallel shared(tod,map,params) reduction(+:tot) default(none)
   { 
@@ -2842,6 +4453,14 @@ void map2det(const MAP *map, const mbTOD *tod, actData *vec, int *ind, int det,
     break;
   }
 #else
+  if (map->tiles) {
+    for (int j=0;j<tod->ndata;j++) {
+      const actData *tile=map->tiles[ind[j]/NK_MAP_TILE_LEN];
+      if (tile)
+	vec[j]+=tile[ind[j]%NK_MAP_TILE_LEN];
+    }
+    return;
+  }
   for (int j=0;j<tod->ndata;j++) {
     vec[j]+=map->map[ind[j]];
   }
@@ -2856,6 +4475,14 @@ void map2det_scaled(const MAP *map, const mbTOD *tod, actData *vec, actData scal
   //get_pointing_vec(tod,map,det,ind);
   get_pointing_vec_new(tod,map,det,ind,scratch);
   
+  if (map->tiles) {
+    for (int j=0;j<tod->ndata;j++) {
+      const actData *tile=map->tiles[ind[j]/NK_MAP_TILE_LEN];
+      if (tile)
+	vec[j]+=tile[ind[j]%NK_MAP_TILE_LEN]*scale_fac;
+    }
+    return;
+  }
   for (int j=0;j<tod->ndata;j++) {
     vec[j]+=map->map[ind[j]]*scale_fac;
   }
@@ -2891,20 +4518,12 @@ long is_tod_inbounds(const MAP *map, mbTOD *tod,const PARAMS *params)
 /*--------------------------------------------------------------------------------*/
 void save_tod_projection(const MAP *map, mbTOD *tod,const PARAMS *params)
 {
+  if (load_pixelization_cache(tod,map,"fit"))
+    return;
   int **proj=imatrix(tod->ndet,tod->ndata);
-#pragma omp parallel shared(tod,map,proj) default(none) 
-  {
-    PointingFitScratch *scratch=allocate_pointing_fit_scratch(tod);
-    //int *ind=(int *)malloc_retry(sizeof(int)*tod->ndata);
-#pragma omp for schedule(dynamic,1)
-    for (int i=0;i<tod->ndet;i++) {
-      if (!mbCutsIsAlwaysCut(tod->cuts,tod->rows[i],tod->cols[i])) {
-	get_pointing_vec_new(tod,map,i,proj[i],scratch);	
-      }
-      
-    }
-  }
+  get_all_pointing_vecs(tod,map,NULL,proj);
   tod->pixelization_saved=proj;
+  save_pixelization_cache(tod,map,"fit");
 }
 
 /*--------------------------------------------------------------------------------*/
@@ -3301,7 +4920,15 @@ void free_tod_storage(mbTOD *tod)
     return;
   }
   assert(tod->have_data==1);
-  free_matrix(tod->data);
+  if (tod->data_map) {
+    munmap(tod->data_map,tod->data_map_len);
+    free(tod->data);
+    tod->data_map=NULL;
+    tod->data_map_len=0;
+  }
+  else
+    free_matrix(tod->data);
+  free_tod_map_tile_buckets(tod);
   tod->have_data=0;
   tod->data=NULL;
 }
@@ -3311,8 +4938,150 @@ void rotate_matrix(actData **mat1, actData **mat2, bool do_transpose)
   
 }
 /*--------------------------------------------------------------------------------*/
-void mapset2mapset(MAPvec *maps, TODvec *tods, PARAMS *params)
+//data buffers handed to TODs running as tasks, one per team, kept between iterations.
+static int tod_pool_nteam=0;
+static long tod_pool_len=0;
+static int tod_pool_ndet=0;
+static actData **tod_pool_buf=NULL;
+static actData ***tod_pool_rows=NULL;
+
+void free_tod_task_pool()
+{
+  for (int i=0;i<tod_pool_nteam;i++) {
+    free(tod_pool_buf[i]);
+    free(tod_pool_rows[i]);
+  }
+  free(tod_pool_buf);
+  free(tod_pool_rows);
+  tod_pool_buf=NULL;
+  tod_pool_rows=NULL;
+  tod_pool_nteam=0;
+  tod_pool_len=0;
+  tod_pool_ndet=0;
+}
+/*--------------------------------------------------------------------------------*/
+static void reserve_tod_task_pool(int nteam, long len, int ndet)
+{
+  if ((nteam<=tod_pool_nteam)&&(len<=tod_pool_len)&&(ndet<=tod_pool_ndet))
+    return;
+  if (tod_pool_nteam>nteam)
+    nteam=tod_pool_nteam;
+  if (tod_pool_len>len)
+    len=tod_pool_len;
+  if (tod_pool_ndet>ndet)
+    ndet=tod_pool_ndet;
+  free_tod_task_pool();
+  tod_pool_buf=(actData **)malloc_retry(sizeof(actData *)*nteam);
+  tod_pool_rows=(actData ***)malloc_retry(sizeof(actData **)*nteam);
+  for (int i=0;i<nteam;i++) {
+    tod_pool_buf[i]=vector(len);
+    tod_pool_rows[i]=(actData **)malloc_retry(sizeof(actData *)*ndet);
+  }
+  tod_pool_nteam=nteam;
+  tod_pool_len=len;
+  tod_pool_ndet=ndet;
+}
+/*--------------------------------------------------------------------------------*/
+static bool *run_small_tods_as_tasks(MAPvec *maps, MAPvec *maps_out, TODvec *tods, PARAMS *params)
+//TODs too narrow to keep every thread busy on their detector loops and FFTs get run several
+//at a time, each on its own team of threads with its own accumulation maps and a data buffer
+//from the pool.  Teams are sized so each thread still has NK_TASK_DETS_PER_THREAD detectors.
+//Returns which TODs were done, the rest are left for the caller to run with all threads.
+{
+  int nthread=omp_get_max_threads();
+  bool *done=(bool *)calloc(tods->ntod>0 ? tods->ntod : 1,sizeof(bool));
+  tod_cost_ind *small=(tod_cost_ind *)malloc_retry(sizeof(tod_cost_ind)*(tods->ntod>0 ? tods->ntod : 1));
+  int nsmall=0;
+  long ndet_tot=0,maxlen=0;
+  int maxdet=0;
+  for (int i=0;i<tods->ntod;i++) {
+    mbTOD *tod=&(tods->tods[i]);
+    if (tod->ndet<nthread*NK_TASK_DETS_PER_THREAD) {
+      small[nsmall].ind=i;
+      small[nsmall].cost=(tods->tod_cost ? tods->tod_cost[i] : 0);
+      if (small[nsmall].cost<=0)
+	small[nsmall].cost=(actData)tod->ndet*tod->ndata;
+      nsmall++;
+      ndet_tot+=tod->ndet;
+      if ((long)tod->ndet*tod->ndata>maxlen)
+	maxlen=(long)tod->ndet*tod->ndata;
+      if (tod->ndet>maxdet)
+	maxdet=tod->ndet;
+    }
+  }
+  int team=1;
+  if (nsmall>0)
+    team=(ndet_tot/nsmall)/NK_TASK_DETS_PER_THREAD;
+  if (team<1)
+    team=1;
+  if (team>nthread)
+    team=nthread;
+  int nteam=nthread/team;
+  if (nteam>nsmall)
+    nteam=nsmall;
+  if (nteam<2) {
+    free(small);
+    return done;
+  }
+
+  //biggest first, so the dynamic schedule doesn't end on a long one.
+  qsort(small,nsmall,sizeof(tod_cost_ind),compare_tod_costs);
+  reserve_tod_task_pool(nteam,maxlen,maxdet);
+  MAPvec **acc=(MAPvec **)malloc_retry(sizeof(MAPvec *)*nteam);
+  for (int i=0;i<nteam;i++) {
+    acc[i]=make_mapset_copy(maps_out);
+    clear_mapset(acc[i]);
+  }
+
+  int old_levels=omp_get_max_active_levels();
+  omp_set_max_active_levels(2);
+#pragma omp parallel for num_threads(nteam) schedule(dynamic,1) shared(maps,tods,params,small,nsmall,acc,team,done,tod_pool_buf,tod_pool_rows) default(none)
+  for (int k=0;k<nsmall;k++) {
+    int me=omp_get_thread_num();
+    omp_set_num_threads(team);  //size of the teams the detector loops below will get.
+    pca_time tt;
+    tick(&tt);
+    int i=small[k].ind;
+    mbTOD *mytod=&(tods->tods[i]);
+    assert(!mytod->have_data);
+    for (int j=0;j<mytod->ndet;j++)
+      tod_pool_rows[me][j]=tod_pool_buf[me]+(long)j*mytod->ndata;
+    mytod->data=tod_pool_rows[me];
+    mytod->have_data=1;
+    mapset2tod(maps,mytod,params);
+    if (!params->no_noise)
+      filter_data(mytod);
+    tod2mapset(acc[me],mytod,params);
+    free_tod_map_tile_buckets(mytod);
+    mytod->data=NULL;
+    mytod->have_data=0;
+    done[i]=true;
+    if (tods->tod_time)
+      tods->tod_time[i]=tocksilent(&tt);
+  }
+  //the teams' extra threads only filter here, so don't let them sit on noise scratch until exit.
+#pragma omp parallel num_threads(nteam) shared(team) default(none)
+#pragma omp parallel num_threads(team) default(none)
+  if (omp_get_thread_num()>0)
+    free_noise_workspace();
+  omp_set_max_active_levels(old_levels);
+
+  for (int i=0;i<nteam;i++) {
+    mapset_axpy(maps_out,acc[i],1.0);
+    destroy_mapset(acc[i]);
+  }
+  free(acc);
+  free(small);
+  return done;
+}
+/*--------------------------------------------------------------------------------*/
+actData mapset2mapset_dot(MAPvec *maps, TODvec *tods, PARAMS *params, MAPvec *dotwith)
+//replace maps with A^T N^-1 A maps.  If dotwith is set, return dotwith.(A^T N^-1 A maps),
+//summed in the same reduction as the maps.
 {
+#ifdef HAVE_MPI
+  mpi_fetch_mapset_ghosts(maps);
+#endif
   MAPvec *maps_copy=make_mapset_copy(maps);
   clear_mapset(maps_copy);
 #ifdef  MAPS_PREALLOC 
@@ -3329,8 +5098,18 @@ void mapset2mapset(MAPvec *maps, TODvec *tods, PARAMS *params)
     bigmaps[myid]=make_mapset_copy(maps);
     clear_mapset(bigmaps[myid]);
   }
+#endif
+  bool *done=NULL;
+#ifndef MAPS_PREALLOC
+  if ((params->tod_tasks)&&(!tods->stream))  //tasks would need many streamed TODs in memory at once
+    done=run_small_tods_as_tasks(maps,maps_copy,tods,params);
 #endif
   for (int i=0;i<tods->ntod;i++) {
+    if ((done)&&(done[i]))
+      continue;
+    stream_tod_in(tods,i);
+    pca_time tt;
+    tick(&tt);
     mbTOD *mytod=&(tods->tods[i]);
     allocate_tod_storage(mytod);
     mapset2tod(maps,mytod,params);
@@ -3342,7 +5121,12 @@ void mapset2mapset(MAPvec *maps, TODvec *tods, PARAMS *params)
     tod2mapset(maps_copy,mytod,params);
 #endif
     free_tod_storage(mytod);    
+    if (tods->tod_time)
+      tods->tod_time[i]=tocksilent(&tt);
+    stream_tod_out(tods,i);
   }
+  if (done)
+    free(done);
 #ifdef MAPS_PREALLOC
   for (int i=0;i<maps->nmap;i++)
     setup_omp_locks(maps_copy->maps[i]);
@@ -3355,11 +5139,22 @@ void mapset2mapset(MAPvec *maps, TODvec *tods, PARAMS *params)
   }
   free(bigmaps);
 #endif
-  copy_mapset2mapset(maps,maps_copy);
-  destroy_mapset(maps_copy);
 #ifdef HAVE_MPI
-  mpi_reduce_mapset(maps);
+  //reduce straight out of the accumulation copy - no temporary or extra memcpy.
+  actData dot=0;
+  int ierr=mpi_reduce_mapset_into(maps,maps_copy,params->reduce_bbox,params->mpi_chunk,dotwith,&dot);
+  assert(ierr==0);
+#else
+  copy_mapset2mapset(maps,maps_copy);
+  actData dot=(dotwith ? mapset_times_mapset(dotwith,maps) : 0);
 #endif
+  destroy_mapset(maps_copy);
+  return dot;
+}
+/*--------------------------------------------------------------------------------*/
+void mapset2mapset(MAPvec *maps, TODvec *tods, PARAMS *params)
+{
+  mapset2mapset_dot(maps,tods,params,NULL);
 }
 /*--------------------------------------------------------------------------------*/
 void detrend_data(mbTOD *tod)
@@ -3511,12 +5306,20 @@ int get_weights(MAPvec *maps, TODvec *tods, PARAMS *params)
 {
   clear_mapset(maps);
   for (int i=0;i<tods->ntod;i++) {
+    stream_tod_in(tods,i);
     mbTOD *mytod=&(tods->tods[i]);
     allocate_tod_storage(mytod);
     assign_tod_value(mytod,1.0);
     tod2mapset(maps,mytod,params); 
     free_tod_storage(mytod);
-  }
+    stream_tod_out(tods,i);
+  }
+  //the weights are my hit counts until they're reduced, so take the projection pivots from
+  //them here.  run_PCG hands them on to the maps it iterates on.
+  if (omp_get_max_threads()>1)
+    for (int i=0;i<maps->nmap;i++)
+      if (!maps->maps[i]->tiles)
+	set_map_pivots_from_hit_map(maps->maps[i],maps->maps[i]);
 #ifdef HAVE_MPI
   mpi_reduce_mapset(maps);
 #endif
@@ -3532,8 +5335,12 @@ int make_initial_mapset(MAPvec *maps, TODvec *tods,PARAMS *params)
 
   bool is_blank=is_mapset_blank(maps);
   MAPvec *maps_in;
-  if (!is_blank)
+  if (!is_blank) {
     maps_in=make_mapset_copy(maps);
+#ifdef HAVE_MPI
+    mpi_fetch_mapset_ghosts(maps_in);
+#endif
+  }
 
 
   clear_mapset(maps);
@@ -3554,6 +5361,7 @@ int make_initial_mapset(MAPvec *maps, TODvec *tods,PARAMS *params)
   else
     mprintf(stdout,"maps are not blank inside initial mapset.\n");
   for (int i=0;i<tods->ntod;i++) {
+    stream_tod_in(tods,i);
     mbTOD *mytod=&(tods->tods[i]);
     mprintf(stdout,"working on %d %s\n",i,mytod->dirfile);
     //keep_1_det(mytod,10,10); //make sure to get rid of this!!!    
@@ -3586,9 +5394,11 @@ int make_initial_mapset(MAPvec *maps, TODvec *tods,PARAMS *params)
 	allocate_tod_storage(mytod);
 	assign_tod_value(mytod,0.0);
       }
-      else
+      else {
 	read_tod_data(mytod);
-
+	if (i+1<tods->ntod)
+	  prefetch_dirfile_tod_data(&(tods->tods[i+1]));
+      }
     }
     
     
@@ -3677,6 +5487,7 @@ int make_initial_mapset(MAPvec *maps, TODvec *tods,PARAMS *params)
     tod2mapset(maps,mytod,params); 
     mprintf(stdout,"finished.\n");
     free_tod_storage(mytod);
+    stream_tod_out(tods,i);
   }
 
     
@@ -3699,6 +5510,19 @@ int make_initial_mapset(MAPvec *maps, TODvec *tods,PARAMS *params)
 void map_axpy(MAP *y, MAP *x, actData a)
 {
   assert(x->npix==y->npix);
+  if (x->tiles) {
+    assert(y->tiles);
+    for (long t=0;t<x->ntile;t++)
+      if (x->tiles[t])
+	get_map_tile(y,t);
+#pragma omp parallel for shared(x,y,a) schedule(dynamic,4) default(none)
+    for (long t=0;t<x->ntile;t++)
+      if (x->tiles[t])
+	for (int i=0;i<NK_MAP_TILE_LEN;i++)
+	  y->tiles[t][i]=y->tiles[t][i]+x->tiles[t][i]*a;
+    return;
+  }
+  assert(!y->tiles);
 #pragma omp parallel for shared(x,y,a) default(none)  
   for (int i=0;i<x->npix;i++) {
     y->map[i]=y->map[i]+x->map[i]*a;    
@@ -3716,6 +5540,15 @@ actData map_times_map(MAP *x, MAP *y)
 {
   assert(x->npix==y->npix);
   double tot=0;
+  if (x->tiles) {
+    assert(y->tiles);
+#pragma omp parallel for shared(x,y) reduction(+:tot) schedule(dynamic,4) default(none)
+    for (long t=0;t<x->ntile;t++)
+      if ((x->tiles[t])&&(y->tiles[t]))
+	for (int i=0;i<NK_MAP_TILE_LEN;i++)
+	  tot += x->tiles[t][i]*y->tiles[t][i];
+    return (actData)tot;
+  }
 #pragma omp parallel for shared(x,y) reduction(+:tot) default(none)
   for (int i=0;i<x->npix;i++)
     tot += x->map[i]*y->map[i];
@@ -3723,19 +5556,42 @@ actData map_times_map(MAP *x, MAP *y)
   return (actData)tot;
 }
 /*--------------------------------------------------------------------------------*/
+static actData sum_over_map_owners(const MAPvec *maps, actData tot)
+//processes only hold their own part of distributed maps, so dot products of them need summing.
+{
+#ifdef HAVE_MPI
+  for (int i=0;i<maps->nmap;i++)
+    if (maps->maps[i]->comm) {
+      MPI_Allreduce(MPI_IN_PLACE,&tot,1,MPI_NType,MPI_SUM,MPI_COMM_WORLD);
+      break;
+    }
+#endif
+  return tot;
+}
+/*--------------------------------------------------------------------------------*/
 actData mapset_times_mapset(MAPvec *x, MAPvec *y)
 {
   assert(x->nmap==y->nmap);
   actData tot=0;
   for (int i=0;i<x->nmap;i++)
     tot += map_times_map(x->maps[i],y->maps[i]);
-  return tot;
+  return sum_over_map_owners(x,tot);
 }
 /*--------------------------------------------------------------------------------*/
 void copy_map2map(MAP *map2, MAP *map)
 {
   assert(map->npix==map2->npix);
   assert(map->npix>0);
+  if (map->tiles) {
+    assert(map2->tiles);
+    for (long t=0;t<map->ntile;t++)
+      if (map->tiles[t])
+	memcpy(get_map_tile(map2,t),map->tiles[t],sizeof(actData)*NK_MAP_TILE_LEN);
+      else
+	if (map2->tiles[t])
+	  memset(map2->tiles[t],0,sizeof(actData)*NK_MAP_TILE_LEN);
+    return;
+  }
   memcpy(map2->map,map->map,sizeof(actData)*map->npix*get_npol_in_map(map));
 }
 /*--------------------------------------------------------------------------------*/
@@ -3747,51 +5603,173 @@ void copy_mapset2mapset(MAPvec *map2, MAPvec *map)
   }
 }
 /*--------------------------------------------------------------------------------*/
-actData PCGstep(MAPvec *r, MAPvec *p, MAPvec *x, TODvec *tods, MAPvec *wts, PARAMS *params)
+PCGWork *allocate_pcg_work(MAPvec *r)
+{
+  PCGWork *work=(PCGWork *)calloc(1,sizeof(PCGWork));
+  work->ap=make_mapset_copy(r);
+  work->mr=make_mapset_copy(r);
+  work->have_mr=false;
+  return work;
+}
+/*--------------------------------------------------------------------------------*/
+void destroy_pcg_work(PCGWork *work)
+{
+  if (!work)
+    return;
+  destroy_mapset(work->ap);
+  destroy_mapset(work->mr);
+  free(work);
+}
+/*--------------------------------------------------------------------------------*/
+static actData pcg_update_map_sparse(MAP *x, MAP *r, const MAP *p, const MAP *ap, MAP *mr, const MAP *wt, actData alpha)
+//pcg_update_map for sparse maps.  Missing tiles are zero, and a tile only gets allocated
+//if something nonzero can land in it.  Sparse maps are temperature only, so there are no
+//polarization planes to carry along.
+{
+  assert((x->tiles)&&(p->tiles)&&(ap->tiles)&&(mr->tiles));
+  assert(get_npol_in_map(r)<=1);
+  assert((wt==NULL)||(wt->tiles));
+  for (long t=0;t<r->ntile;t++) {
+    if (p->tiles[t])
+      get_map_tile(x,t);
+    if (ap->tiles[t])
+      get_map_tile(r,t);
+    if (r->tiles[t])
+      get_map_tile(mr,t);
+    else
+      if (mr->tiles[t])
+	memset(mr->tiles[t],0,sizeof(actData)*NK_MAP_TILE_LEN);
+  }
+  actData malpha=-alpha;
+  double tot=0;
+#pragma omp parallel for shared(x,r,p,ap,mr,wt,alpha,malpha) reduction(+:tot) schedule(dynamic,4) default(none)
+  for (long t=0;t<r->ntile;t++) {
+    if (p->tiles[t])
+      for (int i=0;i<NK_MAP_TILE_LEN;i++)
+	x->tiles[t][i]=x->tiles[t][i]+p->tiles[t][i]*alpha;
+    actData *rr=r->tiles[t];
+    if (!rr)
+      continue;
+    const actData *aa=ap->tiles[t];
+    const actData *ww=(wt ? wt->tiles[t] : NULL);
+    actData *mm=mr->tiles[t];
+    for (int i=0;i<NK_MAP_TILE_LEN;i++) {
+      if (aa)
+	rr[i]=rr[i]+aa[i]*malpha;
+      actData m=rr[i];
+      if (ww)
+	if (ww[i]>0)
+	  m/=ww[i];
+      mm[i]=m;
+      tot += rr[i]*m;
+    }
+  }
+  return (actData)tot;
+}
+/*--------------------------------------------------------------------------------*/
+static actData pcg_update_map(MAP *x, MAP *r, const MAP *p, const MAP *ap, MAP *mr, const MAP *wt, actData alpha)
+//x+=alpha p, r-=alpha ap, mr=M^-1 r and r.mr in a single sweep.  wt is NULL if this
+//map isn't preconditioned.  Each pixel gets the same arithmetic as map_axpy/apply_preconditioner/
+//map_times_map, so on one thread the step matches one built from them bit for bit, polarization
+//planes included (test_pcg_step).  With more threads the sum is only as reproducible as theirs.
+{
+  assert(x->npix==r->npix);
+  assert(p->npix==r->npix);
+  assert(ap->npix==r->npix);
+  assert(mr->npix==r->npix);
+  if (r->tiles)
+    return pcg_update_map_sparse(x,r,p,ap,mr,wt,alpha);
+  actData malpha=-alpha;
+  double tot=0;
+#pragma omp parallel for shared(x,r,p,ap,mr,wt,alpha,malpha) reduction(+:tot) default(none)
+  for (int i=0;i<r->npix;i++) {
+    x->map[i]=x->map[i]+p->map[i]*alpha;
+    actData rr=r->map[i]+ap->map[i]*malpha;
+    actData m=rr;
+    if (wt)
+      if (wt->map[i]>0)
+	m/=wt->map[i];
+    r->map[i]=rr;
+    mr->map[i]=m;
+    tot += rr*m;
+  }
+  //polarization planes past npix are untouched by the axpys and the preconditioner.
+  long ntot=r->npix*get_npol_in_map(r);
+  if (ntot>r->npix)
+    memcpy(mr->map+r->npix,r->map+r->npix,sizeof(actData)*(ntot-r->npix));
+  return (actData)tot;
+}
+/*--------------------------------------------------------------------------------*/
+static void pcg_update_direction(MAP *p, const MAP *mr, actData beta)
+//p=mr+beta p
+{
+  assert(p->npix==mr->npix);
+  if (p->tiles) {
+    assert(mr->tiles);
+    for (long t=0;t<p->ntile;t++)
+      if (mr->tiles[t])
+	get_map_tile(p,t);
+#pragma omp parallel for shared(p,mr,beta) schedule(dynamic,4) default(none)
+    for (long t=0;t<p->ntile;t++)
+      if (p->tiles[t]) {
+	const actData *mm=mr->tiles[t];
+	for (int i=0;i<NK_MAP_TILE_LEN;i++)
+	  p->tiles[t][i]=(mm ? mm[i] : 0)+p->tiles[t][i]*beta;
+      }
+    return;
+  }
+#pragma omp parallel for shared(p,mr,beta) default(none)
+  for (int i=0;i<p->npix;i++)
+    p->map[i]=mr->map[i]+p->map[i]*beta;
+  long ntot=p->npix*get_npol_in_map(p);
+  if (ntot>p->npix)
+    memcpy(p->map+p->npix,mr->map+p->npix,sizeof(actData)*(ntot-p->npix));
+}
+/*--------------------------------------------------------------------------------*/
+actData PCGstep_work(MAPvec *r, MAPvec *p, MAPvec *x, TODvec *tods, MAPvec *wts, PARAMS *params, PCGWork *work)
+//one PCG step with persistent work vectors.  Returns r.M^-1 r at the start of the step,
+//same as PCGstep always has.
 {
   pca_time tt;
   tick(&tt);
-  MAPvec *ap=make_mapset_copy(p);
-  MAPvec *mr=make_mapset_copy(r);
-  mapset2mapset(ap,tods,params);
-  apply_preconditioner(mr,wts,params);
-
-  actData rsqr=mapset_times_mapset(r,mr);
-  destroy_mapset(mr);
-  actData pap=mapset_times_mapset(p,ap);
+  assert(r->nmap==p->nmap);
+  assert(x->nmap==p->nmap);
+
+  copy_mapset2mapset(work->ap,p);
+  actData pap=mapset2mapset_dot(work->ap,tods,params,p);
+  if (!work->have_mr) {
+    copy_mapset2mapset(work->mr,r);
+    apply_preconditioner(work->mr,wts,params);
+    work->rmr=mapset_times_mapset(r,work->mr);
+    work->have_mr=true;
+  }
+  actData rsqr=work->rmr;
   actData alpha_k=rsqr/pap;
-  mapset_axpy(x,p,alpha_k);
-  MAPvec *rk=make_mapset_copy(r);
-  mapset_axpy(rk,ap,-alpha_k);  
-  destroy_mapset(ap);
-
-  MAPvec *mrk=make_mapset_copy(rk);
-  apply_preconditioner(mrk,wts,params);
-
-  actData beta_k=mapset_times_mapset(rk,mrk)/rsqr;
-  MAPvec *pk=make_mapset_copy(mrk);
-  mapset_axpy(pk,p,beta_k);
-
-  //int mpi_broadcast_mapset(MAPvec *maps,master)
-  
-  copy_mapset2mapset(r,rk);
-  copy_mapset2mapset(p,pk);
-  //MPI_Barrier(MPI_COMM_WORLD);
-  //mpi_broadcast_mapset(r,0);
-  //mpi_broadcast_mapset(x,0);
-  //mpi_broadcast_mapset(p,0);
-
 
+  actData rmr=0;
+  for (int i=0;i<r->nmap;i++) {
+    const MAP *wt=NULL;
+    if ((i==0)&&(params->precondition))
+      wt=wts->maps[0];
+    rmr += pcg_update_map(x->maps[i],r->maps[i],p->maps[i],work->ap->maps[i],work->mr->maps[i],wt,alpha_k);
+  }
+  rmr=sum_over_map_owners(r,rmr);
+  actData beta_k=rmr/rsqr;
+  for (int i=0;i<p->nmap;i++)
+    pcg_update_direction(p->maps[i],work->mr->maps[i],beta_k);
+  work->rmr=rmr;
 
-  destroy_mapset(rk);
-  destroy_mapset(pk);
-  destroy_mapset(mrk);
-  
-  //printf("Iteration took %8.3f seconds.\n",tocksilent(&tt));
   mprintf(stdout,"Iteration took %8.3f seconds.\n",tocksilent(&tt));
-  
+
+  return rsqr;
+}
+/*--------------------------------------------------------------------------------*/
+actData PCGstep(MAPvec *r, MAPvec *p, MAPvec *x, TODvec *tods, MAPvec *wts, PARAMS *params)
+{
+  PCGWork *work=allocate_pcg_work(r);
+  actData rsqr=PCGstep_work(r,p,x,tods,wts,params,work);
+  destroy_pcg_work(work);
   return rsqr;
-  
 }
 /*--------------------------------------------------------------------------------*/
 actData PCGstep_noprecon(MAPvec *r, MAPvec *p, MAPvec *x, TODvec *tods, MAPvec *wts, PARAMS *params)
@@ -3847,6 +5825,16 @@ void apply_preconditioner( MAPvec *maps,MAPvec *weights,PARAMS *params)
   if (params->precondition) {
     MAP *map=maps->maps[0];
     MAP *wt=weights->maps[0];
+    if (map->tiles) {
+      assert(wt->tiles);
+#pragma omp parallel for shared(map,wt) schedule(dynamic,4) default(none)
+      for (long t=0;t<map->ntile;t++)
+	if ((map->tiles[t])&&(wt->tiles[t]))
+	  for (int i=0;i<NK_MAP_TILE_LEN;i++)
+	    if (wt->tiles[t][i]>0)
+	      map->tiles[t][i]/=wt->tiles[t][i];
+      return;
+    }
 #pragma omp parallel for shared(map,wt,params) default(none)
     for (int i=0;i<map->npix;i++) {
       if (wt->map[i]>0)
@@ -3869,6 +5857,11 @@ void dump_data(mbTOD *tod, char *fname)
 void readwrite_simple_map(MAP *map, char *filename, int dowrite)
 {
 #ifdef HAVE_MPI
+  if ((dowrite==DOWRITE)&&(map->comm)) {
+    //every process has to take part in writing a distributed map.
+    write_distributed_map(map,filename);
+    return;
+  }
   int myid;
   MPI_Comm_rank(MPI_COMM_WORLD,&myid);
   //if ((dowrite==DOREAD)||((dowrite==DOWRITE)&&(myid==0))) {  //if we're writing, only the master writes.
@@ -3907,9 +5900,21 @@ void readwrite_simple_map(MAP *map, char *filename, int dowrite)
       freadwrite(&map->decmin,sizeof(actData),1,iofile,dowrite);
       freadwrite(&map->decmax,sizeof(actData),1,iofile,dowrite);
       //mprintf(stdout,"limits on %s are %10.5f %10.5f %10.5f %10.5f %4d %4d %10.5f\n",filename,map->decmin,map->decmax,map->ramin,map->ramax,map->nx,map->ny,map->pixsize);
-      if (dowrite==DOREAD)
+      if (dowrite==DOREAD) {
 	map->map=vector(map->npix);
-      freadwrite(map->map,sizeof(actData),map->npix,iofile,dowrite);
+	map->tiles=NULL;
+	map->comm=NULL;
+	map->ntile=0;
+      }
+      if ((dowrite==DOWRITE)&&(map->tiles)) {
+	//stream sparse maps out a tile at a time, filling in the holes with zeros.
+	actData *zeros=(actData *)calloc(NK_MAP_TILE_LEN,sizeof(actData));
+	for (long t=0;t<map->ntile;t++)
+	  fwrite(map->tiles[t] ? map->tiles[t] : zeros,sizeof(actData),map_tile_len(map,t),iofile);
+	free(zeros);
+      }
+      else
+	freadwrite(map->map,sizeof(actData),map->npix,iofile,dowrite);
       fclose(iofile);
       //printf("npix is %ld\n",map->npix);
     }
@@ -3921,6 +5926,12 @@ void run_PCG(MAPvec *maps, TODvec *tods, PARAMS *params)
 
   //createFFTWplans(tod);
 
+#ifdef HAVE_MPI
+  if ((params->distributed_maps)&&(!maps->maps[0]->comm))
+    setup_mapset_comm(maps,tods,params);
+#endif
+  setup_tod_stream(tods,params);
+
   bool had_maps;
   MAPvec *maps_in;
   had_maps=!(is_mapset_blank(maps));
@@ -3949,9 +5960,16 @@ void run_PCG(MAPvec *maps, TODvec *tods, PARAMS *params)
 
   MAPvec *weights=make_mapset_copy(maps);
   get_weights(weights,tods,params);
+  //pivots from the hits of all my TODs, cached on the maps (and so on every copy the PCG makes).
+  for (int i=0;i<maps->nmap;i++) {
+    clear_map_pivots(maps->maps[i]);
+    copy_map_pivots(maps->maps[i],weights->maps[i]);
+  }
   char wtname[MAXLEN];
   sprintf(wtname,"%s.weights",params->outname);
   readwrite_simple_map(weights->maps[0],wtname,DOWRITE);
+  if (weights->maps[0]->tiles)
+    mprintf(stdout,"sky coverage is %ld of %ld map tiles.\n",count_map_tiles(weights->maps[0]),weights->maps[0]->ntile);
   if (params->rawonly) 
     exit(EXIT_SUCCESS);
 
@@ -3975,11 +5993,13 @@ void run_PCG(MAPvec *maps, TODvec *tods, PARAMS *params)
   int iter=0;
   int converged=0;
   actData first_residual=0;
+  PCGWork *work=allocate_pcg_work(r);
   while ((iter<params->maxiter)&&(converged==0))
     {
       iter++;
       //tick(&tt);
-      residual=PCGstep(r,p,x,tods,weights,params);
+      residual=PCGstep_work(r,p,x,tods,weights,params,work);
+      report_tod_balance(tods);
       if (iter==1) 
 	first_residual=residual;
 
@@ -3991,7 +6011,7 @@ void run_PCG(MAPvec *maps, TODvec *tods, PARAMS *params)
 #ifdef HAVE_MPI
       int ierr,myid;
       ierr=MPI_Comm_rank(MPI_COMM_WORLD,&myid);
-      if (myid==0) {
+      if ((myid==0)||(x->maps[0]->comm)) {
 	char outname[512];
 	sprintf(outname,"%s_%d.out",params->tempname,iter);
 	//sprintf(outname,"temporary_map_commonsub_%d.out",iter);
@@ -4002,6 +6022,13 @@ void run_PCG(MAPvec *maps, TODvec *tods, PARAMS *params)
       //displayMap(x->maps[0]);
 #endif
     }
+  destroy_pcg_work(work);
+  if (strlen(params->tod_cost_file))
+    write_tod_costs(tods,params,params->tod_cost_file);
+  free_tod_task_pool();
+  free_all_noise_workspaces();
+  for (int i=0;i<maps->nmap;i++)
+    clear_map_pivots(maps->maps[i]);
   copy_mapset2mapset(maps,x);
   destroy_mapset(x);
   destroy_mapset(r);
@@ -4209,6 +6236,122 @@ void parse_params(int argc, char **argv, PARAMS *params)
     printf("going to write pointing solutions to disk.\n");
   }
 
+  if (tok=find_argument(argc,argv,"@pointing_cache",found_list)) {
+    strncpy(params->pointing_cache,tok,MAXLEN-1);
+    printf("pointing will be cached in %s\n",params->pointing_cache);
+  }
+
+  if (tok=find_argument(argc,argv,"@fft_wisdom",found_list)) {
+    strncpy(params->fft_wisdom,tok,MAXLEN-1);
+    printf("FFTW wisdom will be kept in %s\n",params->fft_wisdom);
+  }
+
+  if (exists_in_command_line(argc,argv,"@tiled_maps",found_list)) {
+    params->tiled_maps=true;
+    printf("storing maps as sparse tiles.\n");
+  }
+
+  if (tok=find_argument(argc,argv,"@stream_tods",found_list)) {
+    strncpy(params->stream_dir,tok,MAXLEN-1);
+    printf("TODs will be streamed through %s\n",params->stream_dir);
+  }
+
+  if (tok=find_argument(argc,argv,"@stream_mem",found_list)) {
+    params->stream_mem=atof(tok);
+    printf("keeping up to %.1f MB of TOD pointing in memory while streaming.\n",params->stream_mem);
+  }
+
+  if (exists_in_command_line(argc,argv,"@tod_tasks",found_list)) {
+    params->tod_tasks=true;
+    printf("running small TODs concurrently.\n");
+  }
+
+  if (exists_in_command_line(argc,argv,"@balance_tods",found_list)) {
+    params->balance_tods=true;
+    printf("handing out TODs by cost.\n");
+  }
+
+  if (tok=find_argument(argc,argv,"@tod_costs",found_list)) {
+    strncpy(params->tod_cost_file,tok,MAXLEN-1);
+    printf("measured TOD costs will be kept in %s\n",params->tod_cost_file);
+  }
+
+  if (exists_in_command_line(argc,argv,"@distributed_maps",found_list)) {
+    params->distributed_maps=true;
+    printf("distributing maps over processes.\n");
+  }
+
+  if (exists_in_command_line(argc,argv,"@reduce_bbox",found_list)) {
+    params->reduce_bbox=true;
+    printf("only reducing the touched part of maps across processes.\n");
+  }
+
+  if (tok=find_argument(argc,argv,"@mpi_chunk",found_list)) {
+    params->mpi_chunk=atol(tok);
+    printf("reducing maps in chunks of %ld pixels.\n",params->mpi_chunk);
+  }
+
+  if (tok=find_argument(argc,argv,"@fft_rigor",found_list)) {
+    if (strcmp(tok,"estimate")==0)
+      params->fft_plan_flags=FFTW_ESTIMATE;
+    else if (strcmp(tok,"patient")==0)
+      params->fft_plan_flags=FFTW_PATIENT;
+    else if (strcmp(tok,"exhaustive")==0)
+      params->fft_plan_flags=FFTW_EXHAUSTIVE;
+    else if (strcmp(tok,"measure")==0)
+      params->fft_plan_flags=FFTW_MEASURE;
+    else {
+      fprintf(stderr,"Unknown @fft_rigor %s, expected estimate, measure, patient or exhaustive.\n",tok);
+#ifdef HAVE_MPI
+      MPI_Abort(MPI_COMM_WORLD,EXIT_FAILURE);
+#endif
+      exit(EXIT_FAILURE);
+    }
+    printf("FFT plans will be made with rigor %s\n",tok);
+  }
+
+  if (tok=find_argument(argc,argv,"@fft_mode",found_list)) {
+    if (strcmp(tok,"batched")==0)
+      params->fft_mode=NK_FFT_BATCHED;
+    else if (strcmp(tok,"threaded")==0)
+      params->fft_mode=NK_FFT_THREADED;
+    else if (strcmp(tok,"split")==0)
+      params->fft_mode=NK_FFT_SPLIT;
+    else {
+      fprintf(stderr,"Unknown @fft_mode %s, expected split, batched or threaded.\n",tok);
+#ifdef HAVE_MPI
+      MPI_Abort(MPI_COMM_WORLD,EXIT_FAILURE);  //only the root parses, so the rest are waiting on it.
+#endif
+      exit(EXIT_FAILURE);
+    }
+    printf("noise FFTs will be threaded as %s\n",tok);
+  }
+
+  if (tok=find_argument(argc,argv,"@fft_threads",found_list)) {
+    params->fft_threads=atoi(tok);
+    printf("using %d threads per TOD for noise FFTs.\n",params->fft_threads);
+  }
+
+  if (tok=find_argument(argc,argv,"@fft_batch",found_list)) {
+    params->fft_batch=atoi(tok);
+    printf("batching %d detectors per noise FFT plan.\n",params->fft_batch);
+  }
+
+  if (exists_in_command_line(argc,argv,"@fft_benchmark",found_list)) {
+    params->fft_benchmark=true;
+    printf("going to benchmark the noise FFTs.\n");
+  }
+
+  if (exists_in_command_line(argc,argv,"@noise_dct",found_list)) {
+    params->noise_dct=true;
+    printf("filtering noise with DCTs.\n");
+  }
+
+  if (tok=find_argument(argc,argv,"@convert_nktod",found_list)) {
+    strncpy(params->nktod_dir,tok,MAXLEN-1);
+    printf("converting TODs to containers in %s\n",params->nktod_dir);
+  }
+
 
 
   
@@ -4251,6 +6394,21 @@ int get_parameters(int argc, char *argv[], PARAMS *params)
 	params->maxtod=0;  //0 for unlimited.
 	params->deglitch=false;
 	params->rawonly=false;
+	params->fft_plan_flags=FFTW_ESTIMATE;
+	params->fft_mode=NK_FFT_SPLIT;
+	params->fft_threads=0;
+	params->fft_batch=NK_FFT_BATCH;
+	params->fft_benchmark=false;
+	params->noise_dct=false;
+	params->reduce_bbox=false;
+	params->tiled_maps=false;
+	params->distributed_maps=false;
+	params->balance_tods=false;
+	params->tod_tasks=false;
+	params->stream_dir[0]='\0';
+	params->nktod_dir[0]='\0';
+	params->stream_mem=0;
+	params->mpi_chunk=NK_MPI_REDUCE_CHUNK;
 
 	int myargc;
 	char **myargv;
@@ -27,6 +27,7 @@
 #endif
 
 #include "dirfile.h"
+#include "readtod.h"
 #include "astro.h"
 #include "mbCommon.h"
 #include "mbCuts.h"
@@ -102,6 +103,12 @@
     print_options(&params);
   if (params.quit)
     exit(EXIT_SUCCESS);  
+  set_fft_plan_flags(params.fft_plan_flags);
+  set_fft_threading(params.fft_mode,params.fft_threads,params.fft_batch);
+  if (params.noise_dct)
+    set_noise_basis(NK_NOISE_DCT);
+  if (strlen(params.fft_wisdom))
+    import_fft_wisdom(params.fft_wisdom);
   
   
 #if 0
@@ -130,7 +137,40 @@
   for (int i=0;i<tods.ntod;i++)
     mprintf(stdout,"I own %s\n",tods.my_fnames[i]);
   
+  if (strlen(params.nktod_dir)) {
+    //each process converts the TODs it owns, then we're done.
+    int nbad=0;
+    for (int i=0;i<tods.ntod;i++) {
+      char outname[2*MAXLEN];
+      char *fname=strdup(tods.my_fnames[i]);
+      int len=strlen(fname);
+      while ((len>1)&&(fname[len-1]=='/'))
+	fname[--len]='\0';
+      char *base=strrchr(fname,'/');
+      snprintf(outname,sizeof(outname),"%s/%s.nktod",params.nktod_dir,base ? base+1 : fname);
+      if (convert_dirfile_to_nktod(tods.my_fnames[i],outname,1)) {
+	fprintf(stderr,"Failed to convert %s to %s\n",tods.my_fnames[i],outname);
+	nbad++;
+      }
+      else
+	mprintf(stdout,"converted %s to %s\n",tods.my_fnames[i],outname);
+      free(fname);
+    }
+    exit(nbad ? EXIT_FAILURE : EXIT_SUCCESS);
+  }
   read_all_tod_headers(&tods,&params);
+  if (params.fft_benchmark) {
+    //once per distinct TOD shape I own.
+    for (int i=0;i<tods.ntod;i++) {
+      bool seen=false;
+      for (int j=0;j<i;j++)
+	if ((tods.tods[j].ndet==tods.tods[i].ndet)&&(tods.tods[j].ndata==tods.tods[i].ndata))
+	  seen=true;
+      if (!seen)
+	benchmark_noise_ffts(tods.tods[i].ndet,tods.tods[i].ndata,3);
+    }
+    exit(EXIT_SUCCESS);
+  }
   set_global_radec_lims(&tods);
   mprintf(stdout,"global limits are %12.5f %12.5f %12.5f %12.5f\n",tods.ramin,tods.ramax,tods.decmin,tods.decmax);
 
@@ -141,8 +181,9 @@
   pca_time tt;
   tick(&tt);
   
-  find_pointing_pivots(tod,1.0);
-  printf("have %d samples.\n",tod->pointing_fit->ncoarse);
+  actData pivot_err=find_pointing_pivots(tod,1.0);
+  printf("have %d samples, max interpolation error %8.4f arcsec.\n",tod->pointing_fit->ncoarse,pivot_err);
+  printf("%d synthetic pivot checks failed.\n",check_pointing_pivots(16,1.0,0));
   //exit(EXIT_SUCCESS);
 #pragma omp parallel shared(tod) default(none)
   {
@@ -168,6 +209,11 @@
       mapvec[i].projection=(nkProjection *)malloc(sizeof(nkProjection));
       mapvec[i].projection->proj_type=NK_RECT;
       mapvec[i].have_locks=0;
+      mapvec[i].ipiv_proc=NULL;
+      mapvec[i].npiv_proc=0;
+      mapvec[i].tiles=NULL;
+      mapvec[i].comm=NULL;
+      mapvec[i].ntile=0;
     }
     maps.maps=&mapvec;
   }
@@ -185,6 +231,18 @@
 
   run_PCG(&maps,&tods,&params);
   readwrite_simple_map(maps.maps[0],params.outname,DOWRITE);
+  if (strlen(params.fft_wisdom)) {
+#ifdef HAVE_MPI
+    if (myrank==0)
+#endif
+      export_fft_wisdom(params.fft_wisdom);
+  }
+  destroy_fft_plan_cache();
+  destroy_tod_stream(&tods);
+  free_dirfile_format_cache();
+#ifdef HAVE_MPI
+  free_mapset_comm(&maps);
+#endif
 
   exit(EXIT_SUCCESS);
   run_PCG(&maps,&tods,&params);
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <complex.h>
+#include <unistd.h>
 
 #include "ninkasi.h"
 #include "noise.h"
@@ -877,10 +878,16 @@ void CalculateIfilter(mbTOD *tod, int mydet, actComplex *ifilter)
 
 
 /*--------------------------------------------------------------------------------*/
+static void filter_data_wnoise_dct(mbTOD *tod);
+
 void filter_data_wnoise(mbTOD *tod)
 {
   assert(tod->have_data);
   assert(tod->noise);
+  if (get_noise_basis()==NK_NOISE_DCT) {
+    filter_data_wnoise_dct(tod);
+    return;
+  }
 #pragma omp parallel shared(tod) default(none)
   {    
 
@@ -1331,6 +1338,400 @@ void allocate_tod_noise_bands(mbTOD *tod,actData *bands, int nband)
   
 }
 /*--------------------------------------------------------------------------------*/
+//Cache of 1-d r2c/c2r plans.  TOD lengths repeat, so a plan is made once per (length, direction,
+//alignment, flags) and is worth measuring.  Plans are made on scratch buffers shifted to the
+//alignment of the real data, then run on each detector's row through the new-array execute
+//calls, which are safe to call from several threads.  The planner itself is not, so lookups
+//and planning all happen in the fftw_planner critical section.
+typedef struct {
+  int ndata;
+  int sign;       //FFTW_FORWARD for r2c, FFTW_BACKWARD for c2r, NK_R2R_SIGN+kind for r2r
+  int inplace;
+  int align_in;
+  int align_out;
+  int howmany;    //detectors done by one execution, rows rdist/cdist elements apart
+  long rdist;
+  long cdist;
+  int nthread;    //FFTW's own threads, 1 unless the plan is threaded
+  unsigned flags;
+  fftw_plan plan;
+} FFTPlanCacheEntry;
+
+static FFTPlanCacheEntry *fft_plan_cache=NULL;
+static int fft_plan_cache_n=0;
+static int fft_plan_cache_alloc=0;
+static unsigned fft_plan_flags=FFTW_ESTIMATE;
+static int fft_mode=NK_FFT_SPLIT;
+static int fft_nthread=0;  //0 to use omp_get_max_threads()
+static int fft_batch=NK_FFT_BATCH;
+static bool fftw_threads_ready=false;
+static int noise_basis=NK_NOISE_FFT;
+
+#define NK_R2R_SIGN 16  //plan cache sign of a real-to-real plan is NK_R2R_SIGN plus its kind
+
+/*--------------------------------------------------------------------------------*/
+void set_fft_plan_flags(unsigned flags)
+//planner rigor used by fft_all_data/ifft_all_data.  FFTW_ESTIMATE by default.
+{
+  fft_plan_flags=flags;
+}
+/*--------------------------------------------------------------------------------*/
+void set_fft_threading(int mode, int nthread, int batch)
+//how the noise FFTs of a TOD are spread over threads.  NK_FFT_SPLIT hands detectors to
+//threads one plan at a time, NK_FFT_BATCHED hands out blocks of batch detectors done by a
+//single plan, and NK_FFT_THREADED does all detectors with one plan running on FFTW's threads.
+//nthread of 0 means omp_get_max_threads().
+{
+  fft_mode=mode;
+  fft_nthread=(nthread>0 ? nthread : 0);
+  fft_batch=(batch>0 ? batch : NK_FFT_BATCH);
+  if ((mode==NK_FFT_THREADED)&&(!fftw_threads_ready)) {
+#pragma omp critical (fftw_planner)
+    {
+      if (!fftw_threads_ready)
+	fftw_threads_ready=(fftw_init_threads()!=0);
+    }
+    if (!fftw_threads_ready) {
+      fprintf(stderr,"Unable to start FFTW threads, splitting FFTs over OpenMP instead.\n");
+      fft_mode=NK_FFT_SPLIT;
+    }
+  }
+}
+/*--------------------------------------------------------------------------------*/
+void set_noise_basis(int basis)
+//NK_NOISE_FFT filters in the periodic r2c/c2r basis, NK_NOISE_DCT in the DCT-II/III basis,
+//which treats the ends as mirrored rather than wrapped so needs no windowing around the filters.
+//Noise fitting stays in the FFT basis either way.
+{
+  noise_basis=basis;
+}
+/*--------------------------------------------------------------------------------*/
+int get_noise_basis(void)
+{
+  return noise_basis;
+}
+/*--------------------------------------------------------------------------------*/
+static int get_fft_nthread(void)
+{
+  return (fft_nthread>0 ? fft_nthread : omp_get_max_threads());
+}
+/*--------------------------------------------------------------------------------*/
+static fftw_plan get_cached_fft_plan_many(int ndata, int sign, int howmany, actData *r, long rdist, actComplex *c, long cdist, int nthread, unsigned flags)
+//a plan for howmany transforms of evenly spaced rows, made once per shape and alignment.
+{
+  int inplace=((void *)r==(void *)c);
+  int align_r=fftw_alignment_of(r);
+  int align_c=fftw_alignment_of((double *)c);
+  int align_in=(sign!=FFTW_BACKWARD) ? align_r : align_c;
+  int align_out=(sign!=FFTW_BACKWARD) ? align_c : align_r;
+  if (howmany==1) {
+    rdist=0;
+    cdist=0;
+  }
+  if (!fftw_threads_ready)
+    nthread=1;
+  fftw_plan plan=NULL;
+  
+#pragma omp critical (fftw_planner)
+  {
+    for (int i=0;i<fft_plan_cache_n;i++) {
+      FFTPlanCacheEntry *e=fft_plan_cache+i;
+      if ((e->ndata==ndata)&&(e->sign==sign)&&(e->inplace==inplace)&&(e->align_in==align_in)&&(e->align_out==align_out)&&(e->howmany==howmany)&&(e->rdist==rdist)&&(e->cdist==cdist)&&(e->nthread==nthread)&&(e->flags==flags)) {
+	plan=e->plan;
+	break;
+      }
+    }
+    if (!plan) {
+      //measuring scribbles on the arrays, so plan on scratch with the same alignment.
+      int nn=get_nn(ndata);
+      size_t nbyte_r=sizeof(actData)*((howmany-1)*rdist+ndata);
+      size_t nbyte_c=sizeof(actComplex)*((howmany-1)*cdist+nn);
+      size_t nbyte=(nbyte_r>nbyte_c ? nbyte_r : nbyte_c)+64;
+      char *rbuf=(char *)fftw_malloc(nbyte);
+      char *cbuf=inplace ? rbuf : (char *)fftw_malloc(nbyte);
+      actData *rs=(actData *)(rbuf+align_r);
+      actComplex *cs=(actComplex *)(cbuf+align_c);
+      if (fftw_threads_ready)
+	fftw_plan_with_nthreads(nthread);
+      if (sign==FFTW_FORWARD)
+	plan=fftw_plan_many_dft_r2c(1,&ndata,howmany,rs,NULL,1,rdist,cs,NULL,1,cdist,flags);
+      else if (sign==FFTW_BACKWARD)
+	plan=fftw_plan_many_dft_c2r(1,&ndata,howmany,cs,NULL,1,cdist,rs,NULL,1,rdist,flags);
+      else {
+	//real to real, from r into the real array at c.
+	fftw_r2r_kind kind=(fftw_r2r_kind)(sign-NK_R2R_SIGN);
+	plan=fftw_plan_many_r2r(1,&ndata,howmany,rs,NULL,1,rdist,(actData *)cs,NULL,1,cdist,&kind,flags);
+      }
+      if (fftw_threads_ready)
+	fftw_plan_with_nthreads(1);
+      if (!inplace)
+	fftw_free(cbuf);
+      fftw_free(rbuf);
+      if (plan) {
+	if (fft_plan_cache_n==fft_plan_cache_alloc) {
+	  fft_plan_cache_alloc=2*fft_plan_cache_alloc+8;
+	  fft_plan_cache=(FFTPlanCacheEntry *)realloc(fft_plan_cache,sizeof(FFTPlanCacheEntry)*fft_plan_cache_alloc);
+	}
+	FFTPlanCacheEntry *e=fft_plan_cache+fft_plan_cache_n;
+	e->ndata=ndata;
+	e->sign=sign;
+	e->inplace=inplace;
+	e->align_in=align_in;
+	e->align_out=align_out;
+	e->howmany=howmany;
+	e->rdist=rdist;
+	e->cdist=cdist;
+	e->nthread=nthread;
+	e->flags=flags;
+	e->plan=plan;
+	fft_plan_cache_n++;
+      }
+    }
+  }
+  if (plan==NULL)
+    fprintf(stderr,"Had a problem getting the fft plan for length %d.\n",ndata);
+  return plan;
+}
+/*--------------------------------------------------------------------------------*/
+static fftw_plan get_cached_fft_plan(int ndata, int sign, actData *r, actComplex *c, unsigned flags)
+{
+  return get_cached_fft_plan_many(ndata,sign,1,r,0,c,0,1,flags);
+}
+/*--------------------------------------------------------------------------------*/
+static long get_row_dist(void **rows, int n, size_t elsize)
+//distance between consecutive rows in elements, or -1 if they aren't evenly spaced.
+{
+  if (n<2)
+    return 0;
+  long d=(char *)rows[1]-(char *)rows[0];
+  if ((d<=0)||(d%elsize))
+    return -1;
+  for (int i=2;i<n;i++)
+    if ((char *)rows[i]-(char *)rows[i-1]!=d)
+      return -1;
+  return d/elsize;
+}
+/*--------------------------------------------------------------------------------*/
+void destroy_fft_plan_cache(void)
+{
+#pragma omp critical (fftw_planner)
+  {
+    for (int i=0;i<fft_plan_cache_n;i++)
+      fftw_destroy_plan(fft_plan_cache[i].plan);
+    free(fft_plan_cache);
+    fft_plan_cache=NULL;
+    fft_plan_cache_n=0;
+    fft_plan_cache_alloc=0;
+  }
+}
+/*--------------------------------------------------------------------------------*/
+//Scratch for the noise filters: two ndet x nn complex buffers.  There is one per thread that
+//filters, grown to the biggest TOD it has seen and kept for the run, so filtering a TOD doesn't
+//go near malloc.  One per TOD would double the resident size of the data.
+typedef struct {
+  long nelem[2];
+  int nrow[2];
+  actComplex *buf[2];
+  actComplex **rows[2];
+} NoiseWorkspace;
+
+static NoiseWorkspace noise_ws;
+#pragma omp threadprivate(noise_ws)
+
+/*--------------------------------------------------------------------------------*/
+static actComplex **get_noise_workspace(int which, int ndet, int nn)
+{
+  NoiseWorkspace *ws=&noise_ws;
+  long nelem=(long)ndet*nn;
+  if (nelem>ws->nelem[which]) {
+    if (ws->buf[which])
+      fftw_free(ws->buf[which]);
+    ws->buf[which]=(actComplex *)fftw_malloc(sizeof(actComplex)*nelem);
+    assert(ws->buf[which]);
+    ws->nelem[which]=nelem;
+  }
+  if (ndet>ws->nrow[which]) {
+    free(ws->rows[which]);
+    ws->rows[which]=(actComplex **)malloc_retry(sizeof(actComplex *)*ndet);
+    ws->nrow[which]=ndet;
+  }
+  for (int i=0;i<ndet;i++)
+    ws->rows[which][i]=ws->buf[which]+(long)i*nn;
+  return ws->rows[which];
+}
+/*--------------------------------------------------------------------------------*/
+void free_noise_workspace(void)
+//release the calling thread's noise scratch.
+{
+  NoiseWorkspace *ws=&noise_ws;
+  for (int i=0;i<2;i++) {
+    if (ws->buf[i])
+      fftw_free(ws->buf[i]);
+    free(ws->rows[i]);
+  }
+  memset(ws,0,sizeof(NoiseWorkspace));
+}
+/*--------------------------------------------------------------------------------*/
+void free_all_noise_workspaces(void)
+//release the noise scratch of every thread in the default team.  Threads of nested teams
+//have to be freed from inside those teams, see run_small_tods_as_tasks.
+{
+#pragma omp parallel default(none)
+  free_noise_workspace();
+}
+/*--------------------------------------------------------------------------------*/
+int import_fft_wisdom(const char *fname)
+//returns 1 if wisdom was read.  A missing file is fine, it just means nothing's been measured yet.
+{
+  int ok=0;
+#pragma omp critical (fftw_planner)
+  ok=fftw_import_wisdom_from_filename(fname);
+  if (!ok)
+    fprintf(stderr,"No FFTW wisdom read from %s.\n",fname);
+  return ok;
+}
+/*--------------------------------------------------------------------------------*/
+int export_fft_wisdom(const char *fname)
+//write under a temporary name and rename, so readers never see a partial file.
+{
+  int len=strlen(fname)+64;
+  char *tmpname=(char *)malloc(len);
+  snprintf(tmpname,len,"%s.tmp.%ld",fname,(long)getpid());
+  int ok=0;
+#pragma omp critical (fftw_planner)
+  ok=fftw_export_wisdom_to_filename(tmpname);
+  if (ok)
+    ok=(rename(tmpname,fname)==0);
+  if (!ok) {
+    fprintf(stderr,"Unable to write FFTW wisdom to %s.\n",fname);
+    remove(tmpname);
+  }
+  free(tmpname);
+  return ok;
+}
+/*--------------------------------------------------------------------------------*/
+
+static void transform_row_block(mbTOD *tod, actComplex **data_fft, int sign, int i0, int n, int nthread, unsigned flags)
+//transform detectors i0..i0+n-1 with one plan if their rows are evenly spaced, else one at a time.
+{
+  long rdist=get_row_dist((void **)(tod->data+i0),n,sizeof(actData));
+  long cdist=get_row_dist((void **)(data_fft+i0),n,sizeof(actComplex));
+  if ((n>1)&&(rdist>=tod->ndata)&&(cdist>=get_nn(tod->ndata))) {
+    fftw_plan plan=get_cached_fft_plan_many(tod->ndata,sign,n,tod->data[i0],rdist,data_fft[i0],cdist,nthread,flags);
+    if (sign==FFTW_FORWARD)
+      fftw_execute_dft_r2c(plan,tod->data[i0],data_fft[i0]);
+    else
+      fftw_execute_dft_c2r(plan,data_fft[i0],tod->data[i0]);
+    return;
+  }
+  for (int i=i0;i<i0+n;i++) {
+    fftw_plan plan=get_cached_fft_plan(tod->ndata,sign,tod->data[i],data_fft[i],flags);
+    if (sign==FFTW_FORWARD)
+      fftw_execute_dft_r2c(plan,tod->data[i],data_fft[i]);
+    else
+      fftw_execute_dft_c2r(plan,data_fft[i],tod->data[i]);
+  }
+}
+/*--------------------------------------------------------------------------------*/
+static void normalize_rows(mbTOD *tod, int i0, int n)
+{
+  actData fn=tod->ndata;
+  for (int i=i0;i<i0+n;i++) {
+    actData *vec=tod->data[i];
+    for (int j=0;j<tod->ndata;j++)
+      vec[j]/=fn;
+  }
+}
+/*--------------------------------------------------------------------------------*/
+static void transform_all_data(mbTOD *tod, actComplex **data_fft, int sign, unsigned flags, bool normalize)
+{
+  int nthread=get_fft_nthread();
+  //a single threaded plan needs evenly spaced rows, otherwise fall back to splitting.
+  bool threaded=(fft_mode==NK_FFT_THREADED)&&(tod->ndet>1);
+  if (threaded)
+    threaded=(get_row_dist((void **)tod->data,tod->ndet,sizeof(actData))>=tod->ndata)&&(get_row_dist((void **)data_fft,tod->ndet,sizeof(actComplex))>=get_nn(tod->ndata));
+  if (threaded) {
+    transform_row_block(tod,data_fft,sign,0,tod->ndet,nthread,flags);
+    if (normalize) {
+#pragma omp parallel for num_threads(nthread) shared(tod) default(none) schedule(static)
+      for (int i=0;i<tod->ndet;i++)
+	normalize_rows(tod,i,1);
+    }
+    return;
+  }
+  //split: one detector per plan, handed out a few at a time.  batched: fft_batch detectors per plan.
+  int batch=(fft_mode==NK_FFT_BATCHED ? fft_batch : 1);
+  int nblock=(tod->ndet+batch-1)/batch;
+#pragma omp parallel for num_threads(nthread) shared(tod,data_fft,sign,flags,normalize,batch,nblock) default(none) schedule(dynamic,(batch>1 ? 1 : 4))
+  for (int b=0;b<nblock;b++) {
+    int i0=b*batch;
+    int n=(tod->ndet-i0<batch ? tod->ndet-i0 : batch);
+    transform_row_block(tod,data_fft,sign,i0,n,1,flags);
+    //normalize while the rows are still in cache.
+    if (normalize)
+      normalize_rows(tod,i0,n);
+  }
+}
+/*--------------------------------------------------------------------------------*/
+static void fft_all_data_into(mbTOD *tod, actComplex **data_fft, unsigned flags)
+//forward transform of every detector into data_fft, which has rows of get_nn(ndata).
+{
+  transform_all_data(tod,data_fft,FFTW_FORWARD,flags,false);
+}
+/*--------------------------------------------------------------------------------*/
+static void ifft_all_data_into(mbTOD *tod, actComplex **data_fft, unsigned flags, bool normalize)
+//inverse transform back into the TOD.  Callers that already folded 1/n into their weights
+//skip the normalization.
+{
+  transform_all_data(tod,data_fft,FFTW_BACKWARD,flags,normalize);
+}
+/*--------------------------------------------------------------------------------*/
+//In the DCT basis, coefficient k sits at frequency k/(2 ndata deltat), i.e. at FFT index k/2,
+//so the pair (2i,2i+1) plays the part of the real and imaginary parts of FFT index i and the
+//noise models apply unchanged.  REDFT10 followed by REDFT01 multiplies by 2*ndata.
+
+static void dct_all_data_into(mbTOD *tod, actData **coef, fftw_r2r_kind kind, unsigned flags)
+//DCT-II (FFTW_REDFT10) of every detector into coef, or DCT-III (FFTW_REDFT01) of coef back into
+//the TOD.  Unnormalized.
+{
+  int nthread=get_fft_nthread();
+#pragma omp parallel for num_threads(nthread) shared(tod,coef,kind,flags) default(none) schedule(dynamic,4)
+  for (int i=0;i<tod->ndet;i++) {
+    actData *in=(kind==FFTW_REDFT10 ? tod->data[i] : coef[i]);
+    actData *out=(kind==FFTW_REDFT10 ? coef[i] : tod->data[i]);
+    fftw_plan plan=get_cached_fft_plan_many(tod->ndata,NK_R2R_SIGN+kind,1,in,0,(actComplex *)out,0,1,flags);
+    fftw_execute_r2r(plan,in,out);
+  }
+}
+/*--------------------------------------------------------------------------------*/
+static void filter_data_wnoise_dct(mbTOD *tod)
+//filter_data_wnoise in the DCT basis, with the filter evaluated at half-integer FFT indices.
+{
+  int n=tod->ndata;
+  int nn=get_nn(n);
+  actData **coef=(actData **)get_noise_workspace(0,tod->ndet,nn);
+  dct_all_data_into(tod,coef,FFTW_REDFT10,fft_plan_flags);
+  actData delta=get_tod_fft_delta(tod);
+#pragma omp parallel for shared(tod,coef,n,delta) default(none) schedule(dynamic,1)
+  for (int i=0;i<tod->ndet;i++) {
+    if (mbCutsIsAlwaysCut(tod->cuts,tod->rows[i],tod->cols[i])) {
+      //cut detectors go back unfiltered.
+      for (int k=0;k<n;k++)
+	coef[i][k]/=2*n;
+      continue;
+    }
+    actData white=n*tod->noise->noises[i].params[0];
+    actData knee_coeff=n*tod->noise->noises[i].params[1];
+    actData powlaw=tod->noise->noises[i].powlaw;
+    actData fac=pow(delta,powlaw)*knee_coeff;
+    for (int k=1;k<n;k++)
+      coef[i][k]/=((white+pow(0.5*k,powlaw)*fac)*2*n);
+    //same DC weight as the FFT filter, twice the filter at FFT index 1.
+    coef[i][0]/=(2*(white+fac)*2*n);
+  }
+  dct_all_data_into(tod,coef,FFTW_REDFT01,fft_plan_flags);
+}
+/*--------------------------------------------------------------------------------*/
 
 actComplex **fft_all_data_flag(mbTOD *tod, unsigned flags) 
 {
@@ -1341,35 +1742,7 @@ actComplex **fft_all_data_flag(mbTOD *tod, unsigned flags)
   int nn=get_nn(tod->ndata);
   //printf("inside, nn is %d\n",nn);
   actComplex **data_fft=cmatrix(tod->ndet,nn);
-
-  int *n=ivector(tod->ndet);
-  for (int i=0;i<tod->ndet;i++)
-    n[i]=tod->ndata;
-
-#ifdef MAX_DET_FFT //if FFT's are touch, cap the # that can be run at once.
-  for (int i=0;i<tod->ndet;i+=MAX_DET_FFT) {
-    int ndet=MAX_DET_FFT;
-    if (ndet>tod->ndet-i)
-      ndet=tod->ndet-i;
-    //fprintf(stderr,"Ndet is %d, i is %d of %d\n",ndet,i,tod->ndet);
-    fftw_plan plan=fftw_plan_many_dft_r2c(1,n+i,ndet,tod->data[i],NULL,1,tod->ndata,data_fft[i],NULL,1,nn,flags);
-    fftw_execute(plan);
-    //fprintf(stderr,"Plan is executed.\n");
-    fftw_destroy_plan(plan);
-  }
-  //fprintf(stderr,"Finished FFT's.\n");
-#else  
-  //fprintf(stderr,"Preparing plan with %d %d %d.\n",tod->ndet,tod->ndata,nn);
-  fftw_plan plan=fftw_plan_many_dft_r2c(1,n,tod->ndet,tod->data[0],NULL,1,tod->ndata,data_fft[0],NULL,1,nn,flags);
-  if (plan==NULL)
-    printf("Had a problem getting the fft plan.\n");
-  //fprintf(stderr,"Executing plan.\n");
-  fftw_execute(plan);
-  //fprintf(stderr,"Executed plan.\n");
-  fftw_destroy_plan(plan);
-  //fprintf(stderr,"Destroyed plan.\n");
-#endif
-  free(n);
+  fft_all_data_into(tod,data_fft,flags);
 
   return data_fft;
   
@@ -1378,7 +1751,7 @@ actComplex **fft_all_data_flag(mbTOD *tod, unsigned flags)
 
 actComplex **fft_all_data(mbTOD *tod) 
 {
-  actComplex **data_fft=fft_all_data_flag(tod,FFTW_ESTIMATE);
+  actComplex **data_fft=fft_all_data_flag(tod,fft_plan_flags);
   return data_fft;
   
 }
@@ -1390,33 +1763,8 @@ void ifft_all_data_flag(mbTOD *tod,actComplex **data_fft,unsigned flag)
   assert(tod->have_data);
   assert(tod->ndet>0);
   
-  int nn=get_nn(tod->ndata);
-
-  int *n=ivector(tod->ndet);
-  for (int i=0;i<tod->ndet;i++)
-    n[i]=tod->ndata;
-
-  
-#if 0
-#pragma omp parallel
-#pragma omp single
-  fftw_plan_with_nthreads(omp_get_num_procs());
-#endif
-  
-  fftw_plan plan=fftw_plan_many_dft_c2r(1,n,tod->ndet,data_fft[0],NULL,1,nn,tod->data[0],NULL,1,tod->ndata,flag);
-  fftw_execute(plan);  
-  fftw_destroy_plan(plan);
-  
-
-  actData fn=tod->ndata;
-#pragma omp parallel for shared(tod,fn) default(none)  
-  for (int i=0;i<tod->ndet;i++)
-    for (int j=0;j<tod->ndata;j++)
-      tod->data[i][j]/=fn;
-
-  
+  ifft_all_data_into(tod,data_fft,flag,true);
   
-  free(n);
   return;
   
 }
@@ -1426,7 +1774,7 @@ void ifft_all_data_flag(mbTOD *tod,actComplex **data_fft,unsigned flag)
 void ifft_all_data(mbTOD *tod,actComplex **data_fft) 
 {
 #if 1
-  ifft_all_data_flag(tod,data_fft,FFTW_ESTIMATE);
+  ifft_all_data_flag(tod,data_fft,fft_plan_flags);
 #else
   assert(tod);
   assert(tod->have_data);
@@ -1458,6 +1806,122 @@ void ifft_all_data(mbTOD *tod,actComplex **data_fft)
   
 }
 /*--------------------------------------------------------------------------------*/
+void benchmark_noise_ffts(int ndet, int ndata, int nrep)
+//time a forward and inverse transform of an ndet x ndata TOD under each threading strategy,
+//and check they all give back the input.  Leaves the threading as it found it.
+{
+  int mode0=fft_mode;
+  int nthread0=fft_nthread;
+  int batch0=fft_batch;
+  int nn=get_nn(ndata);
+  mbTOD tod;
+  memset(&tod,0,sizeof(tod));
+  tod.ndet=ndet;
+  tod.ndata=ndata;
+  tod.data=matrix(ndet,ndata);
+  tod.have_data=1;
+  actData **orig=matrix(ndet,ndata);
+  actComplex **data_fft=cmatrix(ndet,nn);
+  for (int i=0;i<ndet;i++)
+    for (int j=0;j<ndata;j++)
+      orig[i][j]=sin(0.001*(i+1)*j)+((i*7919+j*104729)%1000)*1e-3;
+
+  int modes[]={NK_FFT_SPLIT,NK_FFT_BATCHED,NK_FFT_BATCHED,NK_FFT_BATCHED,NK_FFT_BATCHED,NK_FFT_THREADED};
+  int batches[]={1,4,8,16,32,1};
+  const char *names[]={"split","batched","batched","batched","batched","threaded"};
+  printf("FFT benchmark on %d detectors of %d samples with %d threads:\n",ndet,ndata,(nthread0>0 ? nthread0 : omp_get_max_threads()));
+  for (int m=0;m<6;m++) {
+    set_fft_threading(modes[m],nthread0,batches[m]);
+    if (fft_mode!=modes[m])
+      continue;
+    //the first pass makes the plans.
+    memcpy(tod.data[0],orig[0],sizeof(actData)*ndet*ndata);
+    fft_all_data_into(&tod,data_fft,fft_plan_flags);
+    ifft_all_data_into(&tod,data_fft,fft_plan_flags,true);
+    pca_time tt;
+    tick(&tt);
+    for (int rep=0;rep<nrep;rep++) {
+      fft_all_data_into(&tod,data_fft,fft_plan_flags);
+      ifft_all_data_into(&tod,data_fft,fft_plan_flags,true);
+    }
+    actData t=tocksilent(&tt)/(nrep>0 ? nrep : 1);
+    actData maxerr=0;
+    for (int i=0;i<ndet;i++)
+      for (int j=0;j<ndata;j++)
+	if (fabs(tod.data[i][j]-orig[i][j])>maxerr)
+	  maxerr=fabs(tod.data[i][j]-orig[i][j]);
+    printf("  %-8s batch %2d: %10.5f seconds per forward+inverse, max round trip error %10.3e\n",names[m],(modes[m]==NK_FFT_BATCHED ? batches[m] : 1),t,maxerr);
+  }
+  set_fft_threading(mode0,nthread0,batch0);
+  free_matrix(tod.data);
+  free_matrix(orig);
+  free(data_fft[0]);
+  free(data_fft);
+}
+/*--------------------------------------------------------------------------------*/
+actData check_noise_dct_white(int ndet, int ndata, long seed)
+//filter random data with a white noise model in the FFT and DCT bases and return the largest
+//difference between the two, relative to the largest filtered sample.  A white filter doesn't
+//care how the ends are joined, so this should be at rounding level.  Leaves the basis as it found it.
+{
+  int basis0=noise_basis;
+  mbTOD tod;
+  memset(&tod,0,sizeof(tod));
+  tod.ndet=ndet;
+  tod.ndata=ndata;
+  tod.deltat=1.0/400;
+  tod.nrow=1;
+  tod.ncol=ndet;
+  tod.rows=(int *)calloc(ndet,sizeof(int));
+  tod.cols=(int *)malloc(sizeof(int)*ndet);
+  for (int i=0;i<ndet;i++)
+    tod.cols[i]=i;
+  tod.cuts=mbCutsAlloc(tod.nrow,tod.ncol);
+  tod.data=matrix(ndet,ndata);
+  tod.have_data=1;
+  actData **orig=matrix(ndet,ndata);
+  srand48(seed);
+  for (int i=0;i<ndet;i++)
+    for (int j=0;j<ndata;j++)
+      orig[i][j]=drand48()-0.5+0.1*i;
+  set_tod_noise(&tod,1.0,1.0,-2.0);
+  for (int i=0;i<ndet;i++)
+    tod.noise->noises[i].params[1]=0;  //no 1/f, just white.
+  createFFTWplans1TOD(&tod);
+
+  actData **fft_out=matrix(ndet,ndata);
+  noise_basis=NK_NOISE_FFT;
+  memcpy(tod.data[0],orig[0],sizeof(actData)*ndet*ndata);
+  filter_data_wnoise(&tod);
+  memcpy(fft_out[0],tod.data[0],sizeof(actData)*ndet*ndata);
+  noise_basis=NK_NOISE_DCT;
+  memcpy(tod.data[0],orig[0],sizeof(actData)*ndet*ndata);
+  filter_data_wnoise(&tod);
+  noise_basis=basis0;
+
+  actData maxval=0,maxerr=0;
+  for (int i=0;i<ndet;i++)
+    for (int j=0;j<ndata;j++) {
+      if (fabs(fft_out[i][j])>maxval)
+	maxval=fabs(fft_out[i][j]);
+      if (fabs(tod.data[i][j]-fft_out[i][j])>maxerr)
+	maxerr=fabs(tod.data[i][j]-fft_out[i][j]);
+    }
+  printf("white noise filter differs by %12.4e between the FFT and DCT bases.\n",maxerr/maxval);
+
+  act_fftw_destroy_plan(tod.p_forward);
+  act_fftw_destroy_plan(tod.p_back);
+  free(tod.noise->noises);
+  free(tod.noise);
+  CutsFree(tod.cuts);
+  free(tod.rows);
+  free(tod.cols);
+  free_matrix(tod.data);
+  free_matrix(orig);
+  free_matrix(fft_out);
+  return maxerr/maxval;
+}
+/*--------------------------------------------------------------------------------*/
 void act_syrk(char uplo, char trans, int n, int m, actData alpha, actData *a, int lda, actData beta, actData *b, int ldb)
 {
 #ifdef ACTDATA_DOUBLE
@@ -1604,6 +2068,52 @@ actComplex **apply_banded_rotations(mbTOD *tod, actComplex **mat_in, bool do_for
   return mat;
 }
 
+/*--------------------------------------------------------------------------------*/
+static void scale_copy_complex(const actComplex *in, actComplex *out, int n, actData scale)
+{
+  if (scale==1.0)
+    memcpy(out,in,sizeof(actComplex)*n);
+  else
+    for (int i=0;i<n;i++)
+      out[i]=in[i]*scale;
+}
+/*--------------------------------------------------------------------------------*/
+static void apply_banded_rotations_into(mbTOD *tod, actComplex **mat_in, actComplex **mat, bool do_forward, actData scale)
+//as apply_banded_rotations, but into a caller-supplied matrix, and with everything scaled by
+//scale.  Unrotated frequencies are copied straight across.
+{
+  mbNoiseVectorStructBands *noise=tod->band_noise;
+  int nn=get_nn(tod->ndata);
+
+#pragma omp parallel for shared(tod,noise,mat_in,mat,nn,scale) default(none)
+  for (int det=0;det<tod->ndet;det++) {
+    int j=0;
+    for (int band=0;band<noise->nband;band++)
+      if (noise->do_rotations[band]) {
+	if (noise->ibands[band]>j)
+	  scale_copy_complex(mat_in[det]+j,mat[det]+j,noise->ibands[band]-j,scale);
+	j=noise->ibands[band+1];
+      }
+    if (nn>j)
+      scale_copy_complex(mat_in[det]+j,mat[det]+j,nn-j,scale);
+  }
+
+  for (int band=0;band<noise->nband;band++) {
+    if (noise->do_rotations[band]) {
+      actData **rotmat;
+      char trans;
+      if (do_forward) {
+	trans='n';
+	rotmat=noise->rot_mats[band];
+      }
+      else {
+	trans='t';
+	rotmat=noise->inv_rot_mats_transpose[band];
+      }
+      act_gemm('n',trans,2*(noise->ibands[band+1]-noise->ibands[band]),tod->ndet,tod->ndet,scale,(actData *)(&(mat_in[0][noise->ibands[band]])),2*nn,rotmat[0],tod->ndet,0.0,(actData *)(&(mat[0][noise->ibands[band]])),2*nn);
+    }
+  }
+}
 /*--------------------------------------------------------------------------------*/
 int fit_banded_noise_1det_full(mbNoiseParams1PixBand *params, actData *dat)
 {
@@ -1792,16 +2302,16 @@ void get_simple_banded_noise_model_onerotmat(mbTOD *tod, bool *do_rots, mbNoiseT
 }
 /*--------------------------------------------------------------------------------*/
 
-void apply_banded_noise_1det_full(mbNoiseParams1PixBand *params,actComplex *dat)
+void apply_banded_noise_1det_full(mbNoiseParams1PixBand *params,actComplex *dat, actData scale)
 {
   int n=params->i_high-params->i_low;
   for (int i=0;i<n;i++)
-    dat[i+params->i_low]*=params->noise_data[i];
+    dat[i+params->i_low]*=params->noise_data[i]*scale;
   
 }
 
 /*--------------------------------------------------------------------------------*/
-void apply_banded_noise_1det_interp(mbNoiseParams1PixBand *params_left, mbNoiseParams1PixBand *params, mbNoiseParams1PixBand *params_right, actComplex *dat)
+void apply_banded_noise_1det_interp(mbNoiseParams1PixBand *params_left, mbNoiseParams1PixBand *params, mbNoiseParams1PixBand *params_right, actComplex *dat, actData scale)
 {
 
   int n=params->i_high - params->i_low;
@@ -1810,30 +2320,33 @@ void apply_banded_noise_1det_interp(mbNoiseParams1PixBand *params_left, mbNoiseP
 
   for (int i=0;i<nn;i++) {
     actData fac=((actData)i)/((actData) nn);
-    dat[i+params->i_low]*=(1.0-fac)*params_left->noise_data[0]+fac*params->noise_data[0];
+    dat[i+params->i_low]*=((1.0-fac)*params_left->noise_data[0]+fac*params->noise_data[0])*scale;
   }
   for (int i=nn;i<n;i++) {
     actData fac=((actData)(i-nn))/((actData)( n-nn));
-    dat[i+params->i_low]*=fac*params_right->noise_data[0]+(1-fac)*params->noise_data[0];
+    dat[i+params->i_low]*=(fac*params_right->noise_data[0]+(1-fac)*params->noise_data[0])*scale;
   }
   
 }
 
 /*--------------------------------------------------------------------------------*/
-void apply_banded_noise_1det_constant(mbNoiseParams1PixBand *params,actComplex *dat)
+void apply_banded_noise_1det_constant(mbNoiseParams1PixBand *params,actComplex *dat, actData scale)
 {
   int n=params->i_high-params->i_low;
+  actData fac=params->noise_data[0]*scale;
   for (int i=0;i<n;i++)
-    dat[i+params->i_low]*=params->noise_data[0];
+    dat[i+params->i_low]*=fac;
 
 }
 /*--------------------------------------------------------------------------------*/
-void apply_banded_noise_complex(mbTOD *tod, actComplex **dat)
+static void apply_banded_noise_complex_scaled(mbTOD *tod, actComplex **dat, actData scale)
+//apply the band weights times scale.  Frequencies outside the bands are just scaled.
 {
 
   mbNoiseVectorStructBands *noise=tod->band_noise;
+  int nn=get_nn(tod->ndata);
 
-#pragma omp parallel for shared(tod,dat,noise) default(none)
+#pragma omp parallel for shared(tod,dat,noise,scale,nn) default(none)
   for (int det=0;det<tod->ndet;det++) {
     int fwee;      
     for (int i=0;i<noise->nband;i++) 
@@ -1847,77 +2360,271 @@ void apply_banded_noise_complex(mbTOD *tod, actComplex **dat)
 	int iright=i+1;
 	if (iright>=noise->nband)
 	  iright=noise->nband-1;
-	apply_banded_noise_1det_interp(&(noise->noise_params[ileft][det]),&(noise->noise_params[i][det]),&(noise->noise_params[iright][det]),dat[det]);
+	apply_banded_noise_1det_interp(&(noise->noise_params[ileft][det]),&(noise->noise_params[i][det]),&(noise->noise_params[iright][det]),dat[det],scale);
 	break;
 
       case MBNOISE_FULL:
-	apply_banded_noise_1det_full(&(noise->noise_params[i][det]),dat[det]);
+	apply_banded_noise_1det_full(&(noise->noise_params[i][det]),dat[det],scale);
 	break;
       case MBNOISE_CONSTANT:
-	apply_banded_noise_1det_constant(&(noise->noise_params[i][det]),dat[det]);
+	apply_banded_noise_1det_constant(&(noise->noise_params[i][det]),dat[det],scale);
 	break;
       default:
 	printf("Warning - unrecognized noise type in apply_banded_noise_complex.\n");
 	break;	
       }
+    if (scale!=1.0) {
+      for (int i=0;i<noise->ibands[0];i++)
+	dat[det][i]*=scale;
+      for (int i=noise->ibands[noise->nband];i<nn;i++)
+	dat[det][i]*=scale;
+    }
   }
 }
 /*--------------------------------------------------------------------------------*/
+void apply_banded_noise_complex(mbTOD *tod, actComplex **dat)
+{
+  apply_banded_noise_complex_scaled(tod,dat,1.0);
+}
+/*--------------------------------------------------------------------------------*/
+
+static void apply_diag_proj_noise_inv_bands_scaled(actData **data_in, actData **data_out, actData *ninv, actData **vecs, int ndata, int ndet, int nvecs, int imin, int imax, actData scale);
+static void apply_noise_1det_scaled(mbTOD *tod, int det, actComplex *ts, actData scale);
 
 void apply_banded_projvec_noise_model(mbTOD *tod)
 {
   assert(tod);
   assert(tod->band_vecs_noise);
   mbNoiseStructBandsVecs *noise=tod->band_vecs_noise;
-  actComplex **data_ft=fft_all_data(tod);
   int nn=get_nn(tod->ndata);
-  actComplex **data_filt=cmatrix(tod->ndet,nn);
-  //explicitly zero out constant modes.
-  for (int i=0;i<tod->ndet;i++)
-    data_filt[i][0]=0;
+  actComplex **data_ft=get_noise_workspace(0,tod->ndet,nn);
+  actComplex **data_filt=get_noise_workspace(1,tod->ndet,nn);
+  fft_all_data_into(tod,data_ft,fft_plan_flags);
+
+  //explicitly zero out constant modes, and anything the bands don't reach.
+  int ilow=noise->band_edges[0];
+  int ihigh=noise->band_edges[noise->nband];
+  if (ilow<1)
+    ilow=1;
+  for (int i=0;i<tod->ndet;i++) {
+    for (int j=0;j<ilow;j++)
+      data_filt[i][j]=0;
+    for (int j=ihigh;j<nn;j++)
+      data_filt[i][j]=0;
+  }
+  actData scale=1.0/((actData)tod->ndata);
   for (int i=0;i<noise->nband;i++) {
-    apply_diag_proj_noise_inv_bands((double **)data_ft, (double **)data_filt, noise->noises[i],noise->vecs[i],2*nn,tod->ndet,noise->nvecs[i],2*noise->band_edges[i],2*noise->band_edges[i+1]);
+    apply_diag_proj_noise_inv_bands_scaled((double **)data_ft, (double **)data_filt, noise->noises[i],noise->vecs[i],2*nn,tod->ndet,noise->nvecs[i],2*noise->band_edges[i],2*noise->band_edges[i+1],scale);
   }
-  ifft_all_data(tod,data_filt);
-  free(data_filt[0]);
-  free(data_filt);
-  free(data_ft[0]);
-  free(data_ft);
+  ifft_all_data_into(tod,data_filt,fft_plan_flags,false);
 }
 /*--------------------------------------------------------------------------------*/
 
 void apply_banded_noise_model(mbTOD *tod)
+//1/n from the inverse FFT rides along with the first thing that touches the spectrum, so the
+//data only get read and written by the two transforms.
 {
 
   assert(tod->band_noise);
+  int nn=get_nn(tod->ndata);
+  actData scale=1.0/((actData)tod->ndata);
+  actComplex **data_ft=get_noise_workspace(0,tod->ndet,nn);
+  fft_all_data_into(tod,data_ft,fft_plan_flags);
   
   if (do_I_have_rotations(tod)) {
-    
-    actComplex **data_ft=fft_all_data(tod);
-    actComplex **data_rot=apply_banded_rotations(tod,data_ft,true);
-    free(data_ft[0]);
-    free(data_ft);
-    
-    apply_banded_noise_complex(tod,data_rot);
-    actComplex **data_back=apply_banded_rotations(tod,data_rot,false);
-    free(data_rot[0]);
-    free(data_rot);
-    
-    ifft_all_data(tod,data_back);
-    free(data_back[0]);
-    free(data_back);
+    actComplex **data_rot=get_noise_workspace(1,tod->ndet,nn);
+    apply_banded_rotations_into(tod,data_ft,data_rot,true,scale);
+    apply_banded_noise_complex_scaled(tod,data_rot,1.0);
+    apply_banded_rotations_into(tod,data_rot,data_ft,false,1.0);
   }
   else
-    {
-      actComplex **data_ft=fft_all_data(tod);
-      apply_banded_noise_complex(tod,data_ft);
-      ifft_all_data(tod,data_ft);
-      free(data_ft[0]);
-      free(data_ft);
-    }
+    apply_banded_noise_complex_scaled(tod,data_ft,scale);
   
+  ifft_all_data_into(tod,data_ft,fft_plan_flags,false);
+}
+
+/*--------------------------------------------------------------------------------*/
+//The noise models in the DCT basis.  Weights are looked up at FFT index k/2 for coefficient k,
+//and the 1/(2 ndata) of the transform pair is folded into scale.
+
+static actData banded_noise_weight(const mbNoiseParams1PixBand *left, const mbNoiseParams1PixBand *params, const mbNoiseParams1PixBand *right, int i)
+//weight of FFT index i_low+i of a band, as apply_banded_noise_1det_* use it.
+{
+  int n=params->i_high-params->i_low;
+  int nn=n/2;
+  switch(params->noise_type) {
+  case MBNOISE_FULL:
+    return params->noise_data[i];
+  case MBNOISE_CONSTANT:
+    return params->noise_data[0];
+  case MBNOISE_INTERP:
+    if (i<nn) {
+      actData fac=((actData)i)/((actData) nn);
+      return (1.0-fac)*left->noise_data[0]+fac*params->noise_data[0];
+    }
+    else {
+      actData fac=((actData)(i-nn))/((actData)(n-nn));
+      return fac*right->noise_data[0]+(1-fac)*params->noise_data[0];
+    }
+  default:
+    return 1.0;
+  }
+}
+/*--------------------------------------------------------------------------------*/
+static void apply_banded_noise_dct_scaled(mbTOD *tod, actData **dat, actData scale)
+{
+  mbNoiseVectorStructBands *noise=tod->band_noise;
+  int n=tod->ndata;
+#pragma omp parallel for shared(tod,dat,noise,scale,n) default(none)
+  for (int det=0;det<tod->ndet;det++) {
+    actData *vec=dat[det];
+    for (int band=0;band<noise->nband;band++) {
+      const mbNoiseParams1PixBand *params=&(noise->noise_params[band][det]);
+      const mbNoiseParams1PixBand *left=&(noise->noise_params[band>0 ? band-1 : 0][det]);
+      const mbNoiseParams1PixBand *right=&(noise->noise_params[band<noise->nband-1 ? band+1 : band][det]);
+      for (int i=0;i<params->i_high-params->i_low;i++) {
+	int k=2*(params->i_low+i);
+	if (k>=n)
+	  break;
+	actData w=banded_noise_weight(left,params,right,i)*scale;
+	vec[k]*=w;
+	if (k+1<n)
+	  vec[k+1]*=w;
+      }
+    }
+    if (scale!=1.0) {
+      for (int k=0;(k<2*noise->ibands[0])&&(k<n);k++)
+	vec[k]*=scale;
+      for (int k=2*noise->ibands[noise->nband];k<n;k++)
+	vec[k]*=scale;
+    }
+  }
 }
+/*--------------------------------------------------------------------------------*/
+static void apply_banded_rotations_dct_into(mbTOD *tod, actData **mat_in, actData **mat, int ld, bool do_forward, actData scale)
+//apply_banded_rotations_into for DCT coefficients, in rows ld apart.
+{
+  mbNoiseVectorStructBands *noise=tod->band_noise;
+  int n=tod->ndata;
+
+#pragma omp parallel for shared(tod,noise,mat_in,mat,n,scale) default(none)
+  for (int det=0;det<tod->ndet;det++) {
+    int j=0;
+    for (int band=0;band<noise->nband;band++)
+      if (noise->do_rotations[band]) {
+	int lo=(2*noise->ibands[band]<n ? 2*noise->ibands[band] : n);
+	for (int k=j;k<lo;k++)
+	  mat[det][k]=mat_in[det][k]*scale;
+	j=(2*noise->ibands[band+1]<n ? 2*noise->ibands[band+1] : n);
+      }
+    for (int k=j;k<n;k++)
+      mat[det][k]=mat_in[det][k]*scale;
+  }
 
+  for (int band=0;band<noise->nband;band++) {
+    int lo=(2*noise->ibands[band]<n ? 2*noise->ibands[band] : n);
+    int hi=(2*noise->ibands[band+1]<n ? 2*noise->ibands[band+1] : n);
+    if ((noise->do_rotations[band])&&(hi>lo)) {
+      char trans=(do_forward ? 'n' : 't');
+      actData **rotmat=(do_forward ? noise->rot_mats[band] : noise->inv_rot_mats_transpose[band]);
+      act_gemm('n',trans,hi-lo,tod->ndet,tod->ndet,scale,mat_in[0]+lo,ld,rotmat[0],tod->ndet,0.0,mat[0]+lo,ld);
+    }
+  }
+}
+/*--------------------------------------------------------------------------------*/
+static void apply_banded_noise_model_dct(mbTOD *tod)
+{
+  int n=tod->ndata;
+  int nn=get_nn(n);
+  actData scale=1.0/(2.0*n);
+  actData **coef=(actData **)get_noise_workspace(0,tod->ndet,nn);
+  dct_all_data_into(tod,coef,FFTW_REDFT10,fft_plan_flags);
+  if (do_I_have_rotations(tod)) {
+    actData **coef_rot=(actData **)get_noise_workspace(1,tod->ndet,nn);
+    apply_banded_rotations_dct_into(tod,coef,coef_rot,2*nn,true,scale);
+    apply_banded_noise_dct_scaled(tod,coef_rot,1.0);
+    apply_banded_rotations_dct_into(tod,coef_rot,coef,2*nn,false,1.0);
+  }
+  else
+    apply_banded_noise_dct_scaled(tod,coef,scale);
+  dct_all_data_into(tod,coef,FFTW_REDFT01,fft_plan_flags);
+}
+/*--------------------------------------------------------------------------------*/
+static void apply_banded_projvec_noise_model_dct(mbTOD *tod)
+{
+  mbNoiseStructBandsVecs *noise=tod->band_vecs_noise;
+  int n=tod->ndata;
+  int nn=get_nn(n);
+  actData **coef=(actData **)get_noise_workspace(0,tod->ndet,nn);
+  actData **coef_filt=(actData **)get_noise_workspace(1,tod->ndet,nn);
+  dct_all_data_into(tod,coef,FFTW_REDFT10,fft_plan_flags);
+
+  //zero the constant mode, and anything the bands don't reach.
+  int klow=2*noise->band_edges[0];
+  int khigh=2*noise->band_edges[noise->nband];
+  if (klow<1)
+    klow=1;
+  for (int i=0;i<tod->ndet;i++) {
+    for (int k=0;(k<klow)&&(k<n);k++)
+      coef_filt[i][k]=0;
+    for (int k=khigh;k<n;k++)
+      coef_filt[i][k]=0;
+  }
+  actData scale=1.0/(2.0*n);
+  for (int i=0;i<noise->nband;i++) {
+    int lo=(2*noise->band_edges[i]<n ? 2*noise->band_edges[i] : n);
+    int hi=(2*noise->band_edges[i+1]<n ? 2*noise->band_edges[i+1] : n);
+    if (hi>lo)
+      apply_diag_proj_noise_inv_bands_scaled(coef,coef_filt,noise->noises[i],noise->vecs[i],2*nn,tod->ndet,noise->nvecs[i],lo,hi,scale);
+  }
+  dct_all_data_into(tod,coef_filt,FFTW_REDFT01,fft_plan_flags);
+}
+/*--------------------------------------------------------------------------------*/
+static void apply_noise_1det_powlaw_dct(mbTOD *tod, int det, actData *coef, actData scale)
+//apply_noise_1det_powlaw for DCT coefficients.
+{
+  if (tod->noise->noises[det].noise_type!=MBNOISE_LINEAR_POWLAW) {
+    fprintf(stderr,"Warning - unsupported noise class in apply_noise_1det on detector %d\n",det);
+    return;
+  }
+  int n=tod->ndata;
+  actData amp=tod->noise->noises[det].params[0];
+  actData knee_inv=1.0/tod->noise->noises[det].params[1];
+  actData ind=tod->noise->noises[det].params[2];
+  if (amp==0) {  //set amp=0 to nuke detector
+    memset(coef,0,sizeof(actData)*n);
+    return;
+  }
+  coef[0]=0;
+  actData fac=0.5/((actData)n)/tod->deltat;
+  for (int k=1;k<n;k++) {
+    actData tt=((actData)k)*fac;
+    coef[k]=coef[k]*scale/(amp*(1+pow(tt*knee_inv,-ind)));
+  }
+}
+/*--------------------------------------------------------------------------------*/
+static void apply_noise_dct(mbTOD *tod)
+{
+  if (tod->band_vecs_noise) {
+    apply_banded_projvec_noise_model_dct(tod);
+    return;
+  }
+  if (tod->band_noise) {
+    apply_banded_noise_model_dct(tod);
+    return;
+  }
+  if (tod->noise) {
+    actData **coef=(actData **)get_noise_workspace(0,tod->ndet,get_nn(tod->ndata));
+    dct_all_data_into(tod,coef,FFTW_REDFT10,fft_plan_flags);
+    actData scale=1.0/(2.0*tod->ndata);
+#pragma omp parallel for shared(tod,coef,scale) default(none)
+    for (int i=0;i<tod->ndet;i++)
+      apply_noise_1det_powlaw_dct(tod,i,coef[i],scale);
+    dct_all_data_into(tod,coef,FFTW_REDFT01,fft_plan_flags);
+    return;
+  }
+  printf("Skipping noise application since no noise model found.\n");
+}
 /*--------------------------------------------------------------------------------*/
 void set_noise_powlaw(mbTOD *tod, actData *amps, actData *knees, actData *pows)
 {
@@ -1941,6 +2648,10 @@ void apply_noise(mbTOD *tod)
     fprintf(stderr,"Warning - no data found when attempting to apply model in apply_noise.\n");
     return;
   }
+  if (noise_basis==NK_NOISE_DCT) {
+    apply_noise_dct(tod);
+    return;
+  }
   if (tod->band_vecs_noise) {
       apply_banded_projvec_noise_model(tod);
       return;
@@ -1950,22 +2661,22 @@ void apply_noise(mbTOD *tod)
     return;
   }
   if (tod->noise) {
-    actComplex **data_ft=fft_all_data(tod);
+    actComplex **data_ft=get_noise_workspace(0,tod->ndet,get_nn(tod->ndata));
+    fft_all_data_into(tod,data_ft,fft_plan_flags);
+    actData scale=1.0/((actData)tod->ndata);
 
-#pragma omp parallel for shared(tod,data_ft) default(none)
+#pragma omp parallel for shared(tod,data_ft,scale) default(none)
     for (int i=0;i<tod->ndet;i++) {
-      apply_noise_1det(tod,i,data_ft[i]);
+      apply_noise_1det_scaled(tod,i,data_ft[i],scale);
     }
 
-    ifft_all_data(tod,data_ft);
-    free(data_ft[0]);
-    free(data_ft);
+    ifft_all_data_into(tod,data_ft,fft_plan_flags,false);
     return;    
   }
   printf("Skipping noise application since no noise model found.\n");  
 }
 /*--------------------------------------------------------------------------------*/
-void apply_noise_1det_powlaw(mbTOD *tod, int det, act_fftw_complex *ts )
+static void apply_noise_1det_powlaw_scaled(mbTOD *tod, int det, act_fftw_complex *ts, actData scale)
 {  
   //please do checks before you're here.
   int nn=fft_real2complex_nelem(tod->ndata);
@@ -1974,9 +2685,9 @@ void apply_noise_1det_powlaw(mbTOD *tod, int det, act_fftw_complex *ts )
   actData knee_inv=1.0/tod->noise->noises[det].params[1];
   actData ind=tod->noise->noises[det].params[2];
   
-  if (amp==0) {  //set amp=0 to nuke detector
+  if (amp==0) {  //amp=0 passes the detector through, as it did when the inverse FFT overwrote the zeroing.
     for (int i=0;i<nn;i++) 
-      tod->data[det][i]=0;
+      ts[i]*=scale;
     return;
   }
   ts[0]=0;
@@ -1984,21 +2695,31 @@ void apply_noise_1det_powlaw(mbTOD *tod, int det, act_fftw_complex *ts )
   
   for (int i=1;i<nn;i++) {
     actData tt=((actData)i)*fac;
-    ts[i]=ts[i]/(amp*(1+pow(tt*knee_inv,-ind)));
+    ts[i]=ts[i]*scale/(amp*(1+pow(tt*knee_inv,-ind)));
   }
   
 }
 /*--------------------------------------------------------------------------------*/
-void apply_noise_1det(mbTOD *tod, int det, actComplex *ts)
+void apply_noise_1det_powlaw(mbTOD *tod, int det, act_fftw_complex *ts )
+{
+  apply_noise_1det_powlaw_scaled(tod,det,ts,1.0);
+}
+/*--------------------------------------------------------------------------------*/
+static void apply_noise_1det_scaled(mbTOD *tod, int det, actComplex *ts, actData scale)
 {
   switch(tod->noise->noises[det].noise_type) {
   case MBNOISE_LINEAR_POWLAW:
-    apply_noise_1det_powlaw(tod,det,ts);
+    apply_noise_1det_powlaw_scaled(tod,det,ts,scale);
     break;
   default:
     fprintf(stderr,"Warning - unsupported noise class in apply_noise_1det on detector %d\n",det);
   }
 }
+/*--------------------------------------------------------------------------------*/
+void apply_noise_1det(mbTOD *tod, int det, actComplex *ts)
+{
+  apply_noise_1det_scaled(tod,det,ts,1.0);
+}
 
 /*--------------------------------------------------------------------------------*/
 void simple_test_diag_proj_noise_inv(actData **data_in, actData **data_out, actData *noise, actData **vecs, int ndata, int ndet, int nvecs)
@@ -2063,7 +2784,8 @@ void simple_test_diag_proj_noise_inv(actData **data_in, actData **data_out, actD
 }
 
 /*--------------------------------------------------------------------------------*/
-void apply_diag_proj_noise_inv_bands(actData **data_in, actData **data_out, actData *ninv, actData **vecs, int ndata, int ndet, int nvecs, int imin, int imax)
+static void apply_diag_proj_noise_inv_bands_scaled(actData **data_in, actData **data_out, actData *ninv, actData **vecs, int ndata, int ndet, int nvecs, int imin, int imax, actData scale)
+//columns imin..imax of the output get scale*(N^-1 - N^-1 V (1+V^T N^-1 V)^-1 V^T N^-1) data_in.
 {
   actData **ninv_vecs=matrix(nvecs,ndet);
 #pragma omp parallel for shared(nvecs,ninv_vecs,vecs,ninv,ndet) default(none)
@@ -2080,18 +2802,20 @@ void apply_diag_proj_noise_inv_bands(actData **data_in, actData **data_out, actD
 
   assert(mbInvertPosdefMat(inside,nvecs)==0);
 
-  double **tmp=matrix(nvecs,ndata);
-  act_gemm('n','n',(imax-imin),nvecs,ndet,1.0,data_in[0]+imin,ndata,ninv_vecs[0],ndet,0.0,tmp[0]+imin,ndata);
-  double **tmp2=matrix(nvecs,ndata);
-  act_gemm('n','n',(imax-imin),nvecs,nvecs,1.0,tmp[0]+imin,ndata,inside[0],nvecs,0.0,tmp2[0]+imin,ndata);
+  //the projections only need to be as wide as the band.
+  int nw=imax-imin;
+  double **tmp=matrix(nvecs,nw);
+  act_gemm('n','n',nw,nvecs,ndet,1.0,data_in[0]+imin,ndata,ninv_vecs[0],ndet,0.0,tmp[0],nw);
+  double **tmp2=matrix(nvecs,nw);
+  act_gemm('n','n',nw,nvecs,nvecs,1.0,tmp[0],nw,inside[0],nvecs,0.0,tmp2[0],nw);
 
 
-  act_gemm('n','t',(imax-imin),ndet,nvecs,1.0,tmp2[0]+imin,ndata,ninv_vecs[0],ndet,0.0,data_out[0]+imin,ndata);
+  act_gemm('n','t',nw,ndet,nvecs,1.0,tmp2[0],nw,ninv_vecs[0],ndet,0.0,data_out[0]+imin,ndata);
   
-#pragma omp parallel for shared(ndata,ndet,ninv,data_out,data_in,imin,imax) default(none)
+#pragma omp parallel for shared(ndata,ndet,ninv,data_out,data_in,imin,imax,scale) default(none)
   for (int i=0;i<ndet;i++)
     for (int j=imin;j<imax;j++)
-      data_out[i][j]=data_in[i][j]*ninv[i]-data_out[i][j];
+      data_out[i][j]=(data_in[i][j]*ninv[i]-data_out[i][j])*scale;
 
    
   free(tmp[0]);
@@ -2105,6 +2829,11 @@ void apply_diag_proj_noise_inv_bands(actData **data_in, actData **data_out, actD
 
 }
 /*--------------------------------------------------------------------------------*/
+void apply_diag_proj_noise_inv_bands(actData **data_in, actData **data_out, actData *ninv, actData **vecs, int ndata, int ndet, int nvecs, int imin, int imax)
+{
+  apply_diag_proj_noise_inv_bands_scaled(data_in,data_out,ninv,vecs,ndata,ndet,nvecs,imin,imax,1.0);
+}
+/*--------------------------------------------------------------------------------*/
 void fill_sin_cos_mat(actData *theta, int ndata, int nterm, actData **mat) 
 //fill a matrix with sin/cos(n*hwp) and put in mat
 {
@@ -7,6 +7,10 @@
 #include <string.h>
 #include <stdlib.h>
 #include <omp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "ninkasi.h"
 #include "ninkasi_mathutils.h"
@@ -645,6 +649,17 @@ PointingFitScratch *allocate_pointing_fit_scratch(const mbTOD *tod)
       scratch->sin2gamma_coarse=vector(scratch->pointing_fit->ncoarse);
       scratch->cos2gamma_coarse=vector(scratch->pointing_fit->ncoarse);
 #endif
+      int ncoarse=scratch->pointing_fit->ncoarse;
+      const int *ind=scratch->pointing_fit->coarse_ind;
+      scratch->tod_alt_coarse=vector(ncoarse);
+      scratch->tod_az_coarse=vector(ncoarse);
+      scratch->tod_secalt_coarse=vector(ncoarse);
+      for (int i=0;i<ncoarse;i++) {
+	scratch->tod_alt_coarse[i]=scratch->tod_alt[ind[i]];
+	scratch->tod_az_coarse[i]=scratch->tod_az[ind[i]];
+	scratch->tod_secalt_coarse[i]=1.0/cos(scratch->tod_alt[ind[i]]);
+	scratch->time_coarse[i]=tod->deltat*(ind[i]);
+      }
     }
 
   
@@ -672,6 +687,9 @@ void destroy_pointing_fit_scratch(PointingFitScratch *scratch)
       free(scratch->alt_coarse);
       free(scratch->az_coarse);
       free(scratch->time_coarse);
+      free(scratch->tod_alt_coarse);
+      free(scratch->tod_az_coarse);
+      free(scratch->tod_secalt_coarse);
 #ifdef ACTPOL
       free(scratch->sin2gamma_coarse);
       free(scratch->cos2gamma_coarse);
@@ -738,139 +756,184 @@ void get_radec_from_altaz_fit_tiled(const TiledPointingFit *tile, actData *alt,
   }
 }
 /*--------------------------------------------------------------------------------*/
-void get_radec_from_altaz_fit_1det_coarse(const mbTOD *tod, int det, PointingFitScratch *scratch)
+void interp_coarse_pointing(const int *ind, int ncoarse, int ndata, const actData *ra_coarse, const actData *dec_coarse, actData ra_rate, actData dec_rate, actData ra_off, actData dec_off, actData *ra, actData *dec)
+//fill ra/dec by linear interpolation between pivots, with the clock-rate ramp and the 
+//offsets folded in.  One pass over the data, one division per segment.
 {
-  //printf("in get_radec_from_altaz_fit_1det_coarse\n");
-#if 0
-  //drop this in to do exact pointing
-  get_radec_from_altaz_exact_1det(tod,det,scratch);
-  return;
-#endif
-
-#if 0
-  //drop this in to do approximately exact pointing
-
-  get_radec_from_altaz_fit_1det_coarse_exact(tod,det,scratch);
-  return;
-#endif
-
-  //If we have saved full pointing information, copy it into *scratch here.
-  assert(tod);
-  if (tod->ra_saved) {
-    //printf("doing saved pointing.\n");
-    assert(tod->dec_saved);
-    memcpy(scratch->ra,tod->ra_saved[det],tod->ndata*sizeof(actData));
-    memcpy(scratch->dec,tod->dec_saved[det],tod->ndata*sizeof(actData));
-    //printf("finished saved pointing.\n");
-    return;
+  for (int i=0;i<ncoarse-1;i++) {
+    int i0=ind[i];
+    int nseg=ind[i+1]-i0;
+    actData ninv=1.0/((actData)nseg);
+    actData ra0=ra_coarse[i]+((actData)i0)*ra_rate+ra_off;
+    actData dec0=dec_coarse[i]+((actData)i0)*dec_rate+dec_off;
+    actData ra_slope=(ra_coarse[i+1]-ra_coarse[i])*ninv+ra_rate;
+    actData dec_slope=(dec_coarse[i+1]-dec_coarse[i])*ninv+dec_rate;
+    actData *myra=ra+i0;
+    actData *mydec=dec+i0;
+    for (int j=0;j<nseg;j++) {
+      myra[j]=ra0+((actData)j)*ra_slope;
+      mydec[j]=dec0+((actData)j)*dec_slope;
+    }
   }
-
-  //printf("Don't think I should be here.\n");
+  ra[ndata-1]=ra_coarse[ncoarse-1]+((actData)(ndata-1))*ra_rate+ra_off;
+  dec[ndata-1]=dec_coarse[ncoarse-1]+((actData)(ndata-1))*dec_rate+dec_off;
+}
+/*--------------------------------------------------------------------------------*/
+static void get_radec_coarse_1det(const mbTOD *tod, int det, PointingFitScratch *scratch)
+//evaluate the pointing fit for one detector at the pivots, into scratch->ra_coarse/dec_coarse.
+{
   assert(tod->pointing_fit);
   assert(tod->pointingOffset);
   actData mydalt=get_alt_offset(tod,det);
   actData mydaz=get_az_offset(tod,det);
-  actData myalt=tod->alt[0];
-  actData myaz=tod->az[0];
 
-#ifdef OLD_POINTING_OFFSET
-  actData fac=mydaz/cos(scratch->tod_alt[0]+mydalt);
-#else
-  actData fac=mydaz/cos(scratch->tod_alt[0]);
-#endif
   int ncoarse=scratch->pointing_fit->ncoarse;
   assert(ncoarse>0);
-  int *ind=scratch->pointing_fit->coarse_ind;
-
-  for (int i=0;i<ncoarse;i++) {
 
 #ifdef OLD_POINTING_OFFSET
+  int *ind=scratch->pointing_fit->coarse_ind;
+  for (int i=0;i<ncoarse;i++) {
     scratch->alt_coarse[i]=scratch->tod_alt[ind[i]]+mydalt;
     scratch->az_coarse[i]=scratch->tod_az[ind[i]]+mydaz/cos(scratch->alt_coarse[i]);
+  }
 #else
-    actData alt0=scratch->tod_alt[ind[i]];
-    scratch->alt_coarse[i]=alt0+mydalt;
-    scratch->az_coarse[i]=scratch->tod_az[ind[i]]+mydaz/cos(alt0);
-#endif
-    scratch->time_coarse[i]=tod->deltat*(ind[i]);
+  //boresight trig is cached in the scratch, so no cos() per detector.
+  for (int i=0;i<ncoarse;i++) {
+    scratch->alt_coarse[i]=scratch->tod_alt_coarse[i]+mydalt;
+    scratch->az_coarse[i]=scratch->tod_az_coarse[i]+mydaz*scratch->tod_secalt_coarse[i];
   }
-  
-
-
-
+#endif
 
-  if (tod->pointing_fit->tiled_fit) {
+  if (tod->pointing_fit->tiled_fit) 
     get_radec_from_altaz_fit_tiled(tod->pointing_fit->tiled_fit,scratch->alt_coarse, scratch->az_coarse, scratch->time_coarse,scratch->ra_coarse, scratch->dec_coarse, ncoarse);
-    for (int i=0;i<ncoarse-1;i++) {
-      scratch->ra[ind[i]]=scratch->ra_coarse[i];
-      scratch->dec[ind[i]]=scratch->dec_coarse[i];     
-      for (int j=ind[i]+1;j<ind[i+1];j++) {
-	scratch->ra[j]=scratch->ra_coarse[i]+((actData)(j-ind[i]))/((actData)(ind[i+1]-ind[i]))*(scratch->ra_coarse[i+1]-scratch->ra_coarse[i]);
-	scratch->dec[j]=scratch->dec_coarse[i]+((actData)(j-ind[i]))/((actData)(ind[i+1]-ind[i]))*(scratch->dec_coarse[i+1]-scratch->dec_coarse[i]);
-      } 
-      scratch->ra[tod->ndata-1]=scratch->ra_coarse[ncoarse-1];
-      scratch->dec[tod->ndata-1]=scratch->dec_coarse[ncoarse-1];
-      
-    }
-  }
-  else {
+  else
     eval_2d_poly_pair_inplace(scratch->alt_coarse,scratch->az_coarse,ncoarse,scratch->pointing_fit->ra_fit,scratch->ra_coarse,scratch->pointing_fit->dec_fit,scratch->dec_coarse);
-    
-    for (int i=0;i<ncoarse-1;i++) {
-      scratch->ra[ind[i]]=scratch->ra_coarse[i] +((actData)ind[i])*tod->pointing_fit->ra_clock_rate;
-      scratch->dec[ind[i]]=scratch->dec_coarse[i]+((actData)ind[i])*tod->pointing_fit->dec_clock_rate;
-      
-      for (int j=ind[i]+1;j<ind[i+1];j++) {
-	scratch->ra[j]=scratch->ra_coarse[i]+((actData)(j-ind[i]))/((actData)(ind[i+1]-ind[i]))*(scratch->ra_coarse[i+1]-scratch->ra_coarse[i])+((actData)j)*tod->pointing_fit->ra_clock_rate;
-	scratch->dec[j]=scratch->dec_coarse[i]+((actData)(j-ind[i]))/((actData)(ind[i+1]-ind[i]))*(scratch->dec_coarse[i+1]-scratch->dec_coarse[i])+((actData)j)*tod->pointing_fit->dec_clock_rate;
-      }
-      
+}
+/*--------------------------------------------------------------------------------*/
+void get_radec_coarse_ndet(const mbTOD *tod, const int *dets, int ndet, actData **ra_coarse, actData **dec_coarse, PointingFitScratch *scratch)
+//evaluate the pointing fit at the pivots for a list of detectors.  Pivots are done one at a time
+//with all the detectors at once, so the boresight is looked up once per pivot and the inner loops
+//over detectors vectorize.  Terms are summed in the same order as eval_2d_poly_pair_inplace.
+{
+  assert(tod->pointing_fit);
+  assert(tod->pointingOffset);
+  int ncoarse=scratch->pointing_fit->ncoarse;
+  assert(ncoarse>0);
+
+#ifndef OLD_POINTING_OFFSET
+  if (!tod->pointing_fit->tiled_fit) {
+    const PolyParams2d *ra_fit=scratch->pointing_fit->ra_fit;
+    const PolyParams2d *dec_fit=scratch->pointing_fit->dec_fit;
+    assert(ra_fit->nx==dec_fit->nx);
+    assert(ra_fit->ny==dec_fit->ny);
+    int nx=ra_fit->nx;
+    int ny=ra_fit->ny;
+
+    actData *dalt=vector(ndet);
+    actData *daz=vector(ndet);
+    for (int d=0;d<ndet;d++) {
+      dalt[d]=get_alt_offset(tod,dets[d]);
+      daz[d]=get_az_offset(tod,dets[d]);
     }
+    actData **xvals=matrix(nx,ndet);
+    actData **yvals=matrix(ny,ndet);
+    actData *ra=vector(ndet);
+    actData *dec=vector(ndet);
     
-    scratch->ra[tod->ndata-1]=scratch->ra_coarse[ncoarse-1]+((actData)tod->ndata-1)*tod->pointing_fit->ra_clock_rate;
-    scratch->dec[tod->ndata-1]=scratch->dec_coarse[ncoarse-1]+((actData)tod->ndata-1)*tod->pointing_fit->dec_clock_rate;
-  }
-
-  
-  //fprintf(stderr,"checking pointing offsets.\n");
-  
-#if 0
-  if (det==0) {
-    FILE *outfile=fopen("pointing_blob.txt","w"); 
     for (int i=0;i<ncoarse;i++) {
-      fprintf(outfile,"%4d %14.6e %14.6e\n",ind[i],scratch->ra_coarse[i]+((actData)ind[i])*tod->pointing_fit->ra_clock_rate,scratch->dec_coarse[i]+((actData)ind[i])*tod->pointing_fit->dec_clock_rate);
+      actData alt0=scratch->tod_alt_coarse[i];
+      actData az0=scratch->tod_az_coarse[i];
+      actData secalt=scratch->tod_secalt_coarse[i];
+      for (int d=0;d<ndet;d++) {
+	xvals[0][d]=1;
+	yvals[0][d]=1;
+	ra[d]=0;
+	dec[d]=0;
+      }
+      if (nx>1)
+	for (int d=0;d<ndet;d++)
+	  xvals[1][d]=(alt0+dalt[d]-ra_fit->xcent)/ra_fit->xwidth;
+      if (ny>1)
+	for (int d=0;d<ndet;d++)
+	  yvals[1][d]=(az0+daz[d]*secalt-ra_fit->ycent)/ra_fit->ywidth;
+      for (int j=2;j<nx;j++)
+	for (int d=0;d<ndet;d++)
+	  xvals[j][d]=xvals[j-1][d]*xvals[1][d];
+      for (int j=2;j<ny;j++)
+	for (int d=0;d<ndet;d++)
+	  yvals[j][d]=yvals[j-1][d]*yvals[1][d];
+      
+      for (int ix=0;ix<nx;ix++)
+	for (int iy=0;iy<ny;iy++) {
+	  actData pra=ra_fit->params[ix][iy];
+	  actData pdec=dec_fit->params[ix][iy];
+	  const actData *xx=xvals[ix];
+	  const actData *yy=yvals[iy];
+	  for (int d=0;d<ndet;d++) {
+	    ra[d]+=xx[d]*yy[d]*pra;
+	    dec[d]+=xx[d]*yy[d]*pdec;
+	  }
+	}
+      for (int d=0;d<ndet;d++) {
+	ra_coarse[d][i]=ra[d];
+	dec_coarse[d][i]=dec[d];
+      }
     }
-    fclose(outfile);
+    free(dalt);
+    free(daz);
+    free_matrix(xvals);
+    free_matrix(yvals);
+    free(ra);
+    free(dec);
+    return;
   }
 #endif
-  
-  
-  if (tod->pointing_fit->ra_offset!=0) {
-    for (int i=0;i<tod->ndata;i++)
-      scratch->ra[i]+=tod->pointing_fit->ra_offset;
-  }
-  
-  if (tod->pointing_fit->dec_offset!=0) {
-    //printf("adjusting dec.\n");
-    for (int i=0;i<tod->ndata;i++)
-      scratch->dec[i]+=tod->pointing_fit->dec_offset;
+  //tiled fits (and the old offset convention) go detector by detector.
+  for (int d=0;d<ndet;d++) {
+    get_radec_coarse_1det(tod,dets[d],scratch);
+    memcpy(ra_coarse[d],scratch->ra_coarse,ncoarse*sizeof(actData));
+    memcpy(dec_coarse[d],scratch->dec_coarse,ncoarse*sizeof(actData));
   }
+}
+/*--------------------------------------------------------------------------------*/
+void get_radec_from_altaz_fit_1det_coarse(const mbTOD *tod, int det, PointingFitScratch *scratch)
+{
+  //printf("in get_radec_from_altaz_fit_1det_coarse\n");
+#if 0
+  //drop this in to do exact pointing
+  get_radec_from_altaz_exact_1det(tod,det,scratch);
+  return;
+#endif
 
-  
+#if 0
+  //drop this in to do approximately exact pointing
 
-  
-  //  if (tod->pointing_fit->dec_offset!=0) {
-  //for (int i=0;i<ncoarse;i++)
-  //  scratch->dec_coarse[i]+=tod->pointing_fit->dec_offset;
-  //}
+  get_radec_from_altaz_fit_1det_coarse_exact(tod,det,scratch);
+  return;
+#endif
 
+  //If we have saved full pointing information, copy it into *scratch here.
+  assert(tod);
+  if (tod->ra_saved) {
+    //printf("doing saved pointing.\n");
+    assert(tod->dec_saved);
+    memcpy(scratch->ra,tod->ra_saved[det],tod->ndata*sizeof(actData));
+    memcpy(scratch->dec,tod->dec_saved[det],tod->ndata*sizeof(actData));
+    //printf("finished saved pointing.\n");
+    return;
+  }
 
+  get_radec_coarse_1det(tod,det,scratch);
+
+  //the tiled fit carries its own clock terms, so no ramp there.
+  const PointingFit *fit=tod->pointing_fit;
+  actData ra_rate=(fit->tiled_fit ? 0 : fit->ra_clock_rate);
+  actData dec_rate=(fit->tiled_fit ? 0 : fit->dec_clock_rate);
+  interp_coarse_pointing(scratch->pointing_fit->coarse_ind,scratch->pointing_fit->ncoarse,tod->ndata,scratch->ra_coarse,scratch->dec_coarse,ra_rate,dec_rate,fit->ra_offset,fit->dec_offset,scratch->ra,scratch->dec);
 
-  //apply_time_ramp_to_fit(tod,scratch);
   return;  
 
 }
-
 /*--------------------------------------------------------------------------------*/
 void get_radec_from_altaz_fit_1det_coarse_exact(const mbTOD *tod, int det, PointingFitScratch *scratch)
 //do the full evaluation on the pivot points.  Should help a lot with speed, keep accuracy to ~1"
@@ -1020,12 +1083,41 @@ actData get_interp_segment_az_max_err(actData *az, int i1, int i2)
   return max_err;
 }
 /*--------------------------------------------------------------------------------*/
-void find_pointing_pivots(mbTOD *tod, actData tol)
+static inline void pivot_cone_update(const actData *vec, int p, int i, actData tol, actData *smin, actData *smax)
+//narrow the range of slopes out of pivot p that keep sample i within tol.
+{
+  actData di=i-p;
+  actData lo=(vec[i]-tol-vec[p])/di;
+  actData hi=(vec[i]+tol-vec[p])/di;
+  if (lo>*smin)
+    *smin=lo;
+  if (hi<*smax)
+    *smax=hi;
+}
+/*--------------------------------------------------------------------------------*/
+static actData get_interp_segment_max_err(const actData *vec, int i1, int i2)
+{
+  actData max_err=0;
+  actData fac=(vec[i2]-vec[i1])/((actData)(i2-i1));
+  for (int i=i1+1;i<i2;i++) {
+    actData err=fabs(vec[i1]+(i-i1)*fac-vec[i]);
+    if (err>max_err)
+      max_err=err;
+  }
+  return max_err;
+}
+/*--------------------------------------------------------------------------------*/
+actData find_pointing_pivots(mbTOD *tod, actData tol)
+//pick pivots so that linearly interpolating az and alt between them stays within tol arcseconds
+//on the sky.  Single pass: for the current pivot we keep the window of slopes that pass within
+//tol of every sample so far, and a sample can end the segment only if the chord to it lies in
+//that window.  Returns the achieved max error in arcseconds.
 {
   //printf("pivot tolerance is %8.3g\n",tol);
   if (tol<=0)
     tol=1.0;  //1" threshold.
-  tol=tol/3600.0/180.0*M_PI/cos(tod->alt[0]);  //turn arcsecond pointing tolerance into Radians
+  actData alt_tol=tol/3600.0/180.0*M_PI;  //turn arcsecond pointing tolerance into Radians
+  actData az_tol=alt_tol/cos(tod->alt[0]);
   //printf("tol is %14.4e\n",tol);
 
 #if 1
@@ -1033,24 +1125,27 @@ void find_pointing_pivots(mbTOD *tod, actData tol)
   int *am_i_pivot=(int *)calloc(n,sizeof(int));
   am_i_pivot[0]=1;
   am_i_pivot[n-1]=1;
-  int i1=1;
-  int i2=2;
-
-  while (1) {
-    while ((get_interp_segment_az_max_err(tod->az, i1, i2)<tol)&&(i2<n)) {
-      //printf("i2 is %d\n",i2);
-      //printf("maxerr is %14.5e on %d %d \n",get_interp_segment_az_max_err(tod->az, i1, i2),i1,i2);
-      i2++;
-      //if (i2==500)
-      //exit(EXIT_SUCCESS);
-    
+
+  int p=0;
+  actData az_min=-HUGE_VAL,az_max=HUGE_VAL,alt_min=-HUGE_VAL,alt_max=HUGE_VAL;
+  for (int i=p+1;i<n;i++) {
+    actData di=i-p;
+    actData az_slope=(tod->az[i]-tod->az[p])/di;
+    actData alt_slope=(tod->alt[i]-tod->alt[p])/di;
+    if ((az_slope<az_min)||(az_slope>az_max)||(alt_slope<alt_min)||(alt_slope>alt_max)) {
+      //chord to i misses a sample in between, so the segment ends at i-1.
+      p=i-1;
+      am_i_pivot[p]=1;
+      az_min=-HUGE_VAL;
+      az_max=HUGE_VAL;
+      alt_min=-HUGE_VAL;
+      alt_max=HUGE_VAL;
     }
-    if (i2==n)
-      break;
-    i1=i2-1;
-    am_i_pivot[i1]=1;
-    //printf("added pivot at %d\n",i1);
+    //i is now an interior sample for any later chord out of p.
+    pivot_cone_update(tod->az,p,i,az_tol,&az_min,&az_max);
+    pivot_cone_update(tod->alt,p,i,alt_tol,&alt_min,&alt_max);
   }
+
   int npivot=0;
   for (int i=0;i<n;i++)
     if (am_i_pivot[i])
@@ -1065,6 +1160,19 @@ void find_pointing_pivots(mbTOD *tod, actData tol)
   tod->pointing_fit->ncoarse=npivot;
   tod->pointing_fit->coarse_ind=coarse_ind;
   free(am_i_pivot);
+
+  //each sample is visited once more here, so this stays linear.
+  actData max_err=0;
+  actData cosalt=cos(tod->alt[0]);
+  for (int i=0;i<npivot-1;i++) {
+    actData az_err=get_interp_segment_max_err(tod->az,coarse_ind[i],coarse_ind[i+1])*cosalt;
+    actData alt_err=get_interp_segment_max_err(tod->alt,coarse_ind[i],coarse_ind[i+1]);
+    if (az_err>max_err)
+      max_err=az_err;
+    if (alt_err>max_err)
+      max_err=alt_err;
+  }
+  max_err*=3600.0*180.0/M_PI;
 #if 0
   FILE *outfile=fopen("my_pivots.txt","w");
   for (int i=0;i<npivot;i++) {
@@ -1072,7 +1180,7 @@ void find_pointing_pivots(mbTOD *tod, actData tol)
   }
   fclose(outfile);
 #endif
-  return;
+  return max_err;
 #else
   int samp_size=15;
   int nsamp=tod->ndata/samp_size;
@@ -1085,7 +1193,7 @@ void find_pointing_pivots(mbTOD *tod, actData tol)
   
   tod->pointing_fit->ncoarse=nsamp;
   tod->pointing_fit->coarse_ind=coarse_ind;
-
+  return -1;
 #endif
 
 }
@@ -1109,13 +1217,13 @@ actData find_max_pointing_err(const mbTOD *tod)
 	get_radec_from_altaz_exact_1det(tod,i,scratch_exact);
 	actData mycos=cos(scratch_exact->dec[0]);
 	for (int j=0;j<tod->ndata;j++) {
-	  actData dra=(scratch->ra[i]-scratch_exact->ra[i]);
+	  actData dra=(scratch->ra[j]-scratch_exact->ra[j]);
 	  if (dra>M_PI)
 	    dra-= 2*M_PI;
 	  if (dra<-M_PI)
 	    dra+= 2*M_PI;
 	  dra *= mycos;
-	  actData ddec=scratch->dec[i]-scratch_exact->dec[i];
+	  actData ddec=scratch->dec[j]-scratch_exact->dec[j];
 	  actData err=sqrt(dra*dra+ddec*ddec);
 	  tot_err+=err;
 	  if (err>my_max_err)
@@ -1136,7 +1244,8 @@ actData find_max_pointing_err(const mbTOD *tod)
     if (my_max_err>max_err)
       max_err=my_max_err;
 
-    
+    destroy_pointing_fit_scratch(scratch);
+    destroy_pointing_fit_scratch(scratch_exact);
   }
   actData ndata=ndet_used*tod->ndata;
   printf("used %d detectors, average err is %12.4e.\n",ndet_used,tot_err/ndata);
@@ -1144,6 +1253,73 @@ actData find_max_pointing_err(const mbTOD *tod)
 }
 
 
+/*--------------------------------------------------------------------------------*/
+int check_pointing_pivots(int nscan, actData tol, unsigned seed)
+//regression check for find_pointing_pivots on synthetic triangle and sinusoidal az scans with
+//a slow alt drift and some jitter.  Every segment must be within tol, the returned
+//error must match a brute-force recomputation, and no segment may be extendable by one more
+//sample.  Returns the number of failed scans.
+{
+  int nfail=0;
+  for (int iscan=0;iscan<nscan;iscan++) {
+    mbTOD tod;
+    PointingFit fit;
+    memset(&tod,0,sizeof(tod));
+    memset(&fit,0,sizeof(fit));
+    tod.pointing_fit=&fit;
+    tod.ndata=20000+(int)(40000*myrand(&seed));
+    tod.alt=vector(tod.ndata);
+    tod.az=vector(tod.ndata);
+
+    actData alt0=(30+30*myrand(&seed))*M_PI/180;
+    actData az_throw=(1+5*myrand(&seed))*M_PI/180;
+    actData period=1000+8000*myrand(&seed);
+    actData drift=1e-4*mygasdev(&seed)/tod.ndata;
+    actData jitter=0.05*myrand(&seed)/3600/180*M_PI;
+    for (int i=0;i<tod.ndata;i++) {
+      //alternate between triangle-wave and sinusoidal scans.
+      actData ph=i/period;
+      actData scan=(iscan%2) ? sin(2*M_PI*ph) : 4*fabs(ph-floor(ph)-0.5)-1;
+      tod.az[i]=az_throw*scan+jitter*mygasdev(&seed);
+      tod.alt[i]=alt0+drift*i+jitter*mygasdev(&seed);
+    }
+
+    actData err=find_pointing_pivots(&tod,tol);
+    actData cosalt=cos(tod.alt[0]);
+    actData to_arcsec=3600.0*180.0/M_PI;
+    actData max_err=0;
+    int nbad=0,nshort=0;
+    for (int i=0;i<fit.ncoarse-1;i++) {
+      int i1=fit.coarse_ind[i];
+      int i2=fit.coarse_ind[i+1];
+      actData seg_err=get_interp_segment_max_err(tod.az,i1,i2)*cosalt;
+      actData alt_err=get_interp_segment_max_err(tod.alt,i1,i2);
+      if (alt_err>seg_err)
+	seg_err=alt_err;
+      seg_err*=to_arcsec;
+      if (seg_err>max_err)
+	max_err=seg_err;
+      if (seg_err>tol*(1+1e-10))
+	nbad++;
+      if (i2+1<tod.ndata) {
+	actData next_err=get_interp_segment_max_err(tod.az,i1,i2+1)*cosalt;
+	alt_err=get_interp_segment_max_err(tod.alt,i1,i2+1);
+	if (alt_err>next_err)
+	  next_err=alt_err;
+	if (next_err*to_arcsec<=tol*(1-1e-10))
+	  nshort++;
+      }
+    }
+    int failed=(nbad>0)||(nshort>0)||(fabs(err-max_err)>1e-6*tol);
+    printf("scan %3d: %6d samples, %6d pivots, max err %8.4f\" (returned %8.4f\"), %d over tol, %d extendable%s\n",
+	   iscan,tod.ndata,fit.ncoarse,max_err,err,nbad,nshort,failed ? "  FAILED" : "");
+    nfail+=failed;
+    free(fit.coarse_ind);
+    free(tod.alt);
+    free(tod.az);
+  }
+  return nfail;
+}
 /*--------------------------------------------------------------------------------*/
 void get_radec_from_altaz_exact_1det(const mbTOD *tod,int det,    PointingFitScratch *scratch)
 //set alt and az, create the ctime, then call slalib to get ra/dec
@@ -1397,6 +1573,65 @@ ACTpolPointingFit *update_actpol_pointing(mbTOD *tod, actData *dx, actData *dy,
 
 /*--------------------------------------------------------------------------------*/
 #ifdef ACTPOL
+static unsigned long get_actpol_pointing_cache_subkey(const mbTOD *tod, int op_flag, char *subkey, int len)
+//everything the exact actpol pointing depends on beyond the TOD itself.
+{
+  const ACTpolPointingFit *fit=tod->actpol_pointing;
+  unsigned long hash=0;
+  hash=pointing_cache_hash(fit->dx,sizeof(actData)*tod->ndet,hash);
+  hash=pointing_cache_hash(fit->dy,sizeof(actData)*tod->ndet,hash);
+  hash=pointing_cache_hash(fit->theta,sizeof(actData)*tod->ndet,hash);
+  if (tod->hwp)
+    hash=pointing_cache_hash(tod->hwp,sizeof(actData)*tod->ndata,hash);
+  snprintf(subkey,len,"actpol|op=%d|freq=%.9e|alt0=%.12e|az0=%.12e|throw=%.12e|horns=%016lx",
+	   op_flag,fit->freq,fit->alt0,fit->az0,fit->az_throw,hash);
+  return pointing_cache_hash(subkey,strlen(subkey),0);
+}
+/*--------------------------------------------------------------------------------*/
+static int load_actpol_pointing_cache(mbTOD *tod, int op_flag)
+{
+  if (!tod->pointing_cache)
+    return 0;
+  char subkey[512];
+  unsigned long hash=get_actpol_pointing_cache_subkey(tod,op_flag,subkey,sizeof(subkey));
+  long nmat=((op_flag&NINKASI_DO_RADEC) ? 2 : 0)+((op_flag&NINKASI_DO_TWOGAMMA) ? 1 : 0);
+  long nbyte=nmat*sizeof(actData)*tod->ndet*tod->ndata;
+  void *map;
+  size_t maplen;
+  const actData *vals=(const actData *)map_pointing_cache_file(tod->pointing_cache,"radec",subkey,tod->ndet,tod->ndata,&nbyte,&map,&maplen);
+  if (!vals)
+    return 0;
+  long n=(long)tod->ndet*tod->ndata;
+  if (op_flag&NINKASI_DO_RADEC) {
+    memcpy(tod->ra_saved[0],vals,sizeof(actData)*n);
+    memcpy(tod->dec_saved[0],vals+n,sizeof(actData)*n);
+    vals+=2*n;
+  }
+  if (op_flag&NINKASI_DO_TWOGAMMA)
+    memcpy(tod->twogamma_saved[0],vals,sizeof(actData)*n);
+  munmap(map,maplen);
+  tod->pointing_cache->radec_hash=hash;
+  return 1;
+}
+/*--------------------------------------------------------------------------------*/
+static void save_actpol_pointing_cache(mbTOD *tod, int op_flag)
+{
+  if (!tod->pointing_cache)
+    return;
+  char subkey[512];
+  unsigned long hash=get_actpol_pointing_cache_subkey(tod,op_flag,subkey,sizeof(subkey));
+  long nbyte=sizeof(actData)*tod->ndet*tod->ndata;
+  PointingCacheWriter *w=open_pointing_cache_writer(tod->pointing_cache,"radec",subkey,tod->ndet,tod->ndata);
+  if (op_flag&NINKASI_DO_RADEC) {
+    write_pointing_cache_chunk(w,tod->ra_saved[0],nbyte);
+    write_pointing_cache_chunk(w,tod->dec_saved[0],nbyte);
+  }
+  if (op_flag&NINKASI_DO_TWOGAMMA)
+    write_pointing_cache_chunk(w,tod->twogamma_saved[0],nbyte);
+  close_pointing_cache_writer(w);
+  tod->pointing_cache->radec_hash=hash;
+}
+/*--------------------------------------------------------------------------------*/
 void precalc_actpol_pointing_exact(mbTOD *tod, int op_flag)
 {
   assert(tod);
@@ -1405,6 +1640,8 @@ void precalc_actpol_pointing_exact(mbTOD *tod, int op_flag)
     return;
   }
 
+  //only the cache can fill everything at once.
+  bool use_cache=(tod->pointing_cache)&&(!tod->ra_saved)&&(!tod->dec_saved)&&(!tod->twogamma_saved);
   bool is_pointing_needed=false;
 
 
@@ -1438,6 +1675,12 @@ void precalc_actpol_pointing_exact(mbTOD *tod, int op_flag)
     return;
   }
 
+  if (use_cache)
+    if (load_actpol_pointing_cache(tod,op_flag))
+      return;
+  if (tod->pointing_cache)
+    tod->pointing_cache->radec_hash=0;
+
   const bool do_radec=(op_flag&NINKASI_DO_RADEC)>0;
   const bool do_2gamma=(op_flag&NINKASI_DO_TWOGAMMA)>0;
 
@@ -1525,7 +1768,8 @@ void precalc_actpol_pointing_exact(mbTOD *tod, int op_flag)
     ACTpolArray_free(array);
     
   }
-  
+  if (use_cache)
+    save_actpol_pointing_cache(tod,op_flag);
   
 }
 #endif
@@ -1835,3 +2079,380 @@ void get_radec_from_altaz_actpol_c(double *az, double *el, double *tvec, double
   }
 }
 #endif
+
+/*--------------------------------------------------------------------------------*/
+//On-disk pointing cache.  Each product is one file: a fixed header followed by the raw arrays,
+//64-byte aligned, so readers can mmap the file and use the arrays in place.  The header carries
+//the full key and a checksum of the payload; anything that doesn't match is ignored and
+//recomputed.  Files are written under a temporary name and renamed, so a crashed writer never
+//leaves a half-written file behind.
+
+#define NK_CACHE_MAGIC "NKPCACHE"
+#define NK_CACHE_VERSION 1
+#define NK_CACHE_KEYLEN 2048
+#define NK_CACHE_ALIGN 64
+
+typedef struct {
+  char magic[8];
+  int version;
+  int ndet;
+  int ndata;
+  int pad;
+  unsigned long hash;
+  long offset;    //start of the payload
+  long nbyte;     //size of the payload
+  unsigned long checksum;
+  char key[NK_CACHE_KEYLEN];
+} PointingCacheHeader;
+
+struct pointing_cache_writer_s {
+  FILE *fp;
+  char *fname;
+  char *tmpname;
+  PointingCacheHeader head;
+  unsigned char tail[8];   //bytes not yet folded into the checksum
+  int ntail;
+  int failed;
+};
+
+/*--------------------------------------------------------------------------------*/
+static inline unsigned long cache_hash_word(unsigned long hash, unsigned long word)
+{
+  hash^=word;
+  hash*=0x100000001b3UL;
+  hash^=hash>>29;
+  return hash;
+}
+/*--------------------------------------------------------------------------------*/
+unsigned long pointing_cache_hash(const void *buf, long nbyte, unsigned long hash)
+//64-bit hash eating 8 bytes at a time.  Start with hash=0.
+{
+  const unsigned char *cbuf=(const unsigned char *)buf;
+  if (hash==0)
+    hash=0xcbf29ce484222325UL;
+  long nword=nbyte/8;
+  for (long i=0;i<nword;i++) {
+    unsigned long word;
+    memcpy(&word,cbuf+8*i,8);
+    hash=cache_hash_word(hash,word);
+  }
+  if (nbyte>8*nword) {
+    unsigned long word=0;
+    memcpy(&word,cbuf+8*nword,nbyte-8*nword);
+    hash=cache_hash_word(hash,word^((unsigned long)(nbyte-8*nword)<<56));
+  }
+  return hash;
+}
+/*--------------------------------------------------------------------------------*/
+static char *get_pointing_cache_fname(const PointingCache *cache, const char *kind, const char *subkey, unsigned long *hash)
+{
+  *hash=pointing_cache_hash(subkey,strlen(subkey),cache->hash);
+  *hash=pointing_cache_hash(kind,strlen(kind),*hash);
+  int len=strlen(cache->dir)+strlen(kind)+64;
+  char *fname=(char *)malloc(len);
+  snprintf(fname,len,"%s/nk_%016lx.%s",cache->dir,*hash,kind);
+  return fname;
+}
+/*--------------------------------------------------------------------------------*/
+static void fill_pointing_cache_key(const PointingCache *cache, const char *kind, const char *subkey, char *key)
+{
+  snprintf(key,NK_CACHE_KEYLEN,"%s|%s|%s",cache->key,kind,subkey);
+}
+/*--------------------------------------------------------------------------------*/
+PointingCache *setup_pointing_cache(const mbTOD *tod, const char *dir, const char *froot, const char *offset_file)
+//describe the TOD for the cache.  Nothing is read from the cache here.
+{
+  assert(tod);
+  if ((!dir)||(strlen(dir)==0))
+    return NULL;
+  mkdir(dir,0775);  //fine if it already exists
+  
+  struct stat st;
+  long tod_size=0,tod_mtime=0,off_size=0,off_mtime=0;
+  if (froot && (stat(froot,&st)==0)) {
+    tod_size=st.st_size;
+    tod_mtime=st.st_mtime;
+  }
+  if (offset_file && (stat(offset_file,&st)==0)) {
+    off_size=st.st_size;
+    off_mtime=st.st_mtime;
+  }
+
+  //boresight and detector list by content, so alt/az overrides and cuts change the key.
+  unsigned long hash=0;
+  if (tod->alt)
+    hash=pointing_cache_hash(tod->alt,sizeof(actData)*tod->ndata,hash);
+  if (tod->az)
+    hash=pointing_cache_hash(tod->az,sizeof(actData)*tod->ndata,hash);
+  if (tod->dt)
+    hash=pointing_cache_hash(tod->dt,sizeof(double)*tod->ndata,hash);
+  hash=pointing_cache_hash(tod->rows,sizeof(int)*tod->ndet,hash);
+  hash=pointing_cache_hash(tod->cols,sizeof(int)*tod->ndet,hash);
+  if (tod->cuts)
+    for (int i=0;i<tod->ndet;i++) {
+      int cut=mbCutsIsAlwaysCut(tod->cuts,tod->rows[i],tod->cols[i]);
+      hash=pointing_cache_hash(&cut,sizeof(int),hash);
+    }
+  
+  PointingCache *cache=(PointingCache *)calloc(1,sizeof(PointingCache));
+  cache->dir=strdup(dir);
+  int len=NK_CACHE_KEYLEN;
+  cache->key=(char *)malloc(len);
+  snprintf(cache->key,len,"v%d|tod=%s:%ld:%ld|offsets=%s:%ld:%ld|ndet=%d|ndata=%d|ctime=%.6f|dt=%.9e|bore=%016lx",
+	   NK_CACHE_VERSION,froot ? froot : "",tod_size,tod_mtime,offset_file ? offset_file : "",off_size,off_mtime,
+	   tod->ndet,tod->ndata,tod->ctime,tod->deltat,hash);
+  cache->hash=pointing_cache_hash(cache->key,strlen(cache->key),0);
+  return cache;
+}
+/*--------------------------------------------------------------------------------*/
+void destroy_pointing_cache(PointingCache *cache)
+{
+  if (!cache)
+    return;
+  if (cache->pix_map)
+    munmap(cache->pix_map,cache->pix_map_len);
+  free(cache->dir);
+  free(cache->key);
+  free(cache);
+}
+/*--------------------------------------------------------------------------------*/
+PointingCacheWriter *open_pointing_cache_writer(const PointingCache *cache, const char *kind, const char *subkey, int ndet, int ndata)
+{
+  if (!cache)
+    return NULL;
+  PointingCacheWriter *w=(PointingCacheWriter *)calloc(1,sizeof(PointingCacheWriter));
+  w->fname=get_pointing_cache_fname(cache,kind,subkey,&w->head.hash);
+  int len=strlen(w->fname)+64;
+  w->tmpname=(char *)malloc(len);
+  snprintf(w->tmpname,len,"%s.tmp.%ld",w->fname,(long)getpid());
+  w->fp=fopen(w->tmpname,"w");
+  if (!w->fp) {
+    fprintf(stderr,"Unable to open %s for writing pointing cache.\n",w->tmpname);
+    free(w->fname);
+    free(w->tmpname);
+    free(w);
+    return NULL;
+  }
+  memcpy(w->head.magic,NK_CACHE_MAGIC,8);
+  w->head.version=NK_CACHE_VERSION;
+  w->head.ndet=ndet;
+  w->head.ndata=ndata;
+  w->head.offset=((sizeof(PointingCacheHeader)+NK_CACHE_ALIGN-1)/NK_CACHE_ALIGN)*NK_CACHE_ALIGN;
+  w->head.checksum=0;
+  fill_pointing_cache_key(cache,kind,subkey,w->head.key);
+
+  //header goes in for real once the checksum is known.
+  char zeros[NK_CACHE_ALIGN]={0};
+  long nleft=w->head.offset;
+  while (nleft>0) {
+    long n=(nleft>NK_CACHE_ALIGN) ? NK_CACHE_ALIGN : nleft;
+    if (fwrite(zeros,1,n,w->fp)!=n)
+      w->failed=1;
+    nleft-=n;
+  }
+  return w;
+}
+/*--------------------------------------------------------------------------------*/
+void write_pointing_cache_chunk(PointingCacheWriter *w, const void *buf, long nbyte)
+//append to the payload.  The checksum comes out the same however the payload is chunked.
+{
+  if ((!w)||(nbyte<=0))
+    return;
+  if (fwrite(buf,1,nbyte,w->fp)!=nbyte)
+    w->failed=1;
+  w->head.nbyte+=nbyte;
+
+  const unsigned char *cbuf=(const unsigned char *)buf;
+  if (w->ntail>0) {
+    long n=8-w->ntail;
+    if (n>nbyte)
+      n=nbyte;
+    memcpy(w->tail+w->ntail,cbuf,n);
+    w->ntail+=n;
+    cbuf+=n;
+    nbyte-=n;
+    if (w->ntail<8)
+      return;
+    w->head.checksum=pointing_cache_hash(w->tail,8,w->head.checksum);
+    w->ntail=0;
+  }
+  long nfull=8*(nbyte/8);
+  w->head.checksum=pointing_cache_hash(cbuf,nfull,w->head.checksum);
+  w->ntail=nbyte-nfull;
+  memcpy(w->tail,cbuf+nfull,w->ntail);
+}
+/*--------------------------------------------------------------------------------*/
+int close_pointing_cache_writer(PointingCacheWriter *w)
+//finish the file and move it into place.  Returns 0 on success.
+{
+  if (!w)
+    return 1;
+  if (w->ntail>0)
+    w->head.checksum=pointing_cache_hash(w->tail,w->ntail,w->head.checksum);
+  if (fseek(w->fp,0,SEEK_SET)==0) {
+    if (fwrite(&w->head,sizeof(PointingCacheHeader),1,w->fp)!=1)
+      w->failed=1;
+  }
+  else
+    w->failed=1;
+  if (fclose(w->fp)!=0)
+    w->failed=1;
+  int failed=w->failed;
+  if (!failed)
+    if (rename(w->tmpname,w->fname)!=0)
+      failed=1;
+  if (failed) {
+    fprintf(stderr,"Failed writing pointing cache file %s.\n",w->fname);
+    remove(w->tmpname);
+  }
+  free(w->fname);
+  free(w->tmpname);
+  free(w);
+  return failed;
+}
+/*--------------------------------------------------------------------------------*/
+const void *map_pointing_cache_file(const PointingCache *cache, const char *kind, const char *subkey, int ndet, int ndata, long *nbyte, void **map, size_t *maplen)
+//mmap a cache file and check it.  Returns the payload, or NULL if the file is missing or doesn't
+//match.  If *nbyte>=0 on entry the payload must be exactly that long.  The mapping is private and
+//writable, so callers may scribble on the arrays without touching the file.
+{
+  *map=NULL;
+  *maplen=0;
+  if (!cache)
+    return NULL;
+  unsigned long hash;
+  char *fname=get_pointing_cache_fname(cache,kind,subkey,&hash);
+  int fd=open(fname,O_RDONLY);
+  if (fd<0) {
+    free(fname);
+    return NULL;
+  }
+  struct stat st;
+  void *base=MAP_FAILED;
+  if ((fstat(fd,&st)==0)&&(st.st_size>=(long)sizeof(PointingCacheHeader)))
+    base=mmap(NULL,st.st_size,PROT_READ|PROT_WRITE,MAP_PRIVATE,fd,0);
+  close(fd);
+  if (base==MAP_FAILED) {
+    fprintf(stderr,"Unable to map pointing cache file %s.\n",fname);
+    free(fname);
+    return NULL;
+  }
+
+  const PointingCacheHeader *head=(const PointingCacheHeader *)base;
+  char *key=(char *)malloc(NK_CACHE_KEYLEN);
+  fill_pointing_cache_key(cache,kind,subkey,key);
+  const char *why=NULL;
+  if (memcmp(head->magic,NK_CACHE_MAGIC,8)||(head->version!=NK_CACHE_VERSION))
+    why="bad header";
+  else if ((head->hash!=hash)||strncmp(head->key,key,NK_CACHE_KEYLEN))
+    why="key mismatch";
+  else if ((head->ndet!=ndet)||(head->ndata!=ndata))
+    why="size mismatch";
+  else if ((head->offset<(long)sizeof(PointingCacheHeader))||(head->offset+head->nbyte!=st.st_size)||((*nbyte>=0)&&(head->nbyte!=*nbyte)))
+    why="truncated";
+  else if (pointing_cache_hash((const char *)base+head->offset,head->nbyte,0)!=head->checksum)
+    why="checksum failure";
+  free(key);
+  if (why) {
+    fprintf(stderr,"Ignoring pointing cache file %s: %s.\n",fname,why);
+    munmap(base,st.st_size);
+    free(fname);
+    return NULL;
+  }
+  free(fname);
+  *nbyte=head->nbyte;
+  *map=base;
+  *maplen=st.st_size;
+  return (const char *)base+head->offset;
+}
+/*--------------------------------------------------------------------------------*/
+int load_pointing_fit_cache(mbTOD *tod)
+//restore the pointing fit, pivots and ra/dec limits from the cache.  Returns 1 if it worked.
+{
+  if (!tod->pointing_cache)
+    return 0;
+  assert(tod->pointing_fit==NULL);
+  long nbyte=-1;
+  void *map;
+  size_t maplen;
+  const actData *vals=(const actData *)map_pointing_cache_file(tod->pointing_cache,"fit","",tod->ndet,tod->ndata,&nbyte,&map,&maplen);
+  if (!vals)
+    return 0;
+  long nval=nbyte/sizeof(actData);
+  long ii=0;
+  PointingFit *fit=(PointingFit *)calloc(1,sizeof(PointingFit));
+  fit->ra_clock_rate=vals[ii++];
+  fit->dec_clock_rate=vals[ii++];
+  actData lims[4];
+  for (int i=0;i<4;i++)
+    lims[i]=vals[ii++];
+  PolyParams2d *polys[2];
+  for (int j=0;j<2;j++) {
+    PolyParams2d *poly=(PolyParams2d *)malloc(sizeof(PolyParams2d));
+    poly->xcent=vals[ii++];
+    poly->ycent=vals[ii++];
+    poly->xwidth=vals[ii++];
+    poly->ywidth=vals[ii++];
+    poly->nx=vals[ii++];
+    poly->ny=vals[ii++];
+    poly->params=matrix(poly->nx,poly->ny);
+    memcpy(poly->params[0],vals+ii,sizeof(actData)*poly->nx*poly->ny);
+    ii+=poly->nx*poly->ny;
+    polys[j]=poly;
+  }
+  fit->ra_fit=polys[0];
+  fit->dec_fit=polys[1];
+  fit->ncoarse=vals[ii++];
+  if (fit->ncoarse>0) {
+    fit->coarse_ind=(int *)malloc(sizeof(int)*fit->ncoarse);
+    for (int i=0;i<fit->ncoarse;i++)
+      fit->coarse_ind[i]=vals[ii++];
+  }
+  assert(ii==nval);
+  munmap(map,maplen);
+
+  tod->pointing_fit=fit;
+  tod->ramin=lims[0];
+  tod->ramax=lims[1];
+  tod->decmin=lims[2];
+  tod->decmax=lims[3];
+  return 1;
+}
+/*--------------------------------------------------------------------------------*/
+void save_pointing_fit_cache(const mbTOD *tod)
+{
+  if ((!tod->pointing_cache)||(!tod->pointing_fit))
+    return;
+  const PointingFit *fit=tod->pointing_fit;
+  if ((fit->tiled_fit)||(!fit->ra_fit)||(!fit->dec_fit))
+    return;  //tiled fits aren't cached.
+  long nval=6+2*6+fit->ra_fit->nx*fit->ra_fit->ny+fit->dec_fit->nx*fit->dec_fit->ny+1+fit->ncoarse;
+  actData *vals=vector(nval);
+  long ii=0;
+  vals[ii++]=fit->ra_clock_rate;
+  vals[ii++]=fit->dec_clock_rate;
+  vals[ii++]=tod->ramin;
+  vals[ii++]=tod->ramax;
+  vals[ii++]=tod->decmin;
+  vals[ii++]=tod->decmax;
+  const PolyParams2d *polys[2]={fit->ra_fit,fit->dec_fit};
+  for (int j=0;j<2;j++) {
+    vals[ii++]=polys[j]->xcent;
+    vals[ii++]=polys[j]->ycent;
+    vals[ii++]=polys[j]->xwidth;
+    vals[ii++]=polys[j]->ywidth;
+    vals[ii++]=polys[j]->nx;
+    vals[ii++]=polys[j]->ny;
+    memcpy(vals+ii,polys[j]->params[0],sizeof(actData)*polys[j]->nx*polys[j]->ny);
+    ii+=polys[j]->nx*polys[j]->ny;
+  }
+  vals[ii++]=fit->ncoarse;
+  for (int i=0;i<fit->ncoarse;i++)
+    vals[ii++]=fit->coarse_ind[i];
+  assert(ii==nval);
+
+  PointingCacheWriter *w=open_pointing_cache_writer(tod->pointing_cache,"fit","",tod->ndet,tod->ndata);
+  write_pointing_cache_chunk(w,vals,sizeof(actData)*nval);
+  close_pointing_cache_writer(w);
+  free(vals);
+}
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <math.h>
 #include <assert.h>
+#include <sys/mman.h>
 
 #ifdef USE_HEALPIX
 #include "chealpix.h"
@@ -72,6 +73,9 @@ void radecvec2cea_pix(const actData *ra, const actData *dec, int *rapix, int *de
     return;
   }
   if ((rapix==NULL)&&(ind!=NULL)) {
+#if _OPENMP>=201307
+#pragma omp simd
+#endif
     for (int i=0;i<ndata;i++) {
       int tmp_ra=ra[i]*rafac+dra;
       int tmp_dec=sin5(dec[i])*decfac+ddec;
@@ -118,6 +122,33 @@ void get_map_projection(const mbTOD *tod, const MAP *map, int det, int *ind, Poi
 #endif
 }
 /*--------------------------------------------------------------------------------*/
+void get_map_projection_ndet(const mbTOD *tod, const MAP *map, const int *dets, int ndet, int **ind, PointingFitScratch *scratch)
+//get_map_projection for a block of detectors, ind[i] filled for dets[i].  The pivots of the
+//whole block come from one get_radec_coarse_ndet call, then each detector is interpolated and
+//pixelized in the scratch, so nothing bigger than one detector's ra/dec is ever held.
+{
+  if ((tod->pixelization_saved)||(tod->pixelization_packed)||(tod->ra_saved)) {
+    for (int i=0;i<ndet;i++)
+      get_map_projection(tod,map,dets[i],ind[i],scratch);
+    return;
+  }
+  int ncoarse=scratch->pointing_fit->ncoarse;
+  actData **ra_coarse=matrix(ndet,ncoarse);
+  actData **dec_coarse=matrix(ndet,ncoarse);
+  get_radec_coarse_ndet(tod,dets,ndet,ra_coarse,dec_coarse,scratch);
+
+  //same ramp as get_radec_from_altaz_fit_1det_coarse.
+  const PointingFit *fit=tod->pointing_fit;
+  actData ra_rate=(fit->tiled_fit ? 0 : fit->ra_clock_rate);
+  actData dec_rate=(fit->tiled_fit ? 0 : fit->dec_clock_rate);
+  for (int i=0;i<ndet;i++) {
+    interp_coarse_pointing(scratch->pointing_fit->coarse_ind,ncoarse,tod->ndata,ra_coarse[i],dec_coarse[i],ra_rate,dec_rate,fit->ra_offset,fit->dec_offset,scratch->ra,scratch->dec);
+    convert_radec_to_map_pixel(scratch->ra,scratch->dec,ind[i],tod->ndata,map);
+  }
+  free_matrix(ra_coarse);
+  free_matrix(dec_coarse);
+}
+/*--------------------------------------------------------------------------------*/
 
 void get_map_projection_wchecks(const mbTOD *tod, const MAP *map, int det, int *ind, PointingFitScratch *scratch, bool *inbounds)
 //if inbounds is non-null, check to see if any pixels are out of bounds.  If so, flag 'em.  The check is done once per detector, so
@@ -128,6 +159,10 @@ void get_map_projection_wchecks(const mbTOD *tod, const MAP *map, int det, int *
     memcpy(ind,tod->pixelization_saved[det],sizeof(int)*tod->ndata);
     return;
   }
+  if (tod->pixelization_packed) {
+    unpack_pixelization_det(tod->pixelization_packed,det,ind);
+    return;
+  }
   get_radec_from_altaz_fit_1det_coarse(tod,det,scratch);
 #if 1
   convert_radec_to_map_pixel(scratch->ra,scratch->dec,ind,tod->ndata,map);
@@ -151,18 +186,11 @@ void get_map_projection_wchecks(const mbTOD *tod, const MAP *map, int det, int *
   switch(map->projection->proj_type) {
   case(NK_RECT): 
     //printf("Doing rectangular projection.\n");
-    for (int i=0;i<tod->ndata;i++)
-      ind[i]=(int)((scratch->dec[i]-map->decmin)/map->pixsize)+map->ny*(int)((scratch->ra[i]-map->ramin)/map->pixsize);    
+    radecvec2rect_pix(scratch->ra,scratch->dec,ind,tod->ndata,map);
     break;
     
   case(NK_TAN):
-    {
-      actData x,y;
-      for (int i=0;i<tod->ndata;i++) {
-	radec2xy_tan(&x,&y,scratch->ra[i],scratch->dec[i],map->projection);
-	ind[i]=(int)(x+0.5)+map->nx*((int)(y+0.5));
-      }
-    }
+    radecvec2tan_pix(scratch->ra,scratch->dec,ind,tod->ndata,map);
     break;
 #ifdef USE_HEALPIX
   case(NK_HEALPIX_RING): 
@@ -676,14 +704,63 @@ MAP *extract_subregion_map_cea(MAP *map, actData ramin, actData ramax, actData d
 }
 
 /*--------------------------------------------------------------------------------*/
-void convert_radec_to_map_pixel(const actData *ra, const actData *dec, int *ind, long ndata, const MAP *map)
+void radecvec2rect_pix(const actData *ra, const actData *dec, int *ind, long ndata, const MAP *map)
+{
+  const actData ramin=map->ramin;
+  const actData decmin=map->decmin;
+  const actData pixsize=map->pixsize;
+  const int ny=map->ny;
+#if _OPENMP>=201307
+#pragma omp simd
+#endif
+  for (long i=0;i<ndata;i++)
+    ind[i]=(int)((dec[i]-decmin)/pixsize)+ny*(int)((ra[i]-ramin)/pixsize);
+}
+/*--------------------------------------------------------------------------------*/
+void radecvec2tan_pix(const actData *ra, const actData *dec, int *ind, long ndata, const MAP *map)
+//TAN pixelization of a vector with no libm calls in the loop, so that it vectorizes.  Uses the 
+//sin5/cos5 approximations, good to ~5e-8 radians.  radec2xy_tan stays as the exact reference.
+{
+  const nkProjection *proj=map->projection;
+  const actData ra0=proj->ra_cent;
+  const actData sdec0=sin(proj->dec_cent);
+  const actData cdec0=cos(proj->dec_cent);
+  const actData rapix=proj->rapix;
+  const actData decpix=proj->decpix;
+  const actData radelt=proj->radelt;
+  const int nx=map->nx;
+#if _OPENMP>=201307
+#pragma omp simd
+#endif
+  for (long i=0;i<ndata;i++) {
+    //wrap into [-pi,pi), then fold into [-pi/2,pi/2] where sin5/cos5 are good.  Wrapping is done
+    //without floor() so the loop vectorizes, and assumes ra is within 3*pi of the center.
+    actData dra=ra[i]-ra0;
+    dra+=2*M_PI*((dra<-M_PI)-(dra>=M_PI));
+    actData over=(fabs(dra)>M_PI/2);
+    actData aa=dra+over*(copysign(M_PI,dra)-2*dra);
+    actData sdra=sin5(aa);
+    actData cdra=(1-2*over)*cos5(aa);
+    actData sdec=sin5(dec[i]);
+    actData cdec=cos5(dec[i]);
+
+    actData cosc=sdec0*sdec+cdec0*cdec*cdra;
+    actData x=cdec*sdra/cosc;
+    actData y=(cdec0*sdec-sdec0*cdec*cdra)/cosc;
+    x=rapix+x/radelt;
+    y=decpix-y/radelt;
+    ind[i]=(int)(x+0.5)+nx*((int)(y+0.5));
+  }
+}
+/*--------------------------------------------------------------------------------*/
+void convert_radec_to_map_pixel_exact(const actData *ra, const actData *dec, int *ind, long ndata, const MAP *map)
+//scalar reference for convert_radec_to_map_pixel, with libm trig everywhere.
 {
   const nkProjection *proj=map->projection;
   switch(proj->proj_type) {
-  case(NK_RECT): 
-    //printf("Doing rectangular projection.\n");
+  case(NK_RECT):
     for (long i=0;i<ndata;i++)
-      ind[i]=(int)((dec[i]-map->decmin)/map->pixsize)+map->ny*(int)((ra[i]-map->ramin)/map->pixsize);    
+      ind[i]=(int)((dec[i]-map->decmin)/map->pixsize)+map->ny*(int)((ra[i]-map->ramin)/map->pixsize);
     break;
   case(NK_TAN):
     {
@@ -694,6 +771,62 @@ void convert_radec_to_map_pixel(const actData *ra, const actData *dec, int *ind,
       }
     }
     break;
+  case(NK_CEA):
+    {
+      double rafac=RAD2DEG/proj->radelt;
+      double decfac=RAD2DEG/proj->pv/proj->decdelt;
+      for (long i=0;i<ndata;i++) {
+	int rapix=ra[i]*rafac+proj->rapix-1+0.5;
+	int decpix=sin(dec[i])*decfac+proj->decpix-1+0.5;
+	ind[i]=map->nx*decpix+rapix;
+      }
+    }
+    break;
+  default:
+    convert_radec_to_map_pixel(ra,dec,ind,ndata,map);
+    break;
+  }
+}
+/*--------------------------------------------------------------------------------*/
+long check_projection_kernels(const MAP *map, long npt, long seed)
+//compare the fast pixelization kernels against the exact reference on npt random points inside the 
+//map's ra/dec limits.  Returns the number of points that land in a different pixel, which should only 
+//happen for points within the approximation error of a pixel edge.
+{
+  actData *ra=vector(npt);
+  actData *dec=vector(npt);
+  int *ind=(int *)malloc_retry(sizeof(int)*npt);
+  int *ind_exact=(int *)malloc_retry(sizeof(int)*npt);
+  srand48(seed);
+  for (long i=0;i<npt;i++) {
+    ra[i]=map->ramin+(map->ramax-map->ramin)*drand48();
+    dec[i]=map->decmin+(map->decmax-map->decmin)*drand48();
+  }
+  convert_radec_to_map_pixel(ra,dec,ind,npt,map);
+  convert_radec_to_map_pixel_exact(ra,dec,ind_exact,npt,map);
+  long nbad=0;
+  for (long i=0;i<npt;i++)
+    if (ind[i]!=ind_exact[i])
+      nbad++;
+  mprintf(stdout,"projection kernels disagree on %ld of %ld points.\n",nbad,npt);
+  free(ra);
+  free(dec);
+  free(ind);
+  free(ind_exact);
+  return nbad;
+}
+/*--------------------------------------------------------------------------------*/
+void convert_radec_to_map_pixel(const actData *ra, const actData *dec, int *ind, long ndata, const MAP *map)
+{
+  const nkProjection *proj=map->projection;
+  switch(proj->proj_type) {
+  case(NK_RECT): 
+    //printf("Doing rectangular projection.\n");
+    radecvec2rect_pix(ra,dec,ind,ndata,map);
+    break;
+  case(NK_TAN):
+    radecvec2tan_pix(ra,dec,ind,ndata,map);
+    break;
 #ifdef USE_HEALPIX
   case(NK_HEALPIX_RING):
     for (int i=0;i<ndata;i++) {
@@ -731,11 +864,42 @@ void convert_saved_pointing_to_pixellization(mbTOD *tod, MAP *map)
     fprintf(stderr,"Missing ra/dec in TOD in convert_saved_pointing_to_pixellization.\n");
     return;
   }
-  if (!tod->pixelization_saved)
-    tod->pixelization_saved=imatrix(tod->ndet,tod->ndata);
+  //ra/dec that came through the pointing cache have a known source, so their pixelization can be cached too.
+  char source[64]="";
+  if ((tod->pointing_cache)&&(tod->pointing_cache->radec_hash))
+    snprintf(source,sizeof(source),"radec%016lx",tod->pointing_cache->radec_hash);
+  
+  if ((!tod->pixelization_saved)&&(strlen(source))&&(load_pixelization_cache(tod,map,source))) {
+    if (tod->pixelization_packed)
+      destroy_packed_pixelization(tod->pixelization_packed);
+    tod->pixelization_packed=NULL;
+  }
+  else if (tod->pixelization_saved) {
 #pragma omp parallel for shared(tod,map) default(none)
-  for (int i=0;i<tod->ndet;i++)
-    convert_radec_to_map_pixel(tod->ra_saved[i],tod->dec_saved[i],tod->pixelization_saved[i],tod->ndata,map);
+    for (int i=0;i<tod->ndet;i++)
+      convert_radec_to_map_pixel(tod->ra_saved[i],tod->dec_saved[i],tod->pixelization_saved[i],tod->ndata,map);
+    if (strlen(source))
+      save_pixelization_cache(tod,map,source);
+  }
+  else {
+    //pack as we go so the full-sized pixelization never exists.
+    if (tod->pixelization_packed)
+      destroy_packed_pixelization(tod->pixelization_packed);
+    PackedPixelization *pix=allocate_packed_pixelization(tod->ndet,tod->ndata,get_map_pixel_stride(map));
+#pragma omp parallel shared(tod,map,pix) default(none)
+    {
+      int *ind=(int *)malloc_retry(sizeof(int)*tod->ndata);
+#pragma omp for schedule(dynamic,4)
+      for (int i=0;i<tod->ndet;i++) {
+	convert_radec_to_map_pixel(tod->ra_saved[i],tod->dec_saved[i],ind,tod->ndata,map);
+	pack_pixelization_det(ind,tod->ndata,pix->stride,pix->dets+i);
+      }
+      free(ind);
+    }
+    tod->pixelization_packed=pix;
+    if (strlen(source))
+      save_pixelization_cache(tod,map,source);
+  }
   
   free(tod->ra_saved[0]);
   free(tod->ra_saved);
@@ -746,3 +910,346 @@ void convert_saved_pointing_to_pixellization(mbTOD *tod, MAP *map)
   tod->dec_saved=NULL;
   
 }
+
+/*--------------------------------------------------------------------------------*/
+//Packed pixelizations.  Pixel deltas between neighbouring samples are split into a step
+//in map rows and a step along the row.  While scanning these are almost always -1, 0 or +1, so
+//most blocks pack two samples per byte.  Blocks that jump further fall back on bigger codes.
+#define PIX_MODE_NIBBLE 0  //row/col steps in [-2,1], two samples per byte
+#define PIX_MODE_BYTE 1    //row/col steps in [-8,7], one sample per byte
+#define PIX_MODE_SHORT 2   //raw 16-bit deltas
+#define PIX_MODE_INT 3     //raw 32-bit deltas
+
+int get_map_pixel_stride(const MAP *map)
+//how far apart, in index, neighbouring map rows are.  0 if there is no such thing.
+{
+  switch(map->projection->proj_type) {
+  case NK_RECT:
+    return map->ny;
+  case NK_CEA:
+  case NK_TAN:
+    return map->nx;
+  default:
+    return 0;
+  }
+}
+/*--------------------------------------------------------------------------------*/
+static inline void split_pixel_delta(long d, int stride, long *q, long *r)
+{
+  if (stride<=0) {
+    *q=0;
+    *r=d;
+    return;
+  }
+  *q=d/stride;
+  *r=d-(*q)*stride;
+  if (2*(*r)>stride) {
+    (*q)++;
+    (*r)-=stride;
+  }
+  else
+    if (2*(*r)<-stride) {
+      (*q)--;
+      (*r)+=stride;
+    }
+}
+/*--------------------------------------------------------------------------------*/
+static int get_pixel_block_mode(const int *ind, int n, int stride)
+{
+  int mode=PIX_MODE_NIBBLE;
+  for (int j=1;j<n;j++) {
+    long d=(long)ind[j]-(long)ind[j-1];
+    long q,r;
+    split_pixel_delta(d,stride,&q,&r);
+    if ((stride>0)&&(q>=-2)&&(q<=1)&&(r>=-2)&&(r<=1))
+      continue;
+    if ((stride>0)&&(q>=-8)&&(q<=7)&&(r>=-8)&&(r<=7)) {
+      if (mode<PIX_MODE_BYTE)
+	mode=PIX_MODE_BYTE;
+      continue;
+    }
+    if ((d>=-32768)&&(d<=32767)) {
+      if (mode<PIX_MODE_SHORT)
+	mode=PIX_MODE_SHORT;
+      continue;
+    }
+    return PIX_MODE_INT;
+  }
+  return mode;
+}
+/*--------------------------------------------------------------------------------*/
+static int get_pixel_block_nbyte(int mode, int n)
+{
+  switch(mode) {
+  case PIX_MODE_NIBBLE:
+    return n/2;
+  case PIX_MODE_BYTE:
+    return n-1;
+  case PIX_MODE_SHORT:
+    return 2*(n-1);
+  default:
+    return 4*(n-1);
+  }
+}
+/*--------------------------------------------------------------------------------*/
+void pack_pixelization_det(const int *ind, int ndata, int stride, PackedPixelizationDet *pd)
+{
+  pd->nblock=(ndata+NK_PIX_BLOCK-1)/NK_PIX_BLOCK;
+  pd->base=(int *)malloc_retry(sizeof(int)*(pd->nblock+1));
+  pd->mode=(unsigned char *)malloc_retry(sizeof(unsigned char)*(pd->nblock+1));
+  pd->offset=(int *)malloc_retry(sizeof(int)*(pd->nblock+1));
+  
+  pd->offset[0]=0;
+  for (int block=0;block<pd->nblock;block++) {
+    int i0=block*NK_PIX_BLOCK;
+    int n=(ndata-i0<NK_PIX_BLOCK ? ndata-i0 : NK_PIX_BLOCK);
+    pd->base[block]=ind[i0];
+    pd->mode[block]=get_pixel_block_mode(ind+i0,n,stride);
+    pd->offset[block+1]=pd->offset[block]+get_pixel_block_nbyte(pd->mode[block],n);
+  }
+  pd->stream=(unsigned char *)malloc_retry(pd->offset[pd->nblock]+1);
+
+  for (int block=0;block<pd->nblock;block++) {
+    int i0=block*NK_PIX_BLOCK;
+    int n=(ndata-i0<NK_PIX_BLOCK ? ndata-i0 : NK_PIX_BLOCK);
+    unsigned char *out=pd->stream+pd->offset[block];
+    const int *in=ind+i0;
+    switch(pd->mode[block]) {
+    case PIX_MODE_NIBBLE:
+      memset(out,0,n/2);
+      for (int j=1;j<n;j++) {
+	long q,r;
+	split_pixel_delta((long)in[j]-(long)in[j-1],stride,&q,&r);
+	unsigned char code=((q+2)<<2)|(r+2);
+	out[(j-1)>>1]|=((j-1)&1 ? code<<4 : code);
+      }
+      break;
+    case PIX_MODE_BYTE:
+      for (int j=1;j<n;j++) {
+	long q,r;
+	split_pixel_delta((long)in[j]-(long)in[j-1],stride,&q,&r);
+	out[j-1]=((q+8)<<4)|(r+8);
+      }
+      break;
+    case PIX_MODE_SHORT:
+      for (int j=1;j<n;j++) {
+	short d=in[j]-in[j-1];
+	memcpy(out+2*(j-1),&d,sizeof(short));
+      }
+      break;
+    default:
+      for (int j=1;j<n;j++) {
+	unsigned int d=(unsigned int)in[j]-(unsigned int)in[j-1];  //unsigned so garbage in cut samples wraps safely
+	memcpy(out+4*(j-1),&d,sizeof(unsigned int));
+      }
+      break;
+    }
+  }
+}
+/*--------------------------------------------------------------------------------*/
+static inline void fill_pixel_step_tables(int stride, int *nibble_tab, int *byte_tab)
+{
+  for (int c=0;c<16;c++)
+    nibble_tab[c]=((c>>2)-2)*stride+((c&3)-2);
+  for (int c=0;c<256;c++)
+    byte_tab[c]=((c>>4)-8)*stride+((c&15)-8);
+}
+/*--------------------------------------------------------------------------------*/
+static inline int unpack_pixelization_block_tab(const PackedPixelizationDet *pd, int ndata, int block, int *ind, const int *nibble_tab, const int *byte_tab)
+{
+  int i0=block*NK_PIX_BLOCK;
+  int n=(ndata-i0<NK_PIX_BLOCK ? ndata-i0 : NK_PIX_BLOCK);
+  const unsigned char *in=pd->stream+pd->offset[block];
+  int pix=pd->base[block];
+  ind[0]=pix;
+  switch(pd->mode[block]) {
+  case PIX_MODE_NIBBLE:
+    for (int j=1;j<n;j+=2) {
+      unsigned char cc=in[(j-1)>>1];
+      pix+=nibble_tab[cc&15];
+      ind[j]=pix;
+      if (j+1<n) {
+	pix+=nibble_tab[cc>>4];
+	ind[j+1]=pix;
+      }
+    }
+    break;
+  case PIX_MODE_BYTE:
+    for (int j=1;j<n;j++) {
+      pix+=byte_tab[in[j-1]];
+      ind[j]=pix;
+    }
+    break;
+  case PIX_MODE_SHORT:
+    for (int j=1;j<n;j++) {
+      short d;
+      memcpy(&d,in+2*(j-1),sizeof(short));
+      pix+=d;
+      ind[j]=pix;
+    }
+    break;
+  default:
+    {
+      unsigned int upix=pix;
+      for (int j=1;j<n;j++) {
+	unsigned int d;
+	memcpy(&d,in+4*(j-1),sizeof(unsigned int));
+	upix+=d;
+	ind[j]=upix;
+      }
+    }
+    break;
+  }
+  return n;
+}
+/*--------------------------------------------------------------------------------*/
+int unpack_pixelization_block(const PackedPixelization *pix, int det, int block, int *ind)
+//decode a single block of NK_PIX_BLOCK samples into ind.  Returns the number of samples decoded.
+{
+  int nibble_tab[16],byte_tab[256];
+  fill_pixel_step_tables(pix->stride,nibble_tab,byte_tab);
+  return unpack_pixelization_block_tab(pix->dets+det,pix->ndata,block,ind,nibble_tab,byte_tab);
+}
+/*--------------------------------------------------------------------------------*/
+void unpack_pixelization_det(const PackedPixelization *pix, int det, int *ind)
+{
+  int nibble_tab[16],byte_tab[256];
+  fill_pixel_step_tables(pix->stride,nibble_tab,byte_tab);
+  const PackedPixelizationDet *pd=pix->dets+det;
+  for (int block=0;block<pd->nblock;block++)
+    unpack_pixelization_block_tab(pd,pix->ndata,block,ind+block*NK_PIX_BLOCK,nibble_tab,byte_tab);
+}
+/*--------------------------------------------------------------------------------*/
+const int *get_saved_pixelization(const mbTOD *tod, int det, int *buf)
+//pixelization of a detector from whichever saved form the TOD has.  If it's packed, it gets
+//decoded into buf (ndata long), otherwise the saved row is handed back directly.
+{
+  if (tod->pixelization_saved)
+    return tod->pixelization_saved[det];
+  assert(tod->pixelization_packed);
+  unpack_pixelization_det(tod->pixelization_packed,det,buf);
+  return buf;
+}
+/*--------------------------------------------------------------------------------*/
+PackedPixelization *allocate_packed_pixelization(int ndet, int ndata, int stride)
+{
+  PackedPixelization *pix=(PackedPixelization *)malloc_retry(sizeof(PackedPixelization));
+  pix->ndet=ndet;
+  pix->ndata=ndata;
+  pix->stride=stride;
+  pix->dets=(PackedPixelizationDet *)calloc(ndet,sizeof(PackedPixelizationDet));
+  assert(pix->dets);
+  return pix;
+}
+/*--------------------------------------------------------------------------------*/
+void destroy_packed_pixelization(PackedPixelization *pix)
+{
+  if (!pix)
+    return;
+  for (int i=0;i<pix->ndet;i++) {
+    free(pix->dets[i].base);
+    free(pix->dets[i].mode);
+    free(pix->dets[i].offset);
+    free(pix->dets[i].stream);
+  }
+  free(pix->dets);
+  free(pix);
+}
+/*--------------------------------------------------------------------------------*/
+long get_packed_pixelization_nbyte(const PackedPixelization *pix)
+{
+  long tot=sizeof(PackedPixelization)+pix->ndet*sizeof(PackedPixelizationDet);
+  for (int i=0;i<pix->ndet;i++) {
+    const PackedPixelizationDet *pd=pix->dets+i;
+    tot+=pd->offset[pd->nblock]+(pd->nblock+1)*(2*sizeof(int)+sizeof(unsigned char));
+  }
+  return tot;
+}
+/*--------------------------------------------------------------------------------*/
+void pack_saved_pixelization(mbTOD *tod, const MAP *map)
+//replace the TOD's saved pixelization by its packed form.  
+{
+  if (!tod->pixelization_saved) {
+    fprintf(stderr,"Missing pixelization in pack_saved_pixelization.\n");
+    return;
+  }
+  PackedPixelization *pix=allocate_packed_pixelization(tod->ndet,tod->ndata,get_map_pixel_stride(map));
+#pragma omp parallel for shared(tod,pix) default(none) schedule(dynamic,4)
+  for (int i=0;i<tod->ndet;i++)
+    pack_pixelization_det(tod->pixelization_saved[i],tod->ndata,pix->stride,pix->dets+i);
+  
+  free_saved_pixelization(tod);
+  if (tod->pixelization_packed)
+    destroy_packed_pixelization(tod->pixelization_packed);
+  tod->pixelization_packed=pix;
+}
+/*--------------------------------------------------------------------------------*/
+static void get_pixelization_cache_subkey(const MAP *map, const char *source, char *subkey, int len)
+{
+  const nkProjection *proj=map->projection;
+  if (proj)
+    snprintf(subkey,len,"%s|nx=%d|ny=%d|npix=%ld|pixsize=%.12e|lims=%.12e:%.12e:%.12e:%.12e|proj=%d:%.12e:%.12e:%.12e:%.12e:%.12e:%.12e:%.12e:%d",
+	     source,map->nx,map->ny,map->npix,map->pixsize,map->ramin,map->ramax,map->decmin,map->decmax,
+	     (int)proj->proj_type,proj->radelt,proj->decdelt,proj->ra_cent,proj->dec_cent,proj->rapix,proj->decpix,proj->pv,proj->nside);
+  else
+    snprintf(subkey,len,"%s|nx=%d|ny=%d|npix=%ld|pixsize=%.12e|lims=%.12e:%.12e:%.12e:%.12e",
+	     source,map->nx,map->ny,map->npix,map->pixsize,map->ramin,map->ramax,map->decmin,map->decmax);
+}
+/*--------------------------------------------------------------------------------*/
+int load_pixelization_cache(mbTOD *tod, const MAP *map, const char *source)
+//point pixelization_saved straight into an mmapped cache file.  source says where the pointing
+//came from (e.g. "fit").  Returns 1 if the pixelization was found.
+{
+  if ((!tod->pointing_cache)||(tod->pixelization_saved))
+    return 0;
+  char subkey[1024];
+  get_pixelization_cache_subkey(map,source,subkey,sizeof(subkey));
+  long nbyte=sizeof(int)*(long)tod->ndet*tod->ndata;
+  void *pixmap;
+  size_t maplen;
+  const int *pix=(const int *)map_pointing_cache_file(tod->pointing_cache,"pix",subkey,tod->ndet,tod->ndata,&nbyte,&pixmap,&maplen);
+  if (!pix)
+    return 0;
+  if (tod->pointing_cache->pix_map)
+    munmap(tod->pointing_cache->pix_map,tod->pointing_cache->pix_map_len);
+  tod->pointing_cache->pix_map=pixmap;
+  tod->pointing_cache->pix_map_len=maplen;
+  tod->pixelization_saved=(int **)malloc_retry(sizeof(int *)*tod->ndet);
+  for (int i=0;i<tod->ndet;i++)
+    tod->pixelization_saved[i]=(int *)pix+(long)i*tod->ndata;
+  return 1;
+}
+/*--------------------------------------------------------------------------------*/
+void save_pixelization_cache(const mbTOD *tod, const MAP *map, const char *source)
+{
+  if (!tod->pointing_cache)
+    return;
+  if ((!tod->pixelization_saved)&&(!tod->pixelization_packed))
+    return;
+  char subkey[1024];
+  get_pixelization_cache_subkey(map,source,subkey,sizeof(subkey));
+  PointingCacheWriter *w=open_pointing_cache_writer(tod->pointing_cache,"pix",subkey,tod->ndet,tod->ndata);
+  if (!w)
+    return;
+  int *buf=(int *)malloc_retry(sizeof(int)*tod->ndata);
+  for (int i=0;i<tod->ndet;i++) 
+    write_pointing_cache_chunk(w,get_saved_pixelization(tod,i,buf),sizeof(int)*tod->ndata);
+  free(buf);
+  close_pointing_cache_writer(w);
+}
+/*--------------------------------------------------------------------------------*/
+void free_saved_pixelization(mbTOD *tod)
+//free pixelization_saved, whether it was allocated or mapped from the cache.
+{
+  if (!tod->pixelization_saved)
+    return;
+  if ((tod->pointing_cache)&&(tod->pointing_cache->pix_map)) {
+    munmap(tod->pointing_cache->pix_map,tod->pointing_cache->pix_map_len);
+    tod->pointing_cache->pix_map=NULL;
+    tod->pointing_cache->pix_map_len=0;
+  }
+  else 
+    free(tod->pixelization_saved[0]);
+  free(tod->pixelization_saved);
+  tod->pixelization_saved=NULL;
+}
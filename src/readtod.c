@@ -7,10 +7,13 @@
 #include <ctype.h>
 #include <fcntl.h>
 #include <math.h>
+#include <omp.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -18,6 +21,8 @@
 #include "readtod.h"
 #include "dirfile.h"
 #include "getdata.h"
+#include "ninkasi.h"
+#include "ninkasi_pointing.h"
 
 #define ACT_ARRAY_MAX_ROWS 33
 #define ACT_ARRAY_MAX_COLS 32
@@ -25,6 +30,107 @@
 
 #define MAX(A,B) ((A > B) ? (A) : (B))
 
+#define DIRFILE_FORMAT_CACHE_SIZE 8  //parsed format files kept around, least recently used goes first
+#define DIRFILE_IO_THREADS 4         //channels read at once by one TOD read
+
+/*--------------------------------------------------------------------------------*/
+//Parsed format files, so a dirfile only gets parsed once no matter how many times its header
+//and data get read.  Entries are reference counted, and only unused ones get evicted.
+typedef struct {
+  char *dirfile;
+  struct FormatType *format;
+  int nuse;
+  long last_use;
+} DirfileFormatEntry;
+
+static DirfileFormatEntry dirfile_format_cache[DIRFILE_FORMAT_CACHE_SIZE];
+static long dirfile_format_clock=0;
+static pthread_mutex_t dirfile_format_lock=PTHREAD_MUTEX_INITIALIZER;
+
+static void close_dirfile_format(struct FormatType *format)
+{
+  GetDataClose(format);
+  free(format);
+}
+
+const struct FormatType *get_dirfile_format(const char *filename)
+//format of a dirfile, parsed on first use.  Hand it back with release_dirfile_format.
+{
+  pthread_mutex_lock(&dirfile_format_lock);
+  dirfile_format_clock++;
+  for (int i=0;i<DIRFILE_FORMAT_CACHE_SIZE;i++) {
+    DirfileFormatEntry *e=dirfile_format_cache+i;
+    if ((e->dirfile)&&(strcmp(e->dirfile,filename)==0)) {
+      e->nuse++;
+      e->last_use=dirfile_format_clock;
+      pthread_mutex_unlock(&dirfile_format_lock);
+      return e->format;
+    }
+  }
+  pthread_mutex_unlock(&dirfile_format_lock);
+
+  int status;
+  struct FormatType *format=GetFormat(filename,NULL,&status);
+  if (format==NULL)
+    return NULL;
+
+  pthread_mutex_lock(&dirfile_format_lock);
+  int slot=-1;
+  for (int i=0;i<DIRFILE_FORMAT_CACHE_SIZE;i++) {
+    DirfileFormatEntry *e=dirfile_format_cache+i;
+    if (e->nuse>0)
+      continue;
+    if ((slot<0)||(!e->dirfile)||((dirfile_format_cache[slot].dirfile)&&(e->last_use<dirfile_format_cache[slot].last_use)))
+      slot=i;
+  }
+  if (slot>=0) {
+    DirfileFormatEntry *e=dirfile_format_cache+slot;
+    if (e->dirfile) {
+      close_dirfile_format(e->format);
+      free(e->dirfile);
+    }
+    e->dirfile=strdup(filename);
+    e->format=format;
+    e->nuse=1;
+    e->last_use=dirfile_format_clock;
+  }
+  pthread_mutex_unlock(&dirfile_format_lock);
+  //if everything is in use the format just doesn't get cached, and release closes it.
+  return format;
+}
+
+void release_dirfile_format(const struct FormatType *format)
+{
+  if (format==NULL)
+    return;
+  pthread_mutex_lock(&dirfile_format_lock);
+  for (int i=0;i<DIRFILE_FORMAT_CACHE_SIZE;i++)
+    if ((dirfile_format_cache[i].dirfile)&&(dirfile_format_cache[i].format==format)) {
+      //keep the parsed format, but not the decoded slim fields, once the TOD is read.
+      if (--dirfile_format_cache[i].nuse==0)
+	GetDataDropDecoded(dirfile_format_cache[i].format);
+      pthread_mutex_unlock(&dirfile_format_lock);
+      return;
+    }
+  pthread_mutex_unlock(&dirfile_format_lock);
+  close_dirfile_format((struct FormatType *)format);
+}
+
+void free_dirfile_format_cache()
+{
+  pthread_mutex_lock(&dirfile_format_lock);
+  for (int i=0;i<DIRFILE_FORMAT_CACHE_SIZE;i++) {
+    DirfileFormatEntry *e=dirfile_format_cache+i;
+    if ((e->dirfile)&&(e->nuse==0)) {
+      close_dirfile_format(e->format);
+      free(e->dirfile);
+      e->dirfile=NULL;
+      e->format=NULL;
+    }
+  }
+  pthread_mutex_unlock(&dirfile_format_lock);
+}
+
 /*--------------------------------------------------------------------------------*/
 
 void *dirfile_read_channel_direct(char typechar, const char *filename, const char *channelname, int *nsamples_out)
@@ -68,11 +174,13 @@ read_dirfile_tod_header( const char *filename )
 {
   //printf("reading .%s.\n",filename);
     assert( filename != NULL );
+    if (is_nktod_file(filename))
+      return read_nktod_header(filename);
 
 
-    int status, n;
+    int n;
     //printf("reading format from %s\n",filename);
-    struct FormatType *format = GetFormat( filename, NULL, &status );
+    const struct FormatType *format = get_dirfile_format( filename );
     assert( format != NULL );
     mbTOD *tod = (mbTOD *) calloc( 1,sizeof(mbTOD) );
     tod->dirfile=strdup(filename);
@@ -158,8 +266,7 @@ read_dirfile_tod_header( const char *filename )
     tod->data=NULL;  //should already be set thusly.
     // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-    GetDataClose(format);
-    free(format);
+    release_dirfile_format(format);
 
     return tod;
 }
@@ -167,6 +274,43 @@ read_dirfile_tod_header( const char *filename )
 // ----------------------------------------------------------------------------
 
 
+// ----------------------------------------------------------------------------
+
+int
+read_dirfile_tod_size( const char *filename, int *ndet, int *ndata )
+//just the shape of a TOD, from the format file and frame counts - nothing is read from the
+//data channels.  Returns 0 on success.
+{
+    assert( filename != NULL );
+    int status;
+    *ndet=0;
+    *ndata=0;
+    if (is_nktod_file(filename))
+      return read_nktod_size(filename,ndet,ndata);
+    const struct FormatType *format = get_dirfile_format( filename );
+    if (format==NULL) {
+      fprintf(stderr,"Warning - problem reading format from file .%s.\n",filename);
+      return 1;
+    }
+
+    int nframes = GetNFrames( format, &status, "Enc_Az_Deg" );
+    int spf = GetSamplesPerFrame( format, "Enc_Az_Deg", &status );
+    if ( status == GD_E_OK )
+      *ndata = nframes*spf;
+
+    char tesfield[] = "tesdatar00c00";
+    for ( int r = 0; r < ACT_ARRAY_MAX_ROWS; r++ )
+    for ( int c = 0; c < ACT_ARRAY_MAX_COLS; c++ )
+    {
+        write_tes_channelname( tesfield, r, c );
+        if ( dirfile_has_channel(format, tesfield) )
+          (*ndet)++;
+    }
+
+    release_dirfile_format(format);
+    return (*ndata>0 ? 0 : 1);
+}
+
 // ----------------------------------------------------------------------------
 
 
@@ -338,8 +482,8 @@ void decimate_vector_in_place(actData *vec, int *nn) //shrink a vector by a fact
   int n=*nn;
   int n2=(n+1)/2;  //round up if we are odd
 
-  actData tmp0=0.25*(vec[0]+2*vec[1]*vec[2]);
-  actData tmp1=0.25*(vec[2]+2*vec[3]*vec[4]);
+  actData tmp0=0.25*(vec[0]+2*vec[1]+vec[2]);
+  actData tmp1=0.25*(vec[2]+2*vec[3]+vec[4]);
   for (int i=2;i<n2-1;i++) {
     int ii=2*i;
     vec[i]=0.25*(vec[ii]+2*vec[ii+1]+vec[ii+2]);
@@ -385,66 +529,300 @@ read_dirfile_tod_header_decimate( const char *filename , int decimate )
 }
 
 
+// ----------------------------------------------------------------------------
+//Streaming decimation.  Each factor-of-2 stage is the [1 2 1]/4 filter of decimate_vector,
+//applied to a chunk at a time with two samples of history in front of its buffer, and
+//whatever it produces lands straight in the next stage's buffer.  Results match repeated
+//calls to decimate_vector exactly, including the ends.
+
+#define DECIMATE_MAX_STAGES 16
+#define DECIMATE_CHUNK 65536        //samples read from disk per pass through the stages
+
+typedef struct {
+  int nstage;
+  int chunk;
+  long nin[DECIMATE_MAX_STAGES];     //samples pushed into each stage so far
+  actData xm[DECIMATE_MAX_STAGES];   //third-to-last input of each stage, for the end
+  actData *buf[DECIMATE_MAX_STAGES]; //two samples of history, then the new input
+  actData *space;
+} DecimateStream;
+
+static void setup_decimate_stream(DecimateStream *ds, int nstage, int chunk)
+{
+  assert((nstage>0)&&(nstage<=DECIMATE_MAX_STAGES));
+  ds->nstage=nstage;
+  ds->chunk=chunk;
+  long len=0;
+  for (int i=0;i<nstage;i++)
+    len+=(chunk>>i)+4;
+  ds->space=(actData *)malloc(sizeof(actData)*len);
+  assert(ds->space);
+  len=0;
+  for (int i=0;i<nstage;i++) {
+    ds->buf[i]=ds->space+len;
+    len+=(chunk>>i)+4;
+    ds->nin[i]=0;
+    ds->xm[i]=0;
+  }
+}
+
+static void free_decimate_stream(DecimateStream *ds)
+{
+  free(ds->space);
+  ds->space=NULL;
+}
+
+static actData *decimate_stream_input(DecimateStream *ds)
+//where the next chunk, of at most ds->chunk samples, goes.
+{
+  return ds->buf[0]+2;
+}
+
+static int push_decimate_stage(DecimateStream *ds, int stage, int n, actData *out)
+//run n new samples sitting in stage's buffer through it and every later stage.  Returns
+//how many fully decimated samples were written to out.
+{
+  actData *restrict x=ds->buf[stage];
+  bool last=(stage==ds->nstage-1);
+  actData *restrict y=(last ? out : ds->buf[stage+1]+2);
+  long nin=ds->nin[stage];
+  //x[i] is sample nin-2+i of the stream, and outputs come at even samples from 2 on.
+  int i0=(nin==0 ? 4 : (nin&1 ? 3 : 2));
+  int nout=(n+2>i0 ? (n+2-i0+1)/2 : 0);
+  for (int m=0;m<nout;m++) {
+    int i=i0+2*m;
+    y[m]=0.25*(x[i-2]+2*x[i-1]+x[i]);
+  }
+  ds->xm[stage]=x[n-1];
+  actData x0=x[n];
+  actData x1=x[n+1];
+  x[0]=x0;
+  x[1]=x1;
+  ds->nin[stage]=nin+n;
+  if (last)
+    return nout;
+  return push_decimate_stage(ds,stage+1,nout,out);
+}
+
+static int push_decimate_stream(DecimateStream *ds, int n, actData *out)
+//decimate the n samples put at decimate_stream_input.
+{
+  if (n<=0)
+    return 0;
+  assert(n<=ds->chunk);
+  return push_decimate_stage(ds,0,n,out);
+}
+
+static int finish_decimate_stage(DecimateStream *ds, int stage, actData *out)
+{
+  long n=ds->nin[stage];
+  actData *x=ds->buf[stage];
+  actData end;
+  if (n%2==0)
+    end=0.25*(ds->xm[stage]+2*x[0]+x[1]);
+  else
+    end=0.5*(x[0]+x[1]);
+  if (stage==ds->nstage-1) {
+    out[0]=end;
+    return 1;
+  }
+  ds->buf[stage+1][2]=end;
+  int nout=push_decimate_stage(ds,stage+1,1,out);
+  return nout+finish_decimate_stage(ds,stage+1,out+nout);
+}
+
+static int finish_decimate_stream(DecimateStream *ds, actData *out)
+//the last sample of every stage, once the whole input has been pushed.
+{
+  return finish_decimate_stage(ds,0,out);
+}
+
+static int decimated_length(int n, int decimate)
+{
+  for (int i=0;i<decimate;i++)
+    n=(n+1)/2;
+  return n;
+}
+
 // ----------------------------------------------------------------------------
 
 
 
+static int read_dirfile_channel_into(const struct FormatType *format, const char *field, actData *out, int ndata, int decimate)
+//read one detector straight into its row of the TOD.  Decimated channels are read a chunk at
+//a time and pushed through all the decimation stages on the way, so the full-rate channel is
+//never in memory.  Only over-long channels need a scratch copy.  Returns 0 on success.
+{
+  int status=0;
+  int nframes=GetNFrames(format,&status,field);
+  if (status!=GD_E_OK)
+    return 1;
+  int spf=GetSamplesPerFrame(format,field,&status);
+  if (status!=GD_E_OK)
+    return 1;
+  int n=nframes*spf;
+#ifndef ACTDATA_DOUBLE
+  char type='f';
+#else
+  char type='d';
+#endif
+  if ((decimate==0)&&(n==ndata)) {
+    int nread=GetData(format,field,0,0,nframes,0,type,out,&status);
+    return ((status!=GD_E_OK)||(nread!=n));
+  }
+  if ((decimate>0)&&(decimated_length(n,decimate)==ndata)) {
+    DecimateStream ds;
+    setup_decimate_stream(&ds,decimate,DECIMATE_CHUNK);
+    int nout=0;
+    for (int first=0;first<n;first+=DECIMATE_CHUNK) {
+      int nchunk=(n-first<DECIMATE_CHUNK ? n-first : DECIMATE_CHUNK);
+      int nread=GetData(format,field,0,first,0,nchunk,type,decimate_stream_input(&ds),&status);
+      if ((status!=GD_E_OK)||(nread!=nchunk)) {
+	free_decimate_stream(&ds);
+	return 1;
+      }
+      nout+=push_decimate_stream(&ds,nchunk,out+nout);
+    }
+    nout+=finish_decimate_stream(&ds,out+nout);
+    free_decimate_stream(&ds);
+    assert(nout==ndata);
+    return 0;
+  }
+  actData *chan=(actData *)malloc(sizeof(actData)*n);
+  assert(chan!=NULL);
+  int nread=GetData(format,field,0,0,nframes,0,type,chan,&status);
+  if ((status!=GD_E_OK)||(nread!=n)) {
+    free(chan);
+    return 1;
+  }
+  for (int ii=0;ii<decimate;ii++)
+    chan=decimate_vector(chan,&n);
+  if (n>ndata) {
+#pragma omp critical 
+    {
+      static int firsttime=1;
+      if (firsttime) {
+	firsttime=0;
+	fprintf(stderr,"Warning - data is longer than the TOD.  You should be very nervous about this, unless you expected to see this message.\n");
+      }
+    }
+  }
+  else
+    assert(n==ndata);
+  memcpy(out,chan,sizeof(actData)*ndata);
+  free(chan);
+  return 0;
+}
+
+// ----------------------------------------------------------------------------
+
 actData **read_dirfile_tod_data_from_rowcol_list (mbTOD *tod, int *row, int *col, int ndet, actData **data)
-//if data is non-null, assume the space is allocated.
+//if data is non-null, assume the space is allocated.  Channels are read DIRFILE_IO_THREADS at a time.
 {
   
-  int status;
   assert(tod!=NULL);
   //printf("reading format from %s.\n",tod->dirfile);
-  struct FormatType *format = GetFormat( tod->dirfile, NULL, &status );
+  const struct FormatType *format = get_dirfile_format( tod->dirfile );
   //printf("got it.\n");
   assert( format != NULL );
   
 
   
   if (data==NULL) {
-    actData *vec=(actData *)malloc(ndet*tod->ndata*sizeof(actData));
-    assert(vec!=NULL);
+    data=(actData **)malloc(ndet*sizeof(actData *));
+    actData *vec=(actData *)malloc((long)ndet*tod->ndata*sizeof(actData));
+    assert((data!=NULL)&&(vec!=NULL));
     for (int i=0;i<ndet;i++)
-      data[i]=vec+i*tod->ndata;
+      data[i]=vec+(long)i*tod->ndata;
   }
   
+  int bad=-1;
+#pragma omp parallel for num_threads(DIRFILE_IO_THREADS) schedule(dynamic,1) shared(tod,row,col,ndet,data,format) reduction(max:bad) default(none)
   for (int idet=0;idet<ndet;idet++) {
     assert(row[idet]<33);
     assert(col[idet]<32);
     char tesfield[]="tesdatar00c00";
     sprintf(tesfield,"tesdatar%02dc%02d",row[idet],col[idet]);
-    int n;
-#ifndef ACTDATA_DOUBLE
-    //printf("reading float channel\n");
-    actData *chan = dirfile_read_float_channel( format, tesfield, &n );
-#else
-    //printf("reading double channel\n");
-    actData *chan = dirfile_read_double_channel( format, tesfield, &n );
-#endif
-    //printf("finished channel.\n");
-    for (int ii=0;ii<tod->decimate;ii++)
-      chan=decimate_vector(chan,&n);
-    if (n>tod->ndata) {
-#pragma omp critical 
-      {
-	static int firsttime=1;
-	if (firsttime) {
-	  firsttime=0;
-	  fprintf(stderr,"Warning - data is longer than the TOD.  You should be very nervous about this, unless you expected to see this message.\n");
-	}
-      }
-    }
-    else
-      assert(n==tod->ndata);
-    memcpy(data[idet],chan,sizeof(actData)*tod->ndata);
-    free(chan);
+    if (read_dirfile_channel_into(format,tesfield,data[idet],tod->ndata,tod->decimate))
+      bad=idet;
   }
+  if (bad>=0)
+    fprintf(stderr,"Error reading channel tesdatar%02dc%02d from %s\n",row[bad],col[bad],tod->dirfile);
+  assert(bad<0);
+  release_dirfile_format(format);
   return data;
 }
 
 
 
+// ----------------------------------------------------------------------------
+//Reading the next TOD in the background.  There's one slot, so at most one TOD's worth of
+//data is in flight on top of whatever is being worked on.  The slot isn't locked: it's only
+//meant for a serial loop over TODs (make_initial_mapset), so starting a prefetch, or taking
+//one over, from inside a parallel region is an error.
+typedef struct {
+  mbTOD *tod;
+  actData **data;
+  pthread_t thread;
+  bool active;
+} DirfilePrefetch;
+
+static DirfilePrefetch dirfile_prefetch={NULL,NULL,0,false};
+
+static void *run_dirfile_prefetch(void *arg)
+{
+  DirfilePrefetch *pf=(DirfilePrefetch *)arg;
+  pf->data=read_dirfile_tod_data_from_rowcol_list(pf->tod,pf->tod->rows,pf->tod->cols,pf->tod->ndet,NULL);
+  return NULL;
+}
+
+static void drop_dirfile_prefetch()
+{
+  if (!dirfile_prefetch.active)
+    return;
+  pthread_join(dirfile_prefetch.thread,NULL);
+  free(dirfile_prefetch.data[0]);
+  free(dirfile_prefetch.data);
+  dirfile_prefetch.data=NULL;
+  dirfile_prefetch.tod=NULL;
+  dirfile_prefetch.active=false;
+}
+
+void prefetch_dirfile_tod_data(mbTOD *tod)
+//start reading tod's data in the background.  read_dirfile_tod_data picks it up.  Serial
+//TOD loops only, see above.
+{
+  assert(!omp_in_parallel());
+  drop_dirfile_prefetch();
+  if (is_nktod_file(tod->dirfile))  //containers are cheap to open, and may be mapped in place.
+    return;
+  dirfile_prefetch.tod=tod;
+  if (pthread_create(&dirfile_prefetch.thread,NULL,run_dirfile_prefetch,&dirfile_prefetch)==0)
+    dirfile_prefetch.active=true;
+}
+
+static int take_dirfile_prefetch(mbTOD *tod)
+//if tod is being prefetched, wait for it and hand over the data.  Returns 1 if tod has its data.
+{
+  if ((!dirfile_prefetch.active)||(dirfile_prefetch.tod!=tod))
+    return 0;
+  assert(!omp_in_parallel());
+  pthread_join(dirfile_prefetch.thread,NULL);
+  actData **data=dirfile_prefetch.data;
+  dirfile_prefetch.active=false;
+  dirfile_prefetch.data=NULL;
+  dirfile_prefetch.tod=NULL;
+  if (tod->data==NULL) {
+    tod->data=data;
+    return 1;
+  }
+  for (int i=0;i<tod->ndet;i++)
+    memcpy(tod->data[i],data[i],sizeof(actData)*tod->ndata);
+  free(data[0]);
+  free(data);
+  return 1;
+}
+
 // ----------------------------------------------------------------------------
 
 void read_dirfile_tod_data (mbTOD *tod)
@@ -453,7 +831,12 @@ void read_dirfile_tod_data (mbTOD *tod)
   assert(tod!=NULL);
   if (!tod->have_data)
     tod->data=NULL;
-  tod->data=read_dirfile_tod_data_from_rowcol_list(tod,tod->rows,tod->cols,tod->ndet,tod->data);
+  if (is_nktod_file(tod->dirfile)) {
+    read_nktod_data(tod);
+    return;
+  }
+  if (!take_dirfile_prefetch(tod))
+    tod->data=read_dirfile_tod_data_from_rowcol_list(tod,tod->rows,tod->cols,tod->ndet,tod->data);
   tod->have_data=1;
   
 
@@ -516,4 +899,530 @@ read_dirfile_tod( const char *filename )
   return tod;
 }
 
+// ----------------------------------------------------------------------------
+//Single-file TOD container.  A fixed header, then the detector table, boresight, cuts and
+//pointing offsets, an index with one entry per detector, and the detector-major data
+//block, every section aligned.  Uncompressed data starts on a page boundary so it can be
+//mapped in place.  Detectors can be stored XOR-delta coded, each one only if it shrinks.
+
+#define NKTOD_MAGIC "NKTOD01"
+#define NKTOD_VERSION 1
+#define NKTOD_ALIGN 64
+#define NKTOD_PAGE 4096
+#define NKTOD_RAW 0
+#define NKTOD_XOR 1
+
+typedef struct {
+  char magic[8];
+  int32_t version;
+  int32_t ndet;
+  int32_t ndata;
+  int32_t nrow;
+  int32_t ncol;
+  int32_t elem_size;   //bytes per data sample, sizeof(actData) of the writer
+  int32_t ncut;
+  int32_t have_offsets;
+  double ctime;
+  double deltat;
+  int64_t off_rows;
+  int64_t off_cols;
+  int64_t off_az;
+  int64_t off_alt;
+  int64_t off_cuts;
+  int64_t off_offsets;
+  int64_t off_index;
+  int64_t off_data;
+  int64_t file_len;
+  char pad[104];
+} NkTodHeader;
+
+typedef struct {
+  int64_t offset;
+  int64_t nbyte;
+  int32_t mode;
+  int32_t pad;
+} NkTodDetIndex;
+
+static int64_t nktod_align(int64_t off, int64_t align)
+{
+  return ((off+align-1)/align)*align;
+}
+
+// ----------------------------------------------------------------------------
+
+int is_nktod_file(const char *filename)
+{
+  FILE *infile=fopen(filename,"r");
+  if (!infile)
+    return 0;
+  char magic[8];
+  int ok=(fread(magic,1,8,infile)==8)&&(memcmp(magic,NKTOD_MAGIC,8)==0);
+  fclose(infile);
+  return ok;
+}
+
+// ----------------------------------------------------------------------------
+
+static uint64_t nktod_get_word(const unsigned char *in, int es)
+{
+  if (es==4) {
+    uint32_t w;
+    memcpy(&w,in,4);
+    return w;
+  }
+  uint64_t w;
+  memcpy(&w,in,8);
+  return w;
+}
+
+static long nktod_encode_det(const unsigned char *in, int n, int es, unsigned char *out)
+//XOR each sample with the previous one and drop the leading zero bytes.  A nibble per
+//sample says how many bytes were kept.  Returns the encoded length.
+{
+  unsigned char *ctrl=out;
+  unsigned char *payload=out+(n+1)/2;
+  memset(ctrl,0,(n+1)/2);
+  uint64_t prev=0;
+  for (int i=0;i<n;i++) {
+    uint64_t w=nktod_get_word(in+(long)i*es,es);
+    uint64_t x=w^prev;
+    prev=w;
+    int nb=0;
+    while ((nb<es)&&(x>>(8*nb)))
+      nb++;
+    ctrl[i>>1]|=(i&1 ? nb<<4 : nb);
+    for (int j=0;j<nb;j++)
+      *payload++=(x>>(8*j))&0xff;
+  }
+  return payload-out;
+}
+
+static void nktod_decode_det(const unsigned char *in, int n, int es, unsigned char *out)
+{
+  const unsigned char *ctrl=in;
+  const unsigned char *payload=in+(n+1)/2;
+  uint64_t prev=0;
+  for (int i=0;i<n;i++) {
+    int nb=(i&1 ? ctrl[i>>1]>>4 : ctrl[i>>1]&15);
+    uint64_t x=0;
+    for (int j=0;j<nb;j++)
+      x|=((uint64_t)(*payload++))<<(8*j);
+    prev^=x;
+    if (es==4) {
+      uint32_t w=prev;
+      memcpy(out+(long)i*4,&w,4);
+    }
+    else
+      memcpy(out+(long)i*8,&prev,8);
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+int write_nktod(const mbTOD *tod, const char *filename, int compress)
+//write a TOD, with its data, to a container file.  compress asks for XOR-delta coding of
+//detectors that get smaller with it.  Returns 0 on success.
+{
+  assert(tod);
+  if (!tod->have_data) {
+    fprintf(stderr,"No data in TOD in write_nktod.\n");
+    return 1;
+  }
+  int es=sizeof(actData);
+  long rowbytes=(long)tod->ndata*es;
+
+  //cuts as (row,col,first,last), row -1 for global cuts.
+  int ncut=0;
+  int32_t *cutvec=NULL;
+  if (tod->cuts) {
+    for (int pass=0;pass<2;pass++) {
+      int icut=0;
+      for (int r=-1;r<tod->cuts->nrow;r++)
+	for (int c=(r<0 ? tod->cuts->ncol-1 : 0);c<tod->cuts->ncol;c++) {
+	  const mbCutList *list=(r<0 ? tod->cuts->globalCuts : tod->cuts->detCuts[r][c]);
+	  if (!list)
+	    continue;
+	  for (const mbSingleCut *cut=list->head;cut;cut=cut->next) {
+	    if (pass) {
+	      cutvec[4*icut]=(r<0 ? -1 : r);
+	      cutvec[4*icut+1]=(r<0 ? -1 : c);
+	      cutvec[4*icut+2]=cut->indexFirst;
+	      cutvec[4*icut+3]=cut->indexLast;
+	    }
+	    icut++;
+	  }
+	}
+      if (!pass) {
+	ncut=icut;
+	cutvec=(int32_t *)malloc(sizeof(int32_t)*4*(ncut>0 ? ncut : 1));
+	assert(cutvec);
+      }
+    }
+  }
+
+  const mbPointingOffset *po=tod->pointingOffset;
+  NkTodHeader head;
+  memset(&head,0,sizeof(head));
+  memcpy(head.magic,NKTOD_MAGIC,8);
+  head.version=NKTOD_VERSION;
+  head.ndet=tod->ndet;
+  head.ndata=tod->ndata;
+  head.nrow=tod->nrow;
+  head.ncol=tod->ncol;
+  head.elem_size=es;
+  head.ncut=ncut;
+  head.have_offsets=(po!=NULL);
+  head.ctime=tod->ctime;
+  head.deltat=tod->deltat;
+  int64_t off=nktod_align(sizeof(head),NKTOD_ALIGN);
+  head.off_rows=off;
+  off=nktod_align(off+sizeof(int32_t)*tod->ndet,NKTOD_ALIGN);
+  head.off_cols=off;
+  off=nktod_align(off+sizeof(int32_t)*tod->ndet,NKTOD_ALIGN);
+  head.off_az=off;
+  off=nktod_align(off+sizeof(double)*tod->ndata,NKTOD_ALIGN);
+  head.off_alt=off;
+  off=nktod_align(off+sizeof(double)*tod->ndata,NKTOD_ALIGN);
+  head.off_cuts=off;
+  off=nktod_align(off+sizeof(int32_t)*4*ncut,NKTOD_ALIGN);
+  head.off_offsets=off;
+  if (po)
+    off=nktod_align(off+sizeof(int32_t)*4+sizeof(double)*(po->nparam+2L*po->nrow*po->ncol),NKTOD_ALIGN);
+  head.off_index=off;
+  off=nktod_align(off+sizeof(NkTodDetIndex)*tod->ndet,NKTOD_PAGE);
+  head.off_data=off;
+
+  //encode detectors in parallel, keeping the coded form only where it's smaller.
+  NkTodDetIndex *index=(NkTodDetIndex *)calloc(tod->ndet>0 ? tod->ndet : 1,sizeof(NkTodDetIndex));
+  unsigned char **coded=(unsigned char **)calloc(tod->ndet>0 ? tod->ndet : 1,sizeof(unsigned char *));
+  assert(index&&coded);
+  if (compress) {
+#pragma omp parallel for schedule(dynamic,4) shared(tod,index,coded,es,rowbytes) default(none)
+    for (int i=0;i<tod->ndet;i++) {
+      unsigned char *buf=(unsigned char *)malloc((tod->ndata+1)/2+rowbytes);
+      assert(buf);
+      long nbyte=nktod_encode_det((const unsigned char *)tod->data[i],tod->ndata,es,buf);
+      if (nbyte<rowbytes) {
+	coded[i]=buf;
+	index[i].nbyte=nbyte;
+	index[i].mode=NKTOD_XOR;
+      }
+      else
+	free(buf);
+    }
+  }
+  for (int i=0;i<tod->ndet;i++) {
+    if (index[i].mode==NKTOD_RAW)
+      index[i].nbyte=rowbytes;
+    index[i].offset=off;
+    off+=index[i].nbyte;
+  }
+  head.file_len=off;
+
+  char tmpname[strlen(filename)+8];
+  sprintf(tmpname,"%s.tmp",filename);
+  FILE *outfile=fopen(tmpname,"w");
+  if (!outfile) {
+    fprintf(stderr,"Unable to open %s for writing in write_nktod.\n",tmpname);
+    free(cutvec);
+    free(index);
+    free(coded);
+    return 1;
+  }
+  fwrite(&head,sizeof(head),1,outfile);
+  fseek(outfile,head.off_rows,SEEK_SET);
+  for (int i=0;i<tod->ndet;i++) {
+    int32_t rc=tod->rows[i];
+    fwrite(&rc,sizeof(rc),1,outfile);
+  }
+  fseek(outfile,head.off_cols,SEEK_SET);
+  for (int i=0;i<tod->ndet;i++) {
+    int32_t rc=tod->cols[i];
+    fwrite(&rc,sizeof(rc),1,outfile);
+  }
+  fseek(outfile,head.off_az,SEEK_SET);
+  for (int i=0;i<tod->ndata;i++) {
+    double x=tod->az[i];
+    fwrite(&x,sizeof(x),1,outfile);
+  }
+  fseek(outfile,head.off_alt,SEEK_SET);
+  for (int i=0;i<tod->ndata;i++) {
+    double x=tod->alt[i];
+    fwrite(&x,sizeof(x),1,outfile);
+  }
+  fseek(outfile,head.off_cuts,SEEK_SET);
+  if (ncut)
+    fwrite(cutvec,sizeof(int32_t),4*ncut,outfile);
+  if (po) {
+    fseek(outfile,head.off_offsets,SEEK_SET);
+    int32_t pohead[4]={po->nrow,po->ncol,po->nparam,po->fitType};
+    fwrite(pohead,sizeof(int32_t),4,outfile);
+    for (int i=0;i<po->nparam;i++) {
+      double x=po->fit[i];
+      fwrite(&x,sizeof(x),1,outfile);
+    }
+    for (int r=0;r<po->nrow;r++)
+      for (int c=0;c<po->ncol;c++) {
+	double x=po->offsetAlt[r][c];
+	fwrite(&x,sizeof(x),1,outfile);
+      }
+    for (int r=0;r<po->nrow;r++)
+      for (int c=0;c<po->ncol;c++) {
+	double x=po->offsetAzCosAlt[r][c];
+	fwrite(&x,sizeof(x),1,outfile);
+      }
+  }
+  fseek(outfile,head.off_index,SEEK_SET);
+  fwrite(index,sizeof(NkTodDetIndex),tod->ndet,outfile);
+  fseek(outfile,head.off_data,SEEK_SET);
+  for (int i=0;i<tod->ndet;i++) {
+    if (coded[i]) {
+      fwrite(coded[i],1,index[i].nbyte,outfile);
+      free(coded[i]);
+    }
+    else
+      fwrite(tod->data[i],1,rowbytes,outfile);
+  }
+  int bad=fclose(outfile);
+  if (!bad)
+    bad=rename(tmpname,filename);
+  if (bad)
+    fprintf(stderr,"Error writing %s in write_nktod.\n",filename);
+  free(cutvec);
+  free(index);
+  free(coded);
+  return bad;
+}
+
+// ----------------------------------------------------------------------------
+
+int convert_dirfile_to_nktod(const char *dirfile, const char *filename, int compress)
+//read a TOD from a dirfile and write it as a container.  Returns 0 on success.
+{
+  mbTOD *tod=read_dirfile_tod_header(dirfile);
+  if (!tod)
+    return 1;
+  read_dirfile_tod_data(tod);
+  int bad=write_nktod(tod,filename,compress);
+  free(tod->data[0]);
+  free(tod->data);
+  free(tod->az);
+  free(tod->alt);
+  free(tod->rows);
+  free(tod->cols);
+  free(tod->dirfile);
+  free(tod);
+  return bad;
+}
+
+// ----------------------------------------------------------------------------
+
+static int read_nktod_file_header(FILE *infile, NkTodHeader *head)
+{
+  if ((fread(head,sizeof(NkTodHeader),1,infile)!=1)||(memcmp(head->magic,NKTOD_MAGIC,8))||(head->version!=NKTOD_VERSION))
+    return 1;
+  if ((head->elem_size!=4)&&(head->elem_size!=8))
+    return 1;
+  return 0;
+}
+
+static int read_nktod_section(FILE *infile, int64_t off, void *buf, size_t nbyte)
+{
+  if (nbyte==0)
+    return 0;
+  if (fseek(infile,off,SEEK_SET))
+    return 1;
+  return (fread(buf,1,nbyte,infile)!=nbyte);
+}
+
+// ----------------------------------------------------------------------------
+
+int read_nktod_size(const char *filename, int *ndet, int *ndata)
+{
+  FILE *infile=fopen(filename,"r");
+  if (!infile)
+    return 1;
+  NkTodHeader head;
+  int bad=read_nktod_file_header(infile,&head);
+  fclose(infile);
+  if (bad)
+    return 1;
+  *ndet=head.ndet;
+  *ndata=head.ndata;
+  return (*ndata>0 ? 0 : 1);
+}
+
+// ----------------------------------------------------------------------------
+
+mbTOD *read_nktod_header(const char *filename)
+//everything but the data, including cuts and pointing offsets if the file has them.
+{
+  FILE *infile=fopen(filename,"r");
+  if (!infile)
+    return NULL;
+  NkTodHeader head;
+  if (read_nktod_file_header(infile,&head)) {
+    fprintf(stderr,"Bad TOD container header in %s\n",filename);
+    fclose(infile);
+    return NULL;
+  }
+  mbTOD *tod=(mbTOD *)calloc(1,sizeof(mbTOD));
+  tod->dirfile=strdup(filename);
+  tod->ndet=head.ndet;
+  tod->ndata=head.ndata;
+  tod->nrow=head.nrow;
+  tod->ncol=head.ncol;
+  tod->ctime=head.ctime;
+  tod->deltat=head.deltat;
+  tod->rows=(int *)malloc(sizeof(int)*(tod->ndet>0 ? tod->ndet : 1));
+  tod->cols=(int *)malloc(sizeof(int)*(tod->ndet>0 ? tod->ndet : 1));
+  tod->az=(actData *)malloc(sizeof(actData)*tod->ndata);
+  tod->alt=(actData *)malloc(sizeof(actData)*tod->ndata);
+  int32_t *ivec=(int32_t *)malloc(sizeof(int32_t)*(tod->ndet>0 ? tod->ndet : 1));
+  double *dvec=(double *)malloc(sizeof(double)*tod->ndata);
+  int bad=read_nktod_section(infile,head.off_rows,ivec,sizeof(int32_t)*tod->ndet);
+  for (int i=0;i<tod->ndet;i++)
+    tod->rows[i]=ivec[i];
+  bad+=read_nktod_section(infile,head.off_cols,ivec,sizeof(int32_t)*tod->ndet);
+  for (int i=0;i<tod->ndet;i++)
+    tod->cols[i]=ivec[i];
+  bad+=read_nktod_section(infile,head.off_az,dvec,sizeof(double)*tod->ndata);
+  for (int i=0;i<tod->ndata;i++)
+    tod->az[i]=dvec[i];
+  bad+=read_nktod_section(infile,head.off_alt,dvec,sizeof(double)*tod->ndata);
+  for (int i=0;i<tod->ndata;i++)
+    tod->alt[i]=dvec[i];
+  free(ivec);
+  free(dvec);
+
+  if (head.ncut) {
+    int32_t *cutvec=(int32_t *)malloc(sizeof(int32_t)*4*head.ncut);
+    bad+=read_nktod_section(infile,head.off_cuts,cutvec,sizeof(int32_t)*4*head.ncut);
+    tod->cuts=mbCutsAlloc(tod->nrow,tod->ncol);
+    for (int i=0;i<head.ncut;i++) {
+      if (cutvec[4*i]<0)
+	mbCutsExtendGlobal(tod->cuts,cutvec[4*i+2],cutvec[4*i+3]);
+      else
+	mbCutsExtend(tod->cuts,cutvec[4*i+2],cutvec[4*i+3],cutvec[4*i],cutvec[4*i+1]);
+    }
+    free(cutvec);
+  }
+  if (head.have_offsets) {
+    int32_t pohead[4];
+    bad+=read_nktod_section(infile,head.off_offsets,pohead,sizeof(pohead));
+    mbPointingOffset *po=nkPointingOffsetAlloc(pohead[0],pohead[1],pohead[3]);
+    long n=po->nparam+2L*po->nrow*po->ncol;
+    double *vec=(double *)malloc(sizeof(double)*n);
+    bad+=read_nktod_section(infile,head.off_offsets+sizeof(pohead),vec,sizeof(double)*n);
+    for (int i=0;i<po->nparam;i++)
+      po->fit[i]=vec[i];
+    for (int r=0;r<po->nrow;r++)
+      for (int c=0;c<po->ncol;c++) {
+	po->offsetAlt[r][c]=vec[po->nparam+r*po->ncol+c];
+	po->offsetAzCosAlt[r][c]=vec[po->nparam+po->nrow*po->ncol+r*po->ncol+c];
+      }
+    free(vec);
+    tod->pointingOffset=po;
+  }
+  fclose(infile);
+  if (bad)
+    fprintf(stderr,"Warning - short read on TOD container %s\n",filename);
+  tod->data=NULL;
+  return tod;
+}
+
+// ----------------------------------------------------------------------------
+
+void read_nktod_data(mbTOD *tod)
+//fill tod->data from a container.  If the data are stored plain, at our precision and
+//undecimated, and the TOD doesn't have data space yet, the rows point straight into a private
+//mapping of the file, so nothing is copied until something writes to it.
+{
+  assert(tod);
+  FILE *infile=fopen(tod->dirfile,"r");
+  assert(infile);
+  NkTodHeader head;
+  int bad=read_nktod_file_header(infile,&head);
+  assert(!bad);
+  assert(head.ndet==tod->ndet);
+  NkTodDetIndex *index=(NkTodDetIndex *)malloc(sizeof(NkTodDetIndex)*(head.ndet>0 ? head.ndet : 1));
+  bad=read_nktod_section(infile,head.off_index,index,sizeof(NkTodDetIndex)*head.ndet);
+  assert(!bad);
+
+  bool plain=(head.elem_size==sizeof(actData))&&(tod->decimate==0)&&(head.ndata==tod->ndata);
+  for (int i=0;i<head.ndet;i++)
+    if (index[i].mode!=NKTOD_RAW)
+      plain=false;
+  if ((plain)&&(!tod->have_data)) {
+    void *addr=mmap(NULL,head.file_len,PROT_READ|PROT_WRITE,MAP_PRIVATE,fileno(infile),0);
+    if (addr!=MAP_FAILED) {
+      madvise(addr,head.file_len,MADV_WILLNEED);
+      tod->data=(actData **)malloc(sizeof(actData *)*(tod->ndet>0 ? tod->ndet : 1));
+      for (int i=0;i<tod->ndet;i++)
+	tod->data[i]=(actData *)((char *)addr+index[i].offset);
+      tod->data_map=addr;
+      tod->data_map_len=head.file_len;
+      tod->have_data=1;
+      free(index);
+      fclose(infile);
+      return;
+    }
+  }
 
+  if (!tod->have_data) {
+    tod->data=(actData **)malloc(sizeof(actData *)*(tod->ndet>0 ? tod->ndet : 1));
+    actData *vec=(actData *)malloc(sizeof(actData)*(long)tod->ndet*tod->ndata);
+    assert(tod->data&&vec);
+    for (int i=0;i<tod->ndet;i++)
+      tod->data[i]=vec+(long)i*tod->ndata;
+  }
+  int64_t nbyte_max=0;
+  for (int i=0;i<head.ndet;i++)
+    if (index[i].nbyte>nbyte_max)
+      nbyte_max=index[i].nbyte;
+  int fd=fileno(infile);
+  //decode detectors in parallel, each thread with its own staging buffers.
+#pragma omp parallel shared(tod,head,index,nbyte_max,fd) reduction(+:bad) default(none)
+  {
+    unsigned char *in=(unsigned char *)malloc(nbyte_max>0 ? nbyte_max : 1);
+    unsigned char *raw=(unsigned char *)malloc((long)head.ndata*head.elem_size);
+    actData *chan=(actData *)malloc(sizeof(actData)*head.ndata);
+#pragma omp for schedule(dynamic,4)
+    for (int i=0;i<head.ndet;i++) {
+      if (pread(fd,in,index[i].nbyte,index[i].offset)!=index[i].nbyte) {
+	bad++;
+	continue;
+      }
+      if (index[i].mode==NKTOD_XOR)
+	nktod_decode_det(in,head.ndata,head.elem_size,raw);
+      else
+	memcpy(raw,in,(long)head.ndata*head.elem_size);
+      for (int j=0;j<head.ndata;j++)
+	chan[j]=(head.elem_size==4 ? ((float *)raw)[j] : ((double *)raw)[j]);
+      if (tod->decimate) {
+	//decimate through a stream into chan itself, which is safe since outputs trail inputs.
+	DecimateStream ds;
+	setup_decimate_stream(&ds,tod->decimate,DECIMATE_CHUNK);
+	int nout=0;
+	for (int first=0;first<head.ndata;first+=DECIMATE_CHUNK) {
+	  int nchunk=(head.ndata-first<DECIMATE_CHUNK ? head.ndata-first : DECIMATE_CHUNK);
+	  memcpy(decimate_stream_input(&ds),chan+first,sizeof(actData)*nchunk);
+	  nout+=push_decimate_stream(&ds,nchunk,chan+nout);
+	}
+	nout+=finish_decimate_stream(&ds,chan+nout);
+	free_decimate_stream(&ds);
+	assert(nout>=tod->ndata);
+      }
+      memcpy(tod->data[i],chan,sizeof(actData)*tod->ndata);
+    }
+    free(in);
+    free(raw);
+    free(chan);
+  }
+  if (bad)
+    fprintf(stderr,"Error reading data from TOD container %s\n",tod->dirfile);
+  assert(!bad);
+  tod->have_data=1;
+  free(index);
+  fclose(infile);
+}
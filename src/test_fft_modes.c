@@ -0,0 +1,292 @@
+//Check filter_data, apply_noise and the banded noise model against the way they were done
+//before the FFTs were cached and threaded: a fresh FFTW_ESTIMATE plan per detector, the
+//filter applied to the spectrum, then the inverse transform divided by n.  Every @fft_mode
+//is run twice, so the second pass reuses the cached plans and noise scratch, with both
+//ESTIMATE and MEASURE plans.  Exits non-zero if anything differs by more than rounding.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+
+#include "ninkasi.h"
+#include "noise.h"
+#include "mbCuts.h"
+
+#define NDET 12
+#define NTHREAD 4
+#define TOL 1e-12
+
+/*--------------------------------------------------------------------------------*/
+static mbTOD *make_test_tod(int ndata, long seed)
+//a common mode plus drifts and white noise, so the rotations have something to find.  One
+//detector is always cut.
+{
+  mbTOD *tod=(mbTOD *)calloc(1,sizeof(mbTOD));
+  tod->ndet=NDET;
+  tod->ndata=ndata;
+  tod->deltat=1.0/400;
+  tod->nrow=1;
+  tod->ncol=NDET;
+  tod->rows=(int *)calloc(NDET,sizeof(int));
+  tod->cols=(int *)malloc(sizeof(int)*NDET);
+  for (int i=0;i<NDET;i++)
+    tod->cols[i]=i;
+  tod->cuts=mbCutsAlloc(tod->nrow,tod->ncol);
+  mbCutsSetAlwaysCut(tod->cuts,0,2);
+  tod->data=matrix(NDET,ndata);
+  tod->have_data=1;
+  srand48(seed);
+  actData *common=vector(ndata);
+  actData walk=0;
+  for (int j=0;j<ndata;j++) {
+    walk+=drand48()-0.5;
+    common[j]=walk+sin(0.01*j);
+  }
+  for (int i=0;i<NDET;i++) {
+    walk=0;
+    for (int j=0;j<ndata;j++) {
+      walk+=0.1*(drand48()-0.5);
+      tod->data[i][j]=(1+0.1*i)*common[j]+walk+drand48()-0.5;
+    }
+  }
+  free(common);
+  return tod;
+}
+/*--------------------------------------------------------------------------------*/
+static actComplex **ref_fft(mbTOD *tod)
+{
+  int nn=get_nn(tod->ndata);
+  actComplex **ft=cmatrix(tod->ndet,nn);
+  actData *vec=vector(tod->ndata);
+  for (int i=0;i<tod->ndet;i++) {
+    act_fftw_plan p=act_fftw_plan_dft_r2c_1d(tod->ndata,vec,ft[i],FFTW_ESTIMATE);
+    act_fftw_execute_dft_r2c(p,tod->data[i],ft[i]);
+    act_fftw_destroy_plan(p);
+  }
+  free(vec);
+  return ft;
+}
+/*--------------------------------------------------------------------------------*/
+static void ref_ifft(mbTOD *tod, actComplex **ft)
+{
+  for (int i=0;i<tod->ndet;i++) {
+    act_fftw_plan p=act_fftw_plan_dft_c2r_1d(tod->ndata,ft[i],tod->data[i],FFTW_ESTIMATE);
+    act_fftw_execute_dft_c2r(p,ft[i],tod->data[i]);
+    act_fftw_destroy_plan(p);
+    for (int j=0;j<tod->ndata;j++)
+      tod->data[i][j]/=tod->ndata;
+  }
+  free(ft[0]);
+  free(ft);
+}
+/*--------------------------------------------------------------------------------*/
+static void ref_filter_data(mbTOD *tod)
+//filter_data_wnoise with CalculateIfilter written out.  Always cut detectors are untouched.
+{
+  int n=tod->ndata;
+  int nn=get_nn(n);
+  actComplex *vec=cvector(nn);
+  actData delta=1.0/(tod->deltat*n);
+  for (int i=0;i<tod->ndet;i++) {
+    if (mbCutsIsAlwaysCut(tod->cuts,tod->rows[i],tod->cols[i]))
+      continue;
+    actData white=n*tod->noise->noises[i].params[0];
+    actData knee_coeff=n*tod->noise->noises[i].params[1];
+    actData fac=pow(delta,tod->noise->noises[i].powlaw)*knee_coeff;
+    act_fftw_plan p=act_fftw_plan_dft_r2c_1d(n,tod->data[i],vec,FFTW_ESTIMATE);
+    act_fftw_execute_dft_r2c(p,tod->data[i],vec);
+    act_fftw_destroy_plan(p);
+    for (int j=1;j<nn;j++)
+      vec[j]/=((white+pow(j,tod->noise->noises[i].powlaw)*fac)*n);
+    vec[0]/=(2*(white+fac)*n);
+    p=act_fftw_plan_dft_c2r_1d(n,vec,tod->data[i],FFTW_ESTIMATE);
+    act_fftw_execute_dft_c2r(p,vec,tod->data[i]);
+    act_fftw_destroy_plan(p);
+  }
+  free(vec);
+}
+/*--------------------------------------------------------------------------------*/
+static void ref_apply_noise_powlaw(mbTOD *tod)
+//the power law branch of apply_noise.  amp of zero leaves the detector alone.
+{
+  int nn=get_nn(tod->ndata);
+  actComplex **ft=ref_fft(tod);
+  for (int det=0;det<tod->ndet;det++) {
+    actData amp=tod->noise->noises[det].params[0];
+    actData knee_inv=1.0/tod->noise->noises[det].params[1];
+    actData ind=tod->noise->noises[det].params[2];
+    if (amp==0)
+      continue;
+    ft[det][0]=0;
+    actData fac=1.0/((actData)tod->ndata)/tod->deltat;
+    for (int i=1;i<nn;i++) {
+      actData tt=((actData)i)*fac;
+      ft[det][i]=ft[det][i]/(amp*(1+pow(tt*knee_inv,-ind)));
+    }
+  }
+  ref_ifft(tod,ft);
+}
+/*--------------------------------------------------------------------------------*/
+static actComplex **ref_rotate(mbTOD *tod, actComplex **mat_in, bool do_forward)
+{
+  mbNoiseVectorStructBands *noise=tod->band_noise;
+  int nn=get_nn(tod->ndata);
+  actComplex **mat=cmatrix(tod->ndet,nn);
+  memcpy(mat[0],mat_in[0],sizeof(actComplex)*nn*tod->ndet);
+  for (int band=0;band<noise->nband;band++)
+    if (noise->do_rotations[band]) {
+      char trans=(do_forward ? 'n' : 't');
+      actData **rotmat=(do_forward ? noise->rot_mats[band] : noise->inv_rot_mats_transpose[band]);
+      act_gemm('n',trans,2*(noise->ibands[band+1]-noise->ibands[band]),tod->ndet,tod->ndet,1.0,(actData *)(&(mat_in[0][noise->ibands[band]])),2*nn,rotmat[0],tod->ndet,0.0,(actData *)(&(mat[0][noise->ibands[band]])),2*nn);
+    }
+  free(mat_in[0]);
+  free(mat_in);
+  return mat;
+}
+/*--------------------------------------------------------------------------------*/
+static void ref_apply_banded_noise(mbTOD *tod)
+//apply_banded_noise_model with the per-band weights written out.
+{
+  mbNoiseVectorStructBands *noise=tod->band_noise;
+  actComplex **ft=ref_fft(tod);
+  if (do_I_have_rotations(tod))
+    ft=ref_rotate(tod,ft,true);
+  for (int det=0;det<tod->ndet;det++)
+    for (int band=0;band<noise->nband;band++) {
+      mbNoiseParams1PixBand *params=&(noise->noise_params[band][det]);
+      mbNoiseParams1PixBand *left=&(noise->noise_params[(band>0 ? band-1 : 0)][det]);
+      mbNoiseParams1PixBand *right=&(noise->noise_params[(band<noise->nband-1 ? band+1 : band)][det]);
+      int n=params->i_high-params->i_low;
+      int nn=n/2;
+      for (int i=0;i<n;i++) {
+	actData w=params->noise_data[0];
+	if (params->noise_type==MBNOISE_FULL)
+	  w=params->noise_data[i];
+	if ((params->noise_type==MBNOISE_INTERP)&&(i<nn))
+	  w=(1.0-((actData)i)/nn)*left->noise_data[0]+(((actData)i)/nn)*params->noise_data[0];
+	if ((params->noise_type==MBNOISE_INTERP)&&(i>=nn)) {
+	  actData fac=((actData)(i-nn))/((actData)(n-nn));
+	  w=fac*right->noise_data[0]+(1-fac)*params->noise_data[0];
+	}
+	ft[det][i+params->i_low]*=w;
+      }
+    }
+  if (do_I_have_rotations(tod))
+    ft=ref_rotate(tod,ft,false);
+  ref_ifft(tod,ft);
+}
+/*--------------------------------------------------------------------------------*/
+static actData compare_tods(actData **ref, actData **out, int ndet, int ndata)
+//largest difference relative to the largest sample of its detector, since the filters leave
+//detectors at very different levels.  NaNs count as infinitely wrong.
+{
+  actData worst=0;
+  for (int i=0;i<ndet;i++) {
+    actData maxval=0,maxerr=0;
+    for (int j=0;j<ndata;j++) {
+      if (fabs(ref[i][j])>maxval)
+	maxval=fabs(ref[i][j]);
+      actData err=fabs(out[i][j]-ref[i][j]);
+      if (!(err<=maxerr))
+	maxerr=(isnan(err) ? INFINITY : err);
+    }
+    if (!(maxerr/maxval<=worst))
+      worst=maxerr/maxval;
+  }
+  return worst;
+}
+/*--------------------------------------------------------------------------------*/
+static int check_modes(mbTOD *tod, actData **orig, void (*ref)(mbTOD *), void (*fun)(mbTOD *), const char *what)
+{
+  int ndet=tod->ndet;
+  int ndata=tod->ndata;
+  actData **ref_out=matrix(ndet,ndata);
+  memcpy(tod->data[0],orig[0],sizeof(actData)*ndet*ndata);
+  ref(tod);
+  memcpy(ref_out[0],tod->data[0],sizeof(actData)*ndet*ndata);
+
+  unsigned flags[]={FFTW_ESTIMATE,FFTW_MEASURE};
+  const char *flag_names[]={"estimate","measure"};
+  int modes[]={NK_FFT_SPLIT,NK_FFT_BATCHED,NK_FFT_BATCHED,NK_FFT_THREADED};
+  int batches[]={1,NK_FFT_BATCH,5,1};
+  const char *mode_names[]={"split","batched","batched","threaded"};
+  int nfail=0;
+  actData maxerr=0;
+  for (int f=0;f<2;f++) {
+    set_fft_plan_flags(flags[f]);
+    for (int m=0;m<4;m++) {
+      set_fft_threading(modes[m],NTHREAD,batches[m]);
+      for (int rep=0;rep<2;rep++) {
+	char name[256];
+	sprintf(name,"%s, %d samples, %s batch %d, %s, pass %d",what,ndata,mode_names[m],batches[m],flag_names[f],rep+1);
+	memcpy(tod->data[0],orig[0],sizeof(actData)*ndet*ndata);
+	fun(tod);
+	actData err=compare_tods(ref_out,tod->data,ndet,ndata);
+	if (!(err<=TOL)) {
+	  fprintf(stderr,"%s: relative difference %12.4e from the per-detector transforms.\n",name,err);
+	  nfail++;
+	}
+	if (err>maxerr)
+	  maxerr=err;
+      }
+    }
+  }
+  printf("%s, %d samples: largest relative difference %12.4e over all modes.\n",what,ndata,maxerr);
+  set_fft_plan_flags(FFTW_ESTIMATE);
+  set_fft_threading(NK_FFT_SPLIT,0,NK_FFT_BATCH);
+  free_matrix(ref_out);
+  return nfail;
+}
+/*--------------------------------------------------------------------------------*/
+static int check_tod(int ndata, long seed)
+{
+  int nfail=0;
+  mbTOD *tod=make_test_tod(ndata,seed);
+  actData **orig=matrix(tod->ndet,ndata);
+  memcpy(orig[0],tod->data[0],sizeof(actData)*tod->ndet*ndata);
+  createFFTWplans1TOD(tod);
+
+  set_tod_noise(tod,1.0,2.0,-2.0);
+  nfail+=check_modes(tod,orig,ref_filter_data,filter_data,"filter_data");
+
+  actData amps[NDET],knees[NDET],pows[NDET];
+  for (int i=0;i<NDET;i++) {
+    amps[i]=1+0.1*i;
+    knees[i]=1+0.5*i;
+    pows[i]=-1.5-0.1*i;
+  }
+  amps[3]=0;  //left as it is
+  set_noise_powlaw(tod,amps,knees,pows);
+  nfail+=check_modes(tod,orig,ref_apply_noise_powlaw,apply_noise,"apply_noise power law");
+
+  actData bands[]={0,0.5,2,10,1000};
+  mbNoiseType types[]={MBNOISE_CONSTANT,MBNOISE_INTERP,MBNOISE_FULL,MBNOISE_CONSTANT};
+  bool no_rots[]={false,false,false,false};
+  bool rots[]={true,true,false,true};
+  memcpy(tod->data[0],orig[0],sizeof(actData)*tod->ndet*ndata);
+  allocate_tod_noise_bands(tod,bands,4);
+  get_simple_banded_noise_model(tod,no_rots,types);
+  nfail+=check_modes(tod,orig,ref_apply_banded_noise,apply_noise,"banded noise");
+  memcpy(tod->data[0],orig[0],sizeof(actData)*tod->ndet*ndata);
+  allocate_tod_noise_bands(tod,bands,4);
+  get_simple_banded_noise_model(tod,rots,types);
+  nfail+=check_modes(tod,orig,ref_apply_banded_noise,apply_noise,"banded noise with rotations");
+
+  free_matrix(orig);
+  return nfail;
+}
+/*--------------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+  int nfail=0;
+  //even and odd lengths take different paths through the r2c transforms.
+  nfail+=check_tod(1000,1);
+  nfail+=check_tod(1001,2);
+  if (nfail) {
+    fprintf(stderr,"%d noise filters differ from the per-detector transforms.\n",nfail);
+    return 1;
+  }
+  printf("noise filters match the per-detector transforms in every FFT mode.\n");
+  return 0;
+}
@@ -0,0 +1,21 @@
+//Check the getdata conversion table and the fused LINCOM kernels against the scalar code,
+//then time the two on the type pairs TES channels go through.  Exits non-zero on any mismatch.
+//Usage: test_getdata [nbench]
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "getdata.h"
+
+int main(int argc, char *argv[])
+{
+  int nbench=10000000;
+  if (argc>1)
+    nbench=atoi(argv[1]);
+  int nbad=GetDataCheckConversions(nbench);
+  if (nbad) {
+    fprintf(stderr,"%d getdata conversions don't match the scalar code.\n",nbad);
+    return 1;
+  }
+  printf("all getdata conversions match.\n");
+  return 0;
+}
@@ -0,0 +1,165 @@
+//Round trip a dirfile through a TOD container: convert it, then check that the header and the
+//data read back from the container match the dirfile read exactly, with and without
+//decimation and with and without compression.  Exits non-zero on any mismatch.
+//Usage: test_nktod [dirfile]    with no dirfile, a small synthetic one is made in /tmp.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/mman.h>
+
+#include "ninkasi.h"
+#include "readtod.h"
+
+#define TEST_NDATA 100003
+#define TEST_NROW 2
+#define TEST_NCOL 3
+
+/*--------------------------------------------------------------------------------*/
+static void write_test_channel(const char *dir, const char *name, const void *vec, size_t size, long n)
+{
+  char fname[MAXLEN];
+  snprintf(fname,MAXLEN,"%s/%s",dir,name);
+  FILE *outfile=fopen(fname,"w");
+  assert(outfile);
+  size_t nwrite=fwrite(vec,size,n,outfile);
+  assert(nwrite==n);
+  fclose(outfile);
+}
+/*--------------------------------------------------------------------------------*/
+static void make_test_dirfile(const char *dir)
+//encoders, a clock and a few TES channels of float noise with a drift on top.
+{
+  char fname[MAXLEN];
+  snprintf(fname,MAXLEN,"%s/format",dir);
+  FILE *format=fopen(fname,"w");
+  assert(format);
+  fprintf(format,"Enc_Az_Deg RAW f 1\nEnc_El_Deg RAW f 1\ncpu_s RAW U 1\ncpu_us RAW U 1\n");
+  for (int r=0;r<TEST_NROW;r++)
+    for (int c=0;c<TEST_NCOL;c++)
+      fprintf(format,"tesdatar%02dc%02d RAW f 1\n",r,c);
+  fclose(format);
+
+  float *fvec=(float *)malloc(sizeof(float)*TEST_NDATA);
+  uint32_t *uvec=(uint32_t *)malloc(sizeof(uint32_t)*TEST_NDATA);
+  for (long i=0;i<TEST_NDATA;i++)
+    fvec[i]=120+5*sin(2*M_PI*i/4000.0);
+  write_test_channel(dir,"Enc_Az_Deg",fvec,sizeof(float),TEST_NDATA);
+  for (long i=0;i<TEST_NDATA;i++)
+    fvec[i]=50+1e-4*i/TEST_NDATA;
+  write_test_channel(dir,"Enc_El_Deg",fvec,sizeof(float),TEST_NDATA);
+  for (long i=0;i<TEST_NDATA;i++)
+    uvec[i]=1200000000+i/400;
+  write_test_channel(dir,"cpu_s",uvec,sizeof(uint32_t),TEST_NDATA);
+  for (long i=0;i<TEST_NDATA;i++)
+    uvec[i]=(i%400)*2500;
+  write_test_channel(dir,"cpu_us",uvec,sizeof(uint32_t),TEST_NDATA);
+
+  srand48(1);
+  for (int r=0;r<TEST_NROW;r++)
+    for (int c=0;c<TEST_NCOL;c++) {
+      char name[32];
+      sprintf(name,"tesdatar%02dc%02d",r,c);
+      for (long i=0;i<TEST_NDATA;i++)
+	fvec[i]=1000*(r+1)+10*c+0.01*i+drand48()-0.5;
+      write_test_channel(dir,name,fvec,sizeof(float),TEST_NDATA);
+    }
+  free(fvec);
+  free(uvec);
+}
+/*--------------------------------------------------------------------------------*/
+static void free_test_tod(mbTOD *tod)
+{
+  if (tod->data_map)
+    munmap(tod->data_map,tod->data_map_len);
+  else
+    free(tod->data[0]);
+  free(tod->data);
+  free(tod->az);
+  free(tod->alt);
+  free(tod->rows);
+  free(tod->cols);
+  free(tod->dirfile);
+  free(tod);
+}
+/*--------------------------------------------------------------------------------*/
+static int compare_tods(const mbTOD *ref, const mbTOD *tod, const char *what)
+{
+  if ((ref->ndet!=tod->ndet)||(ref->ndata!=tod->ndata)) {
+    printf("%s: shape %d x %d doesn't match the dirfile's %d x %d.\n",what,tod->ndet,tod->ndata,ref->ndet,ref->ndata);
+    return 1;
+  }
+  long nbad=0;
+  for (int i=0;i<ref->ndet;i++)
+    if ((ref->rows[i]!=tod->rows[i])||(ref->cols[i]!=tod->cols[i]))
+      nbad++;
+  for (int i=0;i<ref->ndata;i++)
+    if ((ref->az[i]!=tod->az[i])||(ref->alt[i]!=tod->alt[i]))
+      nbad++;
+  for (int i=0;i<ref->ndet;i++)
+    for (int j=0;j<ref->ndata;j++)
+      if (ref->data[i][j]!=tod->data[i][j])
+	nbad++;
+  if ((ref->ctime!=tod->ctime)||(ref->deltat!=tod->deltat))
+    nbad++;
+  printf("%s: %ld mismatches.\n",what,nbad);
+  return (nbad>0);
+}
+/*--------------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+  char dirfile[MAXLEN];
+  bool made_dirfile=false;
+  if (argc>1)
+    strncpy(dirfile,argv[1],MAXLEN-1);
+  else {
+    strcpy(dirfile,"/tmp/test_nktod_XXXXXX");
+    if (!mkdtemp(dirfile)) {
+      fprintf(stderr,"Unable to make a scratch dirfile in /tmp.\n");
+      return 1;
+    }
+    make_test_dirfile(dirfile);
+    made_dirfile=true;
+  }
+
+  int nfail=0;
+  for (int compress=0;compress<2;compress++) {
+    char container[MAXLEN];
+    snprintf(container,MAXLEN,"%s.%d.nktod",dirfile,compress);
+    if (convert_dirfile_to_nktod(dirfile,container,compress)) {
+      fprintf(stderr,"Failed to convert %s to %s\n",dirfile,container);
+      return 1;
+    }
+    if (!is_nktod_file(container)) {
+      fprintf(stderr,"%s isn't recognized as a TOD container.\n",container);
+      return 1;
+    }
+    for (int decimate=0;decimate<3;decimate++) {
+      mbTOD *ref=read_dirfile_tod_header_decimate(dirfile,decimate);
+      read_dirfile_tod_data(ref);
+      mbTOD *tod=read_dirfile_tod_header_decimate(container,decimate);
+      read_dirfile_tod_data(tod);
+      char what[64];
+      sprintf(what,"compress %d, decimate %d",compress,decimate);
+      nfail+=compare_tods(ref,tod,what);
+      free_test_tod(ref);
+      free_test_tod(tod);
+    }
+    unlink(container);
+  }
+
+  if (made_dirfile) {
+    char cmd[2*MAXLEN];
+    snprintf(cmd,2*MAXLEN,"rm -rf %s",dirfile);
+    system(cmd);
+  }
+  if (nfail) {
+    fprintf(stderr,"%d container round trips failed.\n",nfail);
+    return 1;
+  }
+  printf("all container round trips match.\n");
+  return 0;
+}
@@ -0,0 +1,27 @@
+//Check that a white noise model filters data the same way in the FFT and DCT noise bases.
+//Exits non-zero if they differ by more than rounding.
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ninkasi.h"
+#include "noise.h"
+
+#define TOL 1e-10
+
+int main(int argc, char *argv[])
+{
+  int ndata[]={10000,10007};  //even and odd lengths take different paths through the r2c transforms.
+  int nfail=0;
+  for (int i=0;i<2;i++) {
+    actData err=check_noise_dct_white(8,ndata[i],i+1);
+    printf("%d samples: relative difference %12.4e\n",ndata[i],err);
+    if (!(err<TOL))
+      nfail++;
+  }
+  if (nfail) {
+    fprintf(stderr,"FFT and DCT white noise filters disagree.\n");
+    return 1;
+  }
+  printf("FFT and DCT white noise filters agree.\n");
+  return 0;
+}
@@ -0,0 +1,226 @@
+//Check PCGstep_work, which fuses the map updates and keeps M^-1 r between steps, against a PCG
+//step written with mapset_axpy/apply_preconditioner/mapset_times_mapset.  On one thread every
+//plane of x, r and p, polarization planes included, has to match bit for bit.  With more
+//threads the dot products are summed in a different order, so they only have to match to
+//rounding.  Exits non-zero on any mismatch.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+
+#include "ninkasi.h"
+#include "mbCuts.h"
+
+#define NDET 20
+#define NDATA 2000
+#define NPIX 5000
+#define NSTEP 5
+#define NTHREAD 4
+#define TOL 1e-12
+
+/*--------------------------------------------------------------------------------*/
+static mbTOD *make_test_tod(void)
+//saved pixelization so no pointing model is needed, and one detector always cut.  The data
+//get made by mapset2mapset.
+{
+  mbTOD *tod=(mbTOD *)calloc(1,sizeof(mbTOD));
+  tod->ndet=NDET;
+  tod->ndata=NDATA;
+  tod->deltat=1.0/400;
+  tod->nrow=1;
+  tod->ncol=NDET;
+  tod->rows=(int *)calloc(NDET,sizeof(int));
+  tod->cols=(int *)malloc(sizeof(int)*NDET);
+  for (int i=0;i<NDET;i++)
+    tod->cols[i]=i;
+  tod->cuts=mbCutsAlloc(tod->nrow,tod->ncol);
+  mbCutsSetAlwaysCut(tod->cuts,0,3);
+  tod->pixelization_saved=imatrix(NDET,NDATA);
+  srand48(1);
+  for (int i=0;i<NDET;i++)
+    for (int j=0;j<NDATA;j++)
+      tod->pixelization_saved[i][j]=(37*i+11*j+lrand48()%50)%(NPIX-200);  //the last pixels are never hit
+#ifdef ACTPOL
+  tod->twogamma_saved=matrix(NDET,NDATA);
+  for (int i=0;i<NDET;i++)
+    for (int j=0;j<NDATA;j++)
+      tod->twogamma_saved[i][j]=2*M_PI*drand48();
+#endif
+  return tod;
+}
+/*--------------------------------------------------------------------------------*/
+static MAPvec *make_test_mapset(int npol)
+{
+  MAP *map=(MAP *)calloc(1,sizeof(MAP));
+  map->projection=(nkProjection *)calloc(1,sizeof(nkProjection));
+  map->projection->proj_type=NK_RECT;
+  map->nx=NPIX/100;
+  map->ny=100;
+  map->npix=NPIX;
+#ifdef ACTPOL
+  for (int i=0;i<npol;i++)
+    map->pol_state[i]=1;
+#endif
+  map->map=vector(npol*NPIX);
+  memset(map->map,0,sizeof(actData)*npol*NPIX);
+  MAPvec *maps=(MAPvec *)calloc(1,sizeof(MAPvec));
+  maps->nmap=1;
+  maps->maps=(MAP **)malloc(sizeof(MAP *));
+  maps->maps[0]=map;
+  return maps;
+}
+/*--------------------------------------------------------------------------------*/
+static void ref_pcg_step(MAPvec *r, MAPvec *p, MAPvec *x, TODvec *tods, MAPvec *wts, PARAMS *params, actData *rsqr_out)
+//one PCG step built from the mapset calls, with fresh copies for everything.
+{
+  MAPvec *ap=make_mapset_copy(p);
+  MAPvec *mr=make_mapset_copy(r);
+  mapset2mapset(ap,tods,params);
+  apply_preconditioner(mr,wts,params);
+  actData rsqr=mapset_times_mapset(r,mr);
+  destroy_mapset(mr);
+  actData pap=mapset_times_mapset(p,ap);
+  actData alpha_k=rsqr/pap;
+  mapset_axpy(x,p,alpha_k);
+  MAPvec *rk=make_mapset_copy(r);
+  mapset_axpy(rk,ap,-alpha_k);
+  destroy_mapset(ap);
+  MAPvec *mrk=make_mapset_copy(rk);
+  apply_preconditioner(mrk,wts,params);
+  actData beta_k=mapset_times_mapset(rk,mrk)/rsqr;
+  MAPvec *pk=make_mapset_copy(mrk);
+  mapset_axpy(pk,p,beta_k);
+  copy_mapset2mapset(r,rk);
+  copy_mapset2mapset(p,pk);
+  destroy_mapset(rk);
+  destroy_mapset(pk);
+  destroy_mapset(mrk);
+  *rsqr_out=rsqr;
+}
+/*--------------------------------------------------------------------------------*/
+static void get_dense_plane(MAP *map, int plane, actData *out)
+//tiled maps have only the one plane, with missing tiles zero.
+{
+  if (!map->tiles) {
+    memcpy(out,map->map+(long)plane*map->npix,sizeof(actData)*map->npix);
+    return;
+  }
+  for (long i=0;i<map->npix;i++) {
+    const actData *tile=map->tiles[i/NK_MAP_TILE_LEN];
+    out[i]=(tile ? tile[i%NK_MAP_TILE_LEN] : 0);
+  }
+}
+/*--------------------------------------------------------------------------------*/
+static actData compare_maps(MAP *ref, MAP *map)
+//largest difference relative to the largest reference pixel of its plane.  0 means bit for bit.
+{
+  actData *a=vector(ref->npix);
+  actData *b=vector(ref->npix);
+  actData worst=0;
+  for (int plane=0;plane<get_npol_in_map(ref);plane++) {
+    get_dense_plane(ref,plane,a);
+    get_dense_plane(map,plane,b);
+    actData maxval=0,maxerr=0;
+    for (long i=0;i<ref->npix;i++) {
+      if (fabs(a[i])>maxval)
+	maxval=fabs(a[i]);
+      actData err=fabs(a[i]-b[i]);
+      if (!(err<=maxerr))
+	maxerr=(isnan(err) ? INFINITY : err);
+    }
+    actData rel=(maxval>0 ? maxerr/maxval : maxerr);
+    if (!(rel<=worst))
+      worst=rel;
+  }
+  free(a);
+  free(b);
+  return worst;
+}
+/*--------------------------------------------------------------------------------*/
+static int check_pcg_steps(TODvec *tods, PARAMS *params, int npol, bool tiled, int nthread, const char *what)
+{
+  omp_set_num_threads(nthread);
+  //a residual with something in every plane, and weights with unhit pixels.
+  MAPvec *b=make_test_mapset(npol);
+  MAPvec *wts=make_test_mapset(1);
+  srand48(2);
+  for (long i=0;i<(long)npol*NPIX;i++)
+    b->maps[0]->map[i]=drand48()-0.5;
+  for (long i=0;i<NPIX-200;i++)
+    wts->maps[0]->map[i]=1+10*drand48();
+  if (tiled) {
+    tile_map(b->maps[0]);
+    tile_map(wts->maps[0]);
+  }
+
+  MAPvec *r_ref=make_mapset_copy(b);
+  MAPvec *p_ref=make_mapset_copy(b);
+  apply_preconditioner(p_ref,wts,params);
+  //the step leaves p's polarization planes as r's, so start them somewhere else.
+  for (long i=NPIX;i<(long)npol*NPIX;i++)
+    p_ref->maps[0]->map[i]=drand48()-0.5;
+  MAPvec *x_ref=make_mapset_copy(b);
+  clear_mapset(x_ref);
+  MAPvec *r=make_mapset_copy(r_ref);
+  MAPvec *p=make_mapset_copy(p_ref);
+  MAPvec *x=make_mapset_copy(x_ref);
+  MAPvec *r1=make_mapset_copy(r_ref);
+  MAPvec *p1=make_mapset_copy(p_ref);
+  MAPvec *x1=make_mapset_copy(x_ref);
+  PCGWork *work=allocate_pcg_work(r);
+
+  actData tol=(nthread==1 ? 0 : TOL);
+  actData worst=0;
+  int nfail=0;
+  for (int step=0;step<NSTEP;step++) {
+    actData rsqr_ref;
+    ref_pcg_step(r_ref,p_ref,x_ref,tods,wts,params,&rsqr_ref);
+    actData rsqr=PCGstep_work(r,p,x,tods,wts,params,work);
+    actData rsqr1=PCGstep(r1,p1,x1,tods,wts,params);
+    actData err[]={compare_maps(x_ref->maps[0],x->maps[0]),compare_maps(r_ref->maps[0],r->maps[0]),compare_maps(p_ref->maps[0],p->maps[0]),
+		   compare_maps(x_ref->maps[0],x1->maps[0]),compare_maps(r_ref->maps[0],r1->maps[0]),compare_maps(p_ref->maps[0],p1->maps[0]),
+		   fabs(rsqr-rsqr_ref)/rsqr_ref,fabs(rsqr1-rsqr_ref)/rsqr_ref};
+    const char *names[]={"x","r","p","PCGstep x","PCGstep r","PCGstep p","r.M^-1 r","PCGstep r.M^-1 r"};
+    for (int i=0;i<8;i++) {
+      if (!(err[i]<=tol)) {
+	fprintf(stderr,"%s, step %d: %s differs by %12.4e.\n",what,step,names[i],err[i]);
+	nfail++;
+      }
+      if (!(err[i]<=worst))
+	worst=err[i];
+    }
+  }
+  printf("%s: largest relative difference over %d steps %12.4e\n",what,NSTEP,worst);
+  destroy_pcg_work(work);
+  omp_set_num_threads(NTHREAD);
+  return nfail;
+}
+/*--------------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+  TODvec tods;
+  memset(&tods,0,sizeof(tods));
+  tods.ntod=1;
+  tods.tods=make_test_tod();
+  PARAMS *params=(PARAMS *)calloc(1,sizeof(PARAMS));
+  *((actData *)params)=1.0;  //map2tod takes its scale factor from the front of params
+  params->precondition=true;
+  params->no_noise=true;
+
+  int nfail=0;
+#ifdef ACTPOL
+  nfail+=check_pcg_steps(&tods,params,3,false,1,"polarized map, 1 thread");
+  nfail+=check_pcg_steps(&tods,params,3,false,NTHREAD,"polarized map, threaded");
+#endif
+  nfail+=check_pcg_steps(&tods,params,1,false,1,"temperature map, 1 thread");
+  nfail+=check_pcg_steps(&tods,params,1,false,NTHREAD,"temperature map, threaded");
+  nfail+=check_pcg_steps(&tods,params,1,true,1,"tiled map, 1 thread");
+  nfail+=check_pcg_steps(&tods,params,1,true,NTHREAD,"tiled map, threaded");
+  if (nfail) {
+    fprintf(stderr,"%d PCG step comparisons failed.\n",nfail);
+    return 1;
+  }
+  printf("PCGstep_work matches the step built from the mapset calls.\n");
+  return 0;
+}
@@ -0,0 +1,89 @@
+//Check the vectorized pixelization kernels against the exact libm reference for
+//RECT, CEA and TAN maps.  Exits non-zero if any kernel lands points in the wrong pixel
+//more often than its approximation error allows.
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "ninkasi.h"
+#include "ninkasi_projection.h"
+
+#define NPT 1000000
+#define SEED 12345
+
+/*--------------------------------------------------------------------------------*/
+static MAP *new_test_map(actData ramin, actData ramax, actData decmin, actData decmax, actData pixsize)
+{
+  MAP *map=(MAP *)calloc(1,sizeof(MAP));
+  map->projection=(nkProjection *)calloc(1,sizeof(nkProjection));
+  map->ramin=ramin;
+  map->ramax=ramax;
+  map->decmin=decmin;
+  map->decmax=decmax;
+  map->pixsize=pixsize;
+  map->nx=(ramax-ramin)/pixsize+1;
+  map->ny=(decmax-decmin)/pixsize+1;
+  map->npix=map->nx*map->ny;
+  map->map=vector(map->npix);
+  return map;
+}
+/*--------------------------------------------------------------------------------*/
+static void free_test_map(MAP *map)
+{
+  free(map->map);
+  free(map->projection);
+  free(map);
+}
+/*--------------------------------------------------------------------------------*/
+static int run_check(const char *name, MAP *map, actData pixsize_rad)
+//sin5/cos5 are good to ~5e-8 radians, so a point can only change pixels if it sits within that
+//distance of a pixel edge.  Allow the fraction of points that close to an edge in either axis.
+{
+  long nbad=check_projection_kernels(map,NPT,SEED);
+  long nallow=0;
+  if (map->projection->proj_type!=NK_RECT)
+    nallow=(long)(NPT*(4*5e-8/pixsize_rad))+1;
+  printf("%s: %ld mismatches, %ld allowed.\n",name,nbad,nallow);
+  if (nbad>nallow) {
+    fprintf(stderr,"%s projection kernel disagrees with the exact reference.\n",name);
+    return 1;
+  }
+  return 0;
+}
+/*--------------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+  const actData pixsize=0.5/60*M_PI/180;  //half-arcminute pixels
+  const actData ramin=-0.3,ramax=0.3,decmin=-0.1,decmax=0.1;
+  int nfail=0;
+
+  MAP *map=new_test_map(ramin,ramax,decmin,decmax,pixsize);
+  map->projection->proj_type=NK_RECT;
+  nfail+=run_check("RECT",map,pixsize);
+  free_test_map(map);
+
+  map=new_test_map(ramin,ramax,decmin,decmax,pixsize);
+  set_map_projection_cea_simple(map);
+  nfail+=run_check("CEA",map,pixsize);
+  free_test_map(map);
+
+  //TAN off the equator, so the dec terms aren't trivial.  The limits are set by hand to
+  //stay well inside the tangent plane.
+  map=new_test_map(ramin,ramax,decmin,decmax,pixsize);
+  int nra=2*0.1/pixsize;
+  int ndec=2*0.1/pixsize;
+  set_map_projection_tan_predef(map,0.5,-0.4,nra/2,ndec/2,pixsize,nra,ndec);
+  map->ramin=0.5-0.08;
+  map->ramax=0.5+0.08;
+  map->decmin=-0.4-0.08;
+  map->decmax=-0.4+0.08;
+  nfail+=run_check("TAN",map,pixsize);
+  free_test_map(map);
+
+  if (nfail) {
+    fprintf(stderr,"%d projection checks failed.\n",nfail);
+    return 1;
+  }
+  printf("all projection checks passed.\n");
+  return 0;
+}
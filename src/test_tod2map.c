@@ -0,0 +1,209 @@
+//Check the threaded tod2map and tod2polmap paths (tile buckets, and tile buckets with cached
+//pivots, and the locked fallback) against a serial projection of the same TOD.  Exits non-zero
+//if any map differs by more than rounding.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+
+#include "ninkasi.h"
+#include "mbCuts.h"
+
+#define NDET 40
+#define NDATA 3000
+#define NPIX 100000
+#define NPIX_SMALL 1000  //too small for the buckets to be worth it
+#define NTHREAD 4
+#define TOL 1e-12
+
+/*--------------------------------------------------------------------------------*/
+static mbTOD *make_test_tod(long npix, long seed)
+//saved pixelization so no pointing model is needed, one detector always cut, and a few with
+//cut regions.
+{
+  mbTOD *tod=(mbTOD *)calloc(1,sizeof(mbTOD));
+  tod->ndet=NDET;
+  tod->ndata=NDATA;
+  tod->deltat=1.0/400;
+  tod->nrow=1;
+  tod->ncol=NDET;
+  tod->rows=(int *)calloc(NDET,sizeof(int));
+  tod->cols=(int *)malloc(sizeof(int)*NDET);
+  for (int i=0;i<NDET;i++)
+    tod->cols[i]=i;
+  tod->cuts=mbCutsAlloc(tod->nrow,tod->ncol);
+  mbCutsSetAlwaysCut(tod->cuts,0,3);
+  for (int i=5;i<NDET;i+=7)
+    mbCutsExtend(tod->cuts,100*i,100*i+250,0,i);
+  get_tod_uncut_regions(tod);
+  tod->data=matrix(NDET,NDATA);
+  tod->have_data=1;
+  tod->pixelization_saved=imatrix(NDET,NDATA);
+  srand48(seed);
+  for (int i=0;i<NDET;i++)
+    for (int j=0;j<NDATA;j++) {
+      //a drifting scan that revisits pixels, plus some scatter.
+      tod->pixelization_saved[i][j]=(37*i+11*j+lrand48()%50)%npix;
+      tod->data[i][j]=drand48()-0.5;
+    }
+#ifdef ACTPOL
+  tod->twogamma_saved=matrix(NDET,NDATA);
+  for (int i=0;i<NDET;i++)
+    for (int j=0;j<NDATA;j++)
+      tod->twogamma_saved[i][j]=2*M_PI*drand48();
+#endif
+  return tod;
+}
+/*--------------------------------------------------------------------------------*/
+static void set_test_kept_data(mbTOD *tod)
+//kept_data that differs from the uncuts: only the first half of every detector.
+{
+  mbCuts *cuts=tod->cuts;
+  tod->cuts=mbCutsAlloc(tod->nrow,tod->ncol);
+  mbCutsExtendGlobal(tod->cuts,NDATA/2,NDATA);
+  tod->kept_data=get_uncut_regions(tod);
+  tod->cuts=cuts;
+}
+/*--------------------------------------------------------------------------------*/
+static MAP *make_test_map(long npix, int npol)
+{
+  MAP *map=(MAP *)calloc(1,sizeof(MAP));
+  map->projection=(nkProjection *)calloc(1,sizeof(nkProjection));
+  map->projection->proj_type=NK_RECT;
+  map->nx=npix/100;
+  map->ny=100;
+  map->npix=npix;
+#ifdef ACTPOL
+  for (int i=0;i<npol;i++)
+    map->pol_state[i]=1;
+#endif
+  map->map=vector(npol*npix);
+  memset(map->map,0,sizeof(actData)*npol*npix);
+  return map;
+}
+/*--------------------------------------------------------------------------------*/
+static int compare_maps(const actData *ref, const actData *map, long n, const char *what)
+{
+  actData maxval=0,maxerr=0;
+  for (long i=0;i<n;i++) {
+    if (fabs(ref[i])>maxval)
+      maxval=fabs(ref[i]);
+    if (fabs(map[i]-ref[i])>maxerr)
+      maxerr=fabs(map[i]-ref[i]);
+  }
+  printf("%s: relative difference from serial %12.4e\n",what,maxerr/maxval);
+  if (!(maxerr<=TOL*maxval)) {
+    fprintf(stderr,"%s doesn't match the serial projection.\n",what);
+    return 1;
+  }
+  return 0;
+}
+/*--------------------------------------------------------------------------------*/
+static int check_tod2map(mbTOD *tod, long npix, const char *what)
+{
+  char name[128];
+  MAP *ref=make_test_map(npix,1);
+  MAP *map=make_test_map(npix,1);
+  int nfail=0;
+
+  omp_set_num_threads(1);
+  tod2map(ref,tod,NULL);
+
+  omp_set_num_threads(NTHREAD);
+  tod2map(map,tod,NULL);
+  sprintf(name,"%s tod2map",what);
+  nfail+=compare_maps(ref->map,map->map,npix,name);
+  //second call reuses the buckets cached on the TOD.
+  memset(map->map,0,sizeof(actData)*npix);
+  tod2map(map,tod,NULL);
+  sprintf(name,"%s tod2map, second call",what);
+  nfail+=compare_maps(ref->map,map->map,npix,name);
+
+  //pivots cached on the map send tod2map down the pivoted path.
+  memset(map->map,0,sizeof(actData)*npix);
+  tod2map_actpol(map,tod,NULL);
+  sprintf(name,"%s tod2map_actpol",what);
+  nfail+=compare_maps(ref->map,map->map,npix,name);
+  memset(map->map,0,sizeof(actData)*npix);
+  tod2map(map,tod,NULL);
+  sprintf(name,"%s tod2map with pivots",what);
+  nfail+=compare_maps(ref->map,map->map,npix,name);
+
+  //pivots from a hit map, as run_PCG takes them from the weights.
+  MAP *hits=make_test_map(npix,1);
+  for (int i=0;i<tod->ndet;i++)
+    for (int j=0;j<tod->ndata;j++)
+      hits->map[tod->pixelization_saved[i][j]]++;
+  set_map_pivots_from_hit_map(map,hits);
+  memset(map->map,0,sizeof(actData)*npix);
+  tod2map(map,tod,NULL);
+  sprintf(name,"%s tod2map with hit map pivots",what);
+  nfail+=compare_maps(ref->map,map->map,npix,name);
+  return nfail;
+}
+/*--------------------------------------------------------------------------------*/
+#ifdef ACTPOL
+static int check_tod2polmap(mbTOD *tod, long npix, const char *what)
+{
+  char name[128];
+  MAP *ref=make_test_map(npix,3);
+  MAP *map=make_test_map(npix,3);
+  int nfail=0;
+
+  omp_set_num_threads(1);
+  tod2polmap(ref,tod);
+
+  omp_set_num_threads(NTHREAD);
+  tod2polmap(map,tod);
+  sprintf(name,"%s tod2polmap",what);
+  nfail+=compare_maps(ref->map,map->map,3*npix,name);
+
+  //alternate with tod2map, as PCG does.  The buckets shouldn't be remade unless kept_data
+  //gives tod2map a different set of samples.
+  MAP *tmap=make_test_map(npix,1);
+  tmap->projection=map->projection;
+  MapTileBuckets *buckets=tod->tile_buckets;
+  tod2map(tmap,tod,NULL);
+  memset(map->map,0,sizeof(actData)*3*npix);
+  tod2polmap(map,tod);
+  sprintf(name,"%s tod2polmap after tod2map",what);
+  nfail+=compare_maps(ref->map,map->map,3*npix,name);
+  if ((buckets)&&(tod->kept_data==NULL)&&(tod->tile_buckets!=buckets)) {
+    fprintf(stderr,"%s: tod2map and tod2polmap didn't share the tile buckets.\n",what);
+    nfail++;
+  }
+  return nfail;
+}
+#endif
+/*--------------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+  int nfail=0;
+
+  mbTOD *tod=make_test_tod(NPIX,1);
+  nfail+=check_tod2map(tod,NPIX,"bucketed");
+#ifdef ACTPOL
+  nfail+=check_tod2polmap(tod,NPIX,"bucketed");
+#endif
+  set_test_kept_data(tod);
+  nfail+=check_tod2map(tod,NPIX,"kept_data");
+#ifdef ACTPOL
+  nfail+=check_tod2polmap(tod,NPIX,"kept_data");
+#endif
+  free_tod_map_tile_buckets(tod);
+
+  mbTOD *small=make_test_tod(NPIX_SMALL,2);
+  nfail+=check_tod2map(small,NPIX_SMALL,"small map");
+#ifdef ACTPOL
+  nfail+=check_tod2polmap(small,NPIX_SMALL,"small map");
+#endif
+  free_tod_map_tile_buckets(small);
+
+  if (nfail) {
+    fprintf(stderr,"%d threaded projections failed.\n",nfail);
+    return 1;
+  }
+  printf("all threaded projections match.\n");
+  return 0;
+}